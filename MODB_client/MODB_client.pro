@@ -9,6 +9,8 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    asynclogger.cpp \
+    binaryprotocol.cpp \
     chatdialog.cpp \
     connectdialog.cpp \
     drawingtool.cpp \
@@ -19,9 +21,12 @@ SOURCES += \
     client.cpp \
     networkprotocol.cpp \
     roomdialog.cpp \
+    strokeitem.cpp \
     websocketmanager.cpp
 
 HEADERS += \
+    asynclogger.h \
+    binaryprotocol.h \
     chatdialog.h \
     client.h \
     connectdialog.h \
@@ -31,6 +36,7 @@ HEADERS += \
     ledindicator.h \
     networkprotocol.h \
     roomdialog.h \
+    strokeitem.h \
     websocketmanager.h
 
 FORMS += \
@@ -0,0 +1,48 @@
+# 客户端绘制压测：和 MODB_client.pro 共用客户端源码（不包括 main.cpp），默认使用离屏平台运行
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets websockets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = MODB_renderbench
+
+SOURCES += \
+    asynclogger.cpp \
+    binaryprotocol.cpp \
+    chatdialog.cpp \
+    connectdialog.cpp \
+    drawingtool.cpp \
+    filemanager.cpp \
+    helpmanager.cpp \
+    ledindicator.cpp \
+    client.cpp \
+    networkprotocol.cpp \
+    renderbench_main.cpp \
+    renderbenchmark.cpp \
+    roomdialog.cpp \
+    strokeitem.cpp \
+    websocketmanager.cpp
+
+HEADERS += \
+    asynclogger.h \
+    binaryprotocol.h \
+    chatdialog.h \
+    client.h \
+    connectdialog.h \
+    drawingtool.h \
+    filemanager.h \
+    helpmanager.h \
+    ledindicator.h \
+    networkprotocol.h \
+    renderbenchmark.h \
+    roomdialog.h \
+    strokeitem.h \
+    websocketmanager.h
+
+FORMS += \
+    client.ui
+
+RESOURCES += \
+    resources.qrc
@@ -0,0 +1,180 @@
+﻿#include "asynclogger.h"
+#include <QDateTime>
+#include <cstdio>
+
+QAtomicInt AsyncLogger::s_level(LL_Info);
+
+AsyncLogger &AsyncLogger::instance()
+{
+    static AsyncLogger logger;
+    return logger;
+}
+
+AsyncLogger::AsyncLogger()
+    : m_slots(new Slot[Capacity])
+    , m_enqueuePos(0)
+    , m_dequeuePos(0)
+    , m_dropped(0)
+    , m_running(0)
+    , m_writer(nullptr)
+{
+    for (quint64 i = 0; i < Capacity; ++i) {
+        m_slots[i].sequence.storeRelaxed(i);
+    }
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+}
+
+void AsyncLogger::setLevel(LogLevel level)
+{
+    s_level.storeRelaxed(level);
+}
+
+LogLevel AsyncLogger::levelFromName(const QString &name, LogLevel fallback)
+{
+    const QString lower = name.trimmed().toLower();
+    if (lower == "debug") return LL_Debug;
+    if (lower == "info") return LL_Info;
+    if (lower == "warning" || lower == "warn") return LL_Warning;
+    if (lower == "error") return LL_Error;
+    if (lower == "off") return LL_Off;
+    return fallback;
+}
+
+void AsyncLogger::start()
+{
+    if (m_writer) return;
+
+    m_running.storeRelease(1);
+    m_writer = QThread::create([this]() { writerLoop(); });
+    m_writer->setObjectName("AsyncLogger");
+    m_writer->start();
+    qInstallMessageHandler(&AsyncLogger::messageHandler);
+}
+
+void AsyncLogger::stop()
+{
+    if (!m_writer) return;
+
+    qInstallMessageHandler(nullptr);
+    m_running.storeRelease(0);
+    m_writer->wait();
+    delete m_writer;
+    m_writer = nullptr;
+}
+
+void AsyncLogger::submit(LogLevel level, const char *category, QString &&message)
+{
+    Record record;
+    record.level = level;
+    record.category = category;
+    record.timestamp = QDateTime::currentMSecsSinceEpoch();
+    record.threadId = reinterpret_cast<quintptr>(QThread::currentThreadId());
+    record.message = std::move(message);
+
+    // 写线程没有运行时直接输出
+    if (!m_running.loadAcquire()) {
+        std::fprintf(stderr, "%s\n", record.message.toLocal8Bit().constData());
+        return;
+    }
+    if (!tryPush(std::move(record))) {
+        m_dropped.fetchAndAddRelaxed(1);
+    }
+}
+
+// 有界无锁队列：每个槽的序号表示槽的状态，序号等于入队位置时可写，等于位置+1时可读
+bool AsyncLogger::tryPush(Record &&record)
+{
+    quint64 pos = m_enqueuePos.loadRelaxed();
+    Slot *slot;
+    forever {
+        slot = &m_slots[pos & (Capacity - 1)];
+        const quint64 sequence = slot->sequence.loadAcquire();
+        const qint64 diff = static_cast<qint64>(sequence - pos);
+        if (diff == 0) {
+            if (m_enqueuePos.testAndSetRelaxed(pos, pos + 1, pos)) break;
+        } else if (diff < 0) {
+            return false;   // 缓冲区已满
+        } else {
+            pos = m_enqueuePos.loadRelaxed();
+        }
+    }
+    slot->record = std::move(record);
+    slot->sequence.storeRelease(pos + 1);
+    return true;
+}
+
+bool AsyncLogger::tryPop(Record &record)
+{
+    Slot &slot = m_slots[m_dequeuePos & (Capacity - 1)];
+    if (slot.sequence.loadAcquire() != m_dequeuePos + 1) return false;
+
+    record = std::move(slot.record);
+    slot.record = Record();
+    slot.sequence.storeRelease(m_dequeuePos + Capacity);
+    ++m_dequeuePos;
+    return true;
+}
+
+void AsyncLogger::writerLoop()
+{
+    static const char *const levelNames[] = {"DEBUG", "INFO", "WARN", "ERROR", "OFF"};
+
+    forever {
+        // 先读取运行状态再取记录，保证停止之前提交的记录都能写出
+        const bool running = m_running.loadAcquire();
+
+        QByteArray batch;
+        Record record;
+        while (tryPop(record)) {
+            batch += QDateTime::fromMSecsSinceEpoch(record.timestamp).toString("yyyy-MM-dd HH:mm:ss.zzz").toLatin1();
+            batch += ' ';
+            batch += levelNames[record.level];
+            batch += " [";
+            batch += record.category ? record.category : "qt";
+            batch += "] ";
+            batch += QByteArray::number(static_cast<qulonglong>(record.threadId), 16);
+            batch += ' ';
+            batch += record.message.toUtf8();
+            batch += '\n';
+        }
+
+        const quint64 dropped = m_dropped.fetchAndStoreRelaxed(0);
+        if (dropped > 0) {
+            batch += "日志缓冲区已满，丢弃 " + QByteArray::number(dropped) + " 条记录\n";
+        }
+
+        if (!batch.isEmpty()) {
+            std::fwrite(batch.constData(), 1, static_cast<size_t>(batch.size()), stderr);
+            std::fflush(stderr);
+        } else if (!running) {
+            break;
+        } else {
+            QThread::msleep(IdleSleepMs);
+        }
+    }
+}
+
+// qDebug/qWarning等也经过异步日志，级别未开启的直接丢弃
+void AsyncLogger::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    LogLevel level;
+    switch (type) {
+        case QtDebugMsg: level = LL_Debug; break;
+        case QtInfoMsg: level = LL_Info; break;
+        case QtWarningMsg: level = LL_Warning; break;
+        case QtCriticalMsg: level = LL_Error; break;
+        case QtFatalMsg:
+        default:
+            // 致命错误之后进程立即结束，同步输出
+            std::fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+            std::fflush(stderr);
+            return;
+    }
+    if (!isEnabled(level)) return;
+    Q_UNUSED(context)
+    instance().submit(level, nullptr, QString(message));
+}
@@ -0,0 +1,112 @@
+﻿#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <QAtomicInteger>
+#include <QDebug>
+#include <QString>
+#include <QThread>
+#include <memory>
+#include <optional>
+
+enum LogLevel {
+    LL_Debug = 0,
+    LL_Info,
+    LL_Warning,
+    LL_Error,
+    LL_Off
+};
+
+// 异步日志：调用方只把记录放入无锁环形缓冲区（多生产者单消费者），由后台线程格式化并批量写出，
+// 每批次只flush一次。级别未开启时日志语句只有一次原子读取和一次分支，参数不会被求值；
+// 缓冲区满时丢弃记录并计数，不阻塞调用方
+class AsyncLogger
+{
+public:
+    static AsyncLogger &instance();
+
+    static bool isEnabled(LogLevel level) { return level >= s_level.loadRelaxed(); }
+    static void setLevel(LogLevel level);
+    static LogLevel levelFromName(const QString &name, LogLevel fallback);
+
+    // 启动后台写线程，并接管qDebug/qWarning等Qt日志输出
+    void start();
+    // 写完缓冲区中剩余的记录并停止写线程
+    void stop();
+
+    void submit(LogLevel level, const char *category, QString &&message);
+
+private:
+    struct Record {
+        LogLevel level = LL_Info;
+        const char *category = nullptr;
+        qint64 timestamp = 0;           // Unix毫秒，写出时才格式化
+        quintptr threadId = 0;
+        QString message;
+    };
+
+    struct Slot {
+        QAtomicInteger<quint64> sequence;
+        Record record;
+    };
+
+    static constexpr quint64 Capacity = 8192;   // 2的幂
+    static constexpr int IdleSleepMs = 5;
+
+    AsyncLogger();
+    ~AsyncLogger();
+
+    bool tryPush(Record &&record);
+    bool tryPop(Record &record);
+    void writerLoop();
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message);
+
+    static QAtomicInt s_level;
+
+    std::unique_ptr<Slot[]> m_slots;
+    QAtomicInteger<quint64> m_enqueuePos;
+    quint64 m_dequeuePos;               // 只由写线程访问
+    QAtomicInteger<quint64> m_dropped;
+    QAtomicInt m_running;
+    QThread *m_writer;
+};
+
+// 一条日志语句：用QDebug拼接参数，析构时提交到异步日志
+class LogLine
+{
+public:
+    LogLine(LogLevel level, const char *category)
+        : m_level(level), m_category(category)
+    {
+        m_stream.emplace(&m_message);
+        m_stream->noquote();
+    }
+    ~LogLine()
+    {
+        // QDebug析构时才把内容写入m_message
+        m_stream.reset();
+        AsyncLogger::instance().submit(m_level, m_category, std::move(m_message));
+    }
+
+    template <typename T>
+    LogLine &operator<<(const T &value)
+    {
+        *m_stream << value;
+        return *this;
+    }
+
+private:
+    LogLevel m_level;
+    const char *m_category;
+    QString m_message;
+    std::optional<QDebug> m_stream;
+};
+
+// 级别未开启时整条语句（包括参数）都不会执行
+#define MODB_LOG(level, category) \
+    if (!AsyncLogger::isEnabled(level)) {} else LogLine(level, category)
+#define LOG_DEBUG(category) MODB_LOG(LL_Debug, category)
+#define LOG_INFO(category) MODB_LOG(LL_Info, category)
+#define LOG_WARNING(category) MODB_LOG(LL_Warning, category)
+#define LOG_ERROR(category) MODB_LOG(LL_Error, category)
+
+#endif // ASYNCLOGGER_H
@@ -0,0 +1,318 @@
+﻿#include "binaryprotocol.h"
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+
+namespace {
+// 防止恶意帧通过深度嵌套耗尽栈空间
+const int MaxNestingDepth = 32;
+// 双精度可精确表示的最大整数
+const double MaxExactInteger = 9007199254740992.0;
+}
+
+QByteArray BinaryCodec::encode(const NetworkMessage &message)
+{
+    QByteArray out;
+    out.reserve(64);
+    out.append(static_cast<char>(FrameMagic));
+    out.append(static_cast<char>(FrameVersion));
+    writeVarint(out, static_cast<quint64>(message.type));
+    writeString(out, message.senderId);
+    writeSignedVarint(out, message.timestamp);
+    writeObject(out, message.data);
+    return out;
+}
+
+bool BinaryCodec::decode(const QByteArray &frame, NetworkMessage &message)
+{
+    Reader in;
+    in.pos = reinterpret_cast<const uchar*>(frame.constData());
+    in.end = in.pos + frame.size();
+
+    if (in.end - in.pos < 2) return false;
+    if (*in.pos++ != FrameMagic) return false;
+    if (*in.pos++ != FrameVersion) return false;
+
+    quint64 type = 0;
+    QString senderId;
+    qint64 timestamp = 0;
+    QJsonObject data;
+    if (!readVarint(in, type) || !readString(in, senderId) ||
+        !readSignedVarint(in, timestamp) || !readObject(in, 0, data)) {
+        return false;
+    }
+    // 帧尾不允许有多余数据
+    if (in.pos != in.end) return false;
+
+    message.type = static_cast<MessageType>(type);
+    message.senderId = senderId;
+    message.timestamp = timestamp;
+    message.data = data;
+    return true;
+}
+
+QString BinaryCodec::formatName(WireFormat format)
+{
+    return format == WF_Binary ? QStringLiteral("binary") : QStringLiteral("json");
+}
+
+WireFormat BinaryCodec::formatFromName(const QString &name)
+{
+    return name == QLatin1String("binary") ? WF_Binary : WF_Json;
+}
+
+void BinaryCodec::writeVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+void BinaryCodec::writeSignedVarint(QByteArray &out, qint64 value)
+{
+    // zigzag：小的负数也编码成短的varint
+    writeVarint(out, (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63));
+}
+
+void BinaryCodec::writeDouble(QByteArray &out, double value)
+{
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    char buffer[sizeof(bits)];
+    qToLittleEndian<quint64>(bits, buffer);
+    out.append(buffer, sizeof(buffer));
+}
+
+void BinaryCodec::writeString(QByteArray &out, const QString &str)
+{
+    const QByteArray utf8 = str.toUtf8();
+    writeVarint(out, static_cast<quint64>(utf8.size()));
+    out.append(utf8);
+}
+
+void BinaryCodec::writeValue(QByteArray &out, const QJsonValue &value)
+{
+    switch (value.type()) {
+    case QJsonValue::Bool:
+        out.append(static_cast<char>(value.toBool() ? VT_True : VT_False));
+        break;
+    case QJsonValue::Double: {
+        const double number = value.toDouble();
+        // 整数（颜色、线宽、类型等）走varint，其余保留完整精度
+        if (std::floor(number) == number && std::fabs(number) <= MaxExactInteger) {
+            out.append(static_cast<char>(VT_Int));
+            writeSignedVarint(out, static_cast<qint64>(number));
+        } else {
+            out.append(static_cast<char>(VT_Double));
+            writeDouble(out, number);
+        }
+        break;
+    }
+    case QJsonValue::String:
+        out.append(static_cast<char>(VT_String));
+        writeString(out, value.toString());
+        break;
+    case QJsonValue::Array: {
+        const QJsonArray array = value.toArray();
+        out.append(static_cast<char>(VT_Array));
+        writeVarint(out, static_cast<quint64>(array.size()));
+        for (const QJsonValue &item : array) {
+            writeValue(out, item);
+        }
+        break;
+    }
+    case QJsonValue::Object: {
+        const QJsonObject object = value.toObject();
+        QByteArray blob;
+        if (isPathBlob(object, blob)) {
+            out.append(static_cast<char>(VT_PathBlob));
+            writePathBlob(out, object, blob);
+        } else {
+            out.append(static_cast<char>(VT_Object));
+            writeObject(out, object);
+        }
+        break;
+    }
+    default:
+        out.append(static_cast<char>(VT_Null));
+        break;
+    }
+}
+
+void BinaryCodec::writeObject(QByteArray &out, const QJsonObject &object)
+{
+    writeVarint(out, static_cast<quint64>(object.size()));
+    for (auto it = object.begin(); it != object.end(); ++it) {
+        writeString(out, it.key());
+        writeValue(out, it.value());
+    }
+}
+
+// 判断对象是否为 DrawingOperation::encodePath 生成的路径：
+// 只有base64重新编码后和原字符串完全一致时才打包，保证解码得到的JSON和原来相同
+bool BinaryCodec::isPathBlob(const QJsonObject &object, QByteArray &blob)
+{
+    if (object.size() != 4 || object["enc"].toString() != QLatin1String("qdelta")) return false;
+    const QJsonValue version = object["v"];
+    const QJsonValue count = object["n"];
+    const QJsonValue data = object["data"];
+    if (!version.isDouble() || !count.isDouble() || !data.isString()) return false;
+    // toInteger对非整数返回默认值
+    if (version.toInteger(-1) < 0 || count.toInteger(-1) < 0) return false;
+
+    const QByteArray base64 = data.toString().toLatin1();
+    auto decoded = QByteArray::fromBase64Encoding(base64, QByteArray::AbortOnBase64DecodingErrors);
+    if (!decoded || decoded.decoded.toBase64() != base64) return false;
+    blob = decoded.decoded;
+    return true;
+}
+
+void BinaryCodec::writePathBlob(QByteArray &out, const QJsonObject &object, const QByteArray &blob)
+{
+    writeVarint(out, static_cast<quint64>(object["v"].toInteger()));
+    writeVarint(out, static_cast<quint64>(object["n"].toInteger()));
+    writeVarint(out, static_cast<quint64>(blob.size()));
+    out.append(blob);
+}
+
+bool BinaryCodec::readVarint(Reader &in, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (in.pos >= in.end) return false;
+        const uchar byte = *in.pos++;
+        value |= static_cast<quint64>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool BinaryCodec::readSignedVarint(Reader &in, qint64 &value)
+{
+    quint64 raw = 0;
+    if (!readVarint(in, raw)) return false;
+    value = static_cast<qint64>(raw >> 1) ^ -static_cast<qint64>(raw & 1);
+    return true;
+}
+
+bool BinaryCodec::readDouble(Reader &in, double &value)
+{
+    if (in.end - in.pos < 8) return false;
+    const quint64 bits = qFromLittleEndian<quint64>(in.pos);
+    std::memcpy(&value, &bits, sizeof(value));
+    in.pos += 8;
+    return true;
+}
+
+bool BinaryCodec::readString(Reader &in, QString &str)
+{
+    quint64 length = 0;
+    if (!readVarint(in, length)) return false;
+    if (length > static_cast<quint64>(in.end - in.pos)) return false;
+    str = QString::fromUtf8(reinterpret_cast<const char*>(in.pos), static_cast<qsizetype>(length));
+    in.pos += length;
+    return true;
+}
+
+bool BinaryCodec::readValue(Reader &in, int depth, QJsonValue &value)
+{
+    if (depth > MaxNestingDepth || in.pos >= in.end) return false;
+
+    switch (*in.pos++) {
+    case VT_Null:
+        value = QJsonValue();
+        return true;
+    case VT_False:
+        value = false;
+        return true;
+    case VT_True:
+        value = true;
+        return true;
+    case VT_Int: {
+        qint64 number = 0;
+        if (!readSignedVarint(in, number)) return false;
+        value = number;
+        return true;
+    }
+    case VT_Double: {
+        double number = 0;
+        if (!readDouble(in, number)) return false;
+        value = number;
+        return true;
+    }
+    case VT_String: {
+        QString str;
+        if (!readString(in, str)) return false;
+        value = str;
+        return true;
+    }
+    case VT_Array: {
+        quint64 count = 0;
+        if (!readVarint(in, count)) return false;
+        // 每个元素至少占一个字节
+        if (count > static_cast<quint64>(in.end - in.pos)) return false;
+        QJsonArray array;
+        for (quint64 i = 0; i < count; ++i) {
+            QJsonValue item;
+            if (!readValue(in, depth + 1, item)) return false;
+            array.append(item);
+        }
+        value = array;
+        return true;
+    }
+    case VT_Object: {
+        QJsonObject object;
+        if (!readObject(in, depth + 1, object)) return false;
+        value = object;
+        return true;
+    }
+    case VT_PathBlob: {
+        QJsonObject object;
+        if (!readPathBlob(in, object)) return false;
+        value = object;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool BinaryCodec::readObject(Reader &in, int depth, QJsonObject &object)
+{
+    quint64 count = 0;
+    if (!readVarint(in, count)) return false;
+    if (count > static_cast<quint64>(in.end - in.pos)) return false;
+    for (quint64 i = 0; i < count; ++i) {
+        QString key;
+        QJsonValue item;
+        if (!readString(in, key) || !readValue(in, depth, item)) return false;
+        object.insert(key, item);
+    }
+    return true;
+}
+
+bool BinaryCodec::readPathBlob(Reader &in, QJsonObject &object)
+{
+    quint64 version = 0;
+    quint64 count = 0;
+    quint64 length = 0;
+    if (!readVarint(in, version) || !readVarint(in, count) || !readVarint(in, length)) return false;
+    // JSON数字只能精确表示2^53以内的整数
+    if (version > static_cast<quint64>(MaxExactInteger) || count > static_cast<quint64>(MaxExactInteger)) {
+        return false;
+    }
+    if (length > static_cast<quint64>(in.end - in.pos)) return false;
+
+    const QByteArray blob = QByteArray::fromRawData(reinterpret_cast<const char*>(in.pos),
+                                                    static_cast<qsizetype>(length));
+    in.pos += length;
+    object = QJsonObject{
+        {"enc", "qdelta"},
+        {"v", static_cast<qint64>(version)},
+        {"n", static_cast<qint64>(count)},
+        {"data", QString::fromLatin1(blob.toBase64())}
+    };
+    return true;
+}
@@ -0,0 +1,73 @@
+﻿#ifndef BINARYPROTOCOL_H
+#define BINARYPROTOCOL_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+#include "networkprotocol.h"
+
+// 线协议格式，连接建立时通过 MT_ProtocolHello 协商，JSON 始终作为回退格式
+enum WireFormat {
+    WF_Json = 0,            // JSON文本帧（sendTextMessage）
+    WF_Binary = 1           // 紧凑二进制帧（sendBinaryMessage）
+};
+
+// 二进制帧编解码
+// 帧格式: [magic][version][type varint][senderId][timestamp zigzag varint][data]
+// 整数使用 varint/zigzag 编码，字符串为 varint长度 + UTF-8，
+// DrawingOperation::encodePath 生成的路径（base64的qdelta差分数据）直接携带原始字节，
+// base64只在JSON帧中使用
+class BinaryCodec
+{
+public:
+    static constexpr quint8 FrameMagic = 0xB7;
+    // 版本2：路径以原始qdelta字节携带（版本1的定点路径数组已经不再使用）
+    static constexpr quint8 FrameVersion = 2;
+
+    static QByteArray encode(const NetworkMessage &message);
+    static bool decode(const QByteArray &frame, NetworkMessage &message);
+
+    // 协商时使用的格式名称
+    static QString formatName(WireFormat format);
+    static WireFormat formatFromName(const QString &name);
+
+private:
+    enum ValueTag : quint8 {
+        VT_Null = 0,
+        VT_False,
+        VT_True,
+        VT_Int,             // zigzag varint
+        VT_Double,          // 8字节小端
+        VT_String,
+        VT_Array,
+        VT_Object,
+        VT_PathBlob         // qdelta路径：版本、元素数量和原始差分字节
+    };
+
+    // 解码游标
+    struct Reader {
+        const uchar *pos;
+        const uchar *end;
+    };
+
+    static void writeVarint(QByteArray &out, quint64 value);
+    static void writeSignedVarint(QByteArray &out, qint64 value);
+    static void writeDouble(QByteArray &out, double value);
+    static void writeString(QByteArray &out, const QString &str);
+    static void writeValue(QByteArray &out, const QJsonValue &value);
+    static void writeObject(QByteArray &out, const QJsonObject &object);
+    // 判断对象是否为encodePath生成的路径，是的话返回解码后的差分字节
+    static bool isPathBlob(const QJsonObject &object, QByteArray &blob);
+    static void writePathBlob(QByteArray &out, const QJsonObject &object, const QByteArray &blob);
+
+    static bool readVarint(Reader &in, quint64 &value);
+    static bool readSignedVarint(Reader &in, qint64 &value);
+    static bool readDouble(Reader &in, double &value);
+    static bool readString(Reader &in, QString &str);
+    static bool readValue(Reader &in, int depth, QJsonValue &value);
+    static bool readObject(Reader &in, int depth, QJsonObject &object);
+    static bool readPathBlob(Reader &in, QJsonObject &object);
+};
+
+#endif // BINARYPROTOCOL_H
@@ -24,7 +24,7 @@ Client::Client(QWidget *parent)
         this->setStyleSheet(strCss);
         file.close();
     } else {
-        qDebug() << "无法加载CSS文件";
+        LOG_WARNING("ui") << "无法加载CSS文件";
     }
 
     is_full = false;
@@ -65,7 +65,7 @@ Client::Client(QWidget *parent)
     // 设置视图的鼠标事件转发
     ui->whiteBoard->setMouseTracking(true);
     if(ui -> whiteBoard -> viewport()){
-        std::cout<<"ui -> whiteBoard -> viewport"<<std::endl;
+        LOG_DEBUG("ui") << "ui -> whiteBoard -> viewport";
     }
     Q_ASSERT(ui->whiteBoard->viewport() != nullptr);
     // 开启事件过滤器，鼠标事件得以被捕获和处理，从而调用对应的绘图方法
@@ -92,6 +92,9 @@ Client::Client(QWidget *parent)
         QMessageBox::warning(this, "错误", message);
     });
 
+    // 新建/打开文件会删除场景中的图形，撤销历史随之作废
+    connect(m_fileManager, &FileManager::sceneAboutToBeCleared, m_drawingTool, &DrawingTool::resetHistory);
+
     // 连接修改信号
     connect(m_drawingTool, &DrawingTool::contentModified, this, [this]() {
         // 只要修改了内容之后，需要标注当前是已修改状态
@@ -135,7 +138,7 @@ Client::Client(QWidget *parent)
     connect(ui->clear, &QAction::triggered, this, &Client::on_clearAction);
     // 在Client构造函数中添加调试连接
     connect(ui->undo, &QAction::triggered, this, [this]() {
-        qDebug() << "撤销按钮被点击";
+        LOG_DEBUG("ui") << "撤销按钮被点击";
         try {
             m_drawingTool->undo();
         } catch (const std::exception& e) {
@@ -148,7 +151,7 @@ Client::Client(QWidget *parent)
     });
 
     connect(ui->redo, &QAction::triggered, this, [this]() {
-        qDebug() << "重做按钮被点击";
+        LOG_DEBUG("ui") << "重做按钮被点击";
         try {
             this -> on_redoAction();
         } catch (const std::exception& e) {
@@ -300,6 +303,8 @@ Client::Client(QWidget *parent)
 
 Client::~Client()
 {
+    // 场景销毁之前先释放只被撤销/重做历史持有的图形
+    m_drawingTool->resetHistory();
     delete ui;
 }
 
@@ -830,14 +835,15 @@ void Client::onClearSceneReceived()
     m_drawingTool->clearScene();
 }
 
-void Client::onUndoRequestReceived()
+// 其他客户端的撤销/重做只改变本地画面，不再作为本地的撤销/重做转发给服务端
+void Client::onUndoRequestReceived(const DrawingOperation &operation)
 {
-    m_drawingTool->undo();
+    m_drawingTool->processNetworkOperation(operation);
 }
 
-void Client::onRedoRequestReceived()
+void Client::onRedoRequestReceived(const DrawingOperation &operation)
 {
-    m_drawingTool->redo();
+    m_drawingTool->processNetworkOperation(operation);
 }
 
 void Client::setOnlineMode(bool online)
@@ -1161,21 +1167,21 @@ void Client::on_font_weight_valueChanged(int arg1)
 
 void Client::onUndoRequestedWithData(const DrawingOperation &operation)
 {
-    qDebug() << "处理带数据的撤销请求，操作类型:" << operation.opType;
+    LOG_DEBUG("net") << "处理带数据的撤销请求，操作类型:" << operation.opType;
 
     if (m_webSocketManager && m_webSocketManager->isConnected()) {
         try {
             // 创建网络消息
             NetworkMessage message;
             message.type = MT_UndoRequest;
-            message.timestamp = QDateTime::currentSecsSinceEpoch();
+            message.timestamp = QDateTime::currentMSecsSinceEpoch();
             message.senderId = m_webSocketManager->getUserId();
             message.data = operation.toJson();
 
             // 发送到服务器
             m_webSocketManager->sendNetworkMessage(message);
 
-            qDebug() << "已发送撤销请求到服务器";
+            LOG_DEBUG("net") << "已发送撤销请求到服务器";
 
         } catch (const std::exception& e) {
             qCritical() << "发送撤销请求失败:" << e.what();
@@ -1192,21 +1198,21 @@ void Client::onUndoRequestedWithData(const DrawingOperation &operation)
 
 void Client::onRedoRequestedWithData(const DrawingOperation &operation)
 {
-    qDebug() << "处理带数据的重做请求，操作类型:" << operation.opType;
+    LOG_DEBUG("net") << "处理带数据的重做请求，操作类型:" << operation.opType;
 
     if (m_webSocketManager && m_webSocketManager->isConnected()) {
         try {
             // 创建网络消息
             NetworkMessage message;
             message.type = MT_RedoRequest;
-            message.timestamp = QDateTime::currentSecsSinceEpoch();
+            message.timestamp = QDateTime::currentMSecsSinceEpoch();
             message.senderId = m_webSocketManager->getUserId();
             message.data = operation.toJson();
 
             // 发送到服务器
             m_webSocketManager->sendNetworkMessage(message);
 
-            qDebug() << "已发送重做请求到服务器";
+            LOG_DEBUG("net") << "已发送重做请求到服务器";
 
         } catch (const std::exception& e) {
             qCritical() << "发送重做请求失败:" << e.what();
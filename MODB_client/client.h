@@ -34,6 +34,8 @@ QT_END_NAMESPACE
 class Client : public QMainWindow
 {
     Q_OBJECT
+    // 绘制压测直接访问绘图工具和网格
+    friend class RenderBenchmark;
 
 public:
     Client(QWidget *parent = nullptr);
@@ -103,8 +105,8 @@ private slots:
     void onClearSceneRequested();
     void onUndoRequested();
     void onRedoRequested();
-    void onUndoRequestReceived();
-    void onRedoRequestReceived();
+    void onUndoRequestReceived(const DrawingOperation &operation);
+    void onRedoRequestReceived(const DrawingOperation &operation);
     void setOnlineMode(bool online);
 
     void disconnectClient();
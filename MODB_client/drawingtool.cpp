@@ -5,11 +5,12 @@
 #include <QGraphicsEllipseItem>
 #include <QGraphicsTextItem>
 #include <QPen>
+#include <QUuid>
 
 DrawingTool::DrawingTool(QGraphicsScene *scene, QObject *parent)
     : QObject(parent), m_scene(scene), m_currentTool(Pencil), m_tempItem(nullptr),
+    m_reclaimedItems(0),
     m_isOnlineMode(false) // 默认离线模式
-    , m_currentNetworkPath(nullptr)
 {
     // 初始化画笔和画刷
     m_pen.setColor(Qt::black);
@@ -25,7 +26,6 @@ DrawingTool::DrawingTool(QGraphicsScene *scene, QObject *parent)
     pen_width = 1;
 
     m_isErasing = false;
-    m_erasedItems.clear();
 
     m_currentPath = nullptr;
     font_weight = 12;
@@ -73,8 +73,8 @@ void DrawingTool::mousePressEvent(QGraphicsSceneMouseEvent *event)
         break;
     case Eraser:
         m_isErasing = true;
-        // 保存橡皮擦操作前的状态
-        saveState();
+        // 之前未提交的改变单独作为一条记录，这次拖动擦除的图形合并为一条记录
+        commitAction();
         // 显示橡皮擦预览
         drawEraser(event);
         // 执行擦除操作
@@ -143,18 +143,29 @@ void DrawingTool::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
             m_tempItem = nullptr;
         }
 
-        // 橡皮擦操作完成，保存状态
-        saveState();
+        // 橡皮擦操作完成，整个拖动过程擦除的图形作为一条撤销记录
+        QString operationId = DrawingOperation::generateId();
+        int erasedCount = m_pendingEntry.removed.size();
+        QStringList erasedIds = itemIds(m_pendingEntry.removed);
+        if (!erasedIds.isEmpty()) {
+            m_erasedById.insert(operationId, erasedIds);
+        }
+        commitAction(operationId);
 
-        // 如果是网络模式，发送橡皮擦操作
-        if (m_isOnlineMode) {
+        // 如果是网络模式，擦除了图形就发送橡皮擦操作。被擦除的图形都有id时带上id，其他客户端按id擦除；
+        // 有没有id的图形（例如旧版本历史中的图形）时只发送位置和大小，和不认识id的旧客户端一样按位置擦除
+        if (m_isOnlineMode && erasedCount > 0) {
             DrawingOperation operation;
             operation.opType = DOT_Erase;
+            operation.operationId = operationId;
             operation.data = QVariantMap{
                 {"positionX", event->scenePos().x()},
                 {"positionY", event->scenePos().y()},
                 {"eraserSize", m_pen.width() + 10}
             };
+            if (erasedIds.size() == erasedCount) {
+                operation.data.insert("itemIds", erasedIds);
+            }
             // 只要绘制之后，鼠标释放之后就会通过消息发送给客户端，然后将消息自动发送给服务端，并广播其他客户端
             emit drawingOperationCreated(operation);
         }
@@ -166,46 +177,56 @@ void DrawingTool::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
         QGraphicsItem* finishedItem = m_tempItem;
         m_tempItem = nullptr;
 
-        // 确保当前绘制的结果被正确添加到场景
-        if (!m_scene->items().contains(finishedItem)) {
+        // 确保当前绘制的结果被正确添加到场景（直接检查图形所在的场景，不遍历场景）
+        if (finishedItem->scene() != m_scene) {
             m_scene->addItem(finishedItem);
         }
 
+        // 操作id同时作为图形id
+        QString operationId = DrawingOperation::generateId();
+        assignItemId(finishedItem, operationId);
+
         // 如果是网络模式，发送绘图操作
         if (m_isOnlineMode) {
             DrawingOperation operation;
-            std::cout<<"m_currentTool = "<<m_currentTool<<std::endl;
+            LOG_DEBUG("draw") << "m_currentTool =" << m_currentTool;
             // 获得当前的状态，然后执行相应的操作
             operation.opType = getCurrentOperationType();
+            operation.operationId = operationId;
             operation.data = getCurrentOperationData(finishedItem);
             emit drawingOperationCreated(operation);
         }
 
-        // 保存当前状态（用于撤销）
-        saveState();
+        // 记录加入的图形（用于撤销）
+        recordAdded(finishedItem);
+        commitAction(operationId);
 
         // 通知内容已修改
         emit contentModified();
     }
     else if (m_currentTool == Pencil && m_currentPath) {
-        // 铅笔绘图完成
+        // 铅笔绘图完成，点缓冲转换成路径
+        m_currentPath->finish();
+        QString operationId = DrawingOperation::generateId();
+        assignItemId(m_currentPath, operationId);
         if (m_isOnlineMode) {
             DrawingOperation operation;
             operation.opType = DOT_EndStroke;// 结束笔画
+            operation.operationId = operationId;
 
             operation.data = QVariantMap();
             operation.data.insert("path", QVariant::fromValue(m_currentPath->path()));
             operation.data.insert("penColor", m_pen.color());
             operation.data.insert("penWidth", m_pen.width());
+            operation.data.insert("strokeId", m_strokeId);
 
             emit drawingOperationCreated(operation);
         }
 
-        // 铅笔绘图完成
+        // 铅笔绘图完成，记录加入的笔画（用于撤销）
+        recordAdded(m_currentPath);
+        commitAction(operationId);
         m_currentPath = nullptr;
-
-        // 保存当前状态（用于撤销）
-        saveState();
         // 通知内容已修改
         emit contentModified();
     }
@@ -216,12 +237,9 @@ void DrawingTool::drawPencil(QGraphicsSceneMouseEvent *event)
 {
     if (event->buttons() & Qt::LeftButton) {
         if (!m_currentPath) {
-            m_currentPath = new QGraphicsPathItem();
-            QPainterPath path;
-            path.moveTo(m_startPoint);
-            m_currentPath->setPath(path);
-            m_currentPath->setPen(m_pen);
+            m_currentPath = new StrokeItem(m_startPoint, m_pen);
             m_scene->addItem(m_currentPath);
+            m_strokeId = QUuid::createUuid().toString(QUuid::WithoutBraces).left(8);
 
             // 发送开始笔画消息
             if (m_isOnlineMode) {
@@ -231,16 +249,16 @@ void DrawingTool::drawPencil(QGraphicsSceneMouseEvent *event)
                     {"startX", m_startPoint.x()},
                     {"startY", m_startPoint.y()},
                     {"penColor", m_pen.color()},
-                    {"penWidth", m_pen.width()}
+                    {"penWidth", m_pen.width()},
+                    {"strokeId", m_strokeId}
                 };
                 emit drawingOperationCreated(operation);
             }
         }
 
-        QPainterPath path = m_currentPath->path();
+        // 点直接追加到笔画项中，只刷新新增的线段
         QPointF currentPos = event->scenePos();
-        path.lineTo(currentPos);
-        m_currentPath->setPath(path);
+        m_currentPath->addPoint(currentPos);
 
         // 发送添加点消息
         if (m_isOnlineMode) {
@@ -248,22 +266,35 @@ void DrawingTool::drawPencil(QGraphicsSceneMouseEvent *event)
             operation.opType = DOT_AddPoint;
             operation.data = QVariantMap{
                 {"x", currentPos.x()},
-                {"y", currentPos.y()}
+                {"y", currentPos.y()},
+                {"strokeId", m_strokeId}
             };
             emit drawingOperationCreated(operation);
         }
     } else {
         // 结束笔画
+        QString operationId;
+        if (m_currentPath) {
+            m_currentPath->finish();
+            operationId = DrawingOperation::generateId();
+            assignItemId(m_currentPath, operationId);
+        }
         if (m_currentPath && m_isOnlineMode) {
             DrawingOperation operation;
             operation.opType = DOT_EndStroke;
+            operation.operationId = operationId;
             operation.data = QVariantMap{
                 {"path", QVariant::fromValue(m_currentPath->path())},
                 {"penColor", m_pen.color()},
-                {"penWidth", m_pen.width()}
+                {"penWidth", m_pen.width()},
+                {"strokeId", m_strokeId}
             };
             emit drawingOperationCreated(operation);
         }
+        if (m_currentPath) {
+            recordAdded(m_currentPath);
+            commitAction(operationId);
+        }
         m_currentPath = nullptr;
     }
 }
@@ -356,9 +387,6 @@ void DrawingTool::drawText(QGraphicsSceneMouseEvent *event)
         QString text = QInputDialog::getText(nullptr, "编辑", "请输入文本:",
                                              QLineEdit::Normal, "", &ok);
         if (ok && !text.isEmpty()) {
-            // 保存添加文本前的状态
-            saveState();
-
             QGraphicsTextItem *textItem = new QGraphicsTextItem(text);
             textItem->setPos(event->scenePos());
             // 设置字体大小
@@ -368,11 +396,15 @@ void DrawingTool::drawText(QGraphicsSceneMouseEvent *event)
 
             textItem->setDefaultTextColor(m_textColor);
             m_scene->addItem(textItem);
+            QString operationId = DrawingOperation::generateId();
+            assignItemId(textItem, operationId);
+            recordAdded(textItem);
 
             // 如果是网络模式，发送文本操作
             if (m_isOnlineMode) {
                 DrawingOperation operation;
                 operation.opType = DOT_AddText;
+                operation.operationId = operationId;
                 operation.data = QVariantMap{
                     {"content", text},
                     {"x", event->scenePos().x()},
@@ -384,6 +416,7 @@ void DrawingTool::drawText(QGraphicsSceneMouseEvent *event)
             }
 
             // 文本添加完成，通知内容已修改
+            commitAction(operationId);
             emit contentModified();
         }
     }
@@ -433,17 +466,16 @@ void DrawingTool::eraseAtPosition(const QPointF &position)
                                                         Qt::IntersectsItemShape,
                                                         Qt::DescendingOrder);
 
-    // 擦除找到的项（除了橡皮擦临时项本身）
+    // 擦除找到的项（除了橡皮擦临时项本身），已经擦除的项不在场景中，不会被再次找到；
+    // 被擦除的项保存在当前操作的撤销记录中
     foreach (QGraphicsItem* item, itemsInArea) {
+        // 未结束的远端笔画还在绘制中，不参与擦除
         if (item != m_tempItem
+            && !m_remoteStrokeItems.contains(item)
             && item->data(Qt::UserRole).toString() != "grid") {
-            // 保存被擦除的项（用于可能的撤销）
-            if (!m_erasedItems.contains(item)) {
-                m_erasedItems.append(item);
-            }
-
             // 从场景中移除项
             m_scene->removeItem(item);
+            recordRemoved(item);
         }
     }
 }
@@ -476,186 +508,318 @@ QColor DrawingTool::currentBrushColor() const { return m_brush.color(); }
 QColor DrawingTool::currentTextColor() const { return m_textColor; }
 
 
-// 实现撤销
-// void DrawingTool::undoErase()
-// {
-//     if (!m_erasedItems.isEmpty()) {
-//         // 如果点击撤销按钮的话，需要将之前的给恢复
-//         QGraphicsItem* item = m_erasedItems.takeLast();
-//         m_scene->addItem(item);
-//     }
-// }
+// 记录当前操作加入的图形
+void DrawingTool::recordAdded(QGraphicsItem *item)
+{
+    m_pendingEntry.added.append(item);
+    m_pendingAdded.insert(item);
+}
 
-// 保存当前状态到撤销栈
-void DrawingTool::saveState()
+// 记录当前操作移除的图形，同一个操作中先加入后移除的图形两边抵消
+void DrawingTool::recordRemoved(QGraphicsItem *item)
 {
-    if (m_scene) {
-        // 收集当前场景中的所有项（不包含临时项）
-        QList<QGraphicsItem*> currentState;
-        // 保存当前的绘制结果
-        foreach (QGraphicsItem* item, m_scene->items()) {
-            // 不保存临时项（如橡皮擦预览、正在绘制的临时形状）
-            if (item != m_tempItem && item != m_currentPath&&
-                item->data(Qt::UserRole).toString() != "grid") {
-                currentState.append(item);
-            }
-        }
+    if (m_pendingAdded.remove(item)) {
+        m_pendingEntry.added.removeOne(item);
+        discardItem(item);
+    } else {
+        m_pendingEntry.removed.append(item);
+    }
+}
 
-        // 只有当状态确实发生变化时才保存
-        if (!m_undoStack.isEmpty()) {
-            QList<QGraphicsItem*> lastState = m_undoStack.last();
-            // 如果当前场景状态和之前的一样就不用发生改变或者说不用保存
-            if (lastState.size() == currentState.size()) {
-                // 简单检查状态是否相同（可以更复杂的状态比较）
-                bool sameState = true;
-                // 遍历每一个状态是否发生变化
-                for (int i = 0; i < lastState.size(); ++i) {
-                    if (lastState[i] != currentState[i]) {
-                        sameState = false;
-                        break;
-                    }
-                }
-                if (sameState) {
-                    return; // 状态相同，不保存
-                }
-            }
-        }
+// 提交当前操作：没有改变时不产生记录
+void DrawingTool::commitAction(const QString &operationId)
+{
+    if (m_pendingEntry.isEmpty()) {
+        return;
+    }
+    m_pendingEntry.operationId = operationId;
+    retainEntry(m_pendingEntry);
+    m_undoHistory.append(m_pendingEntry);
+    m_pendingEntry = HistoryEntry();
+    m_pendingAdded.clear();
+    LOG_DEBUG("draw") << "保存操作，撤销历史长度:" << m_undoHistory.size();
+
+    // 新的操作之后不能再重做，被撤销的操作加入的图形随之释放
+    for (const HistoryEntry &entry : std::as_const(m_redoHistory)) {
+        releaseEntry(entry);
+    }
+    m_redoHistory.clear();
+}
 
-        m_undoStack.append(currentState);
-        qDebug() << "保存状态，撤销栈大小:" << m_undoStack.size();
+void DrawingTool::retainEntry(const HistoryEntry &entry)
+{
+    for (QGraphicsItem *item : entry.added) {
+        ++m_itemRefs[item];
+    }
+    for (QGraphicsItem *item : entry.removed) {
+        ++m_itemRefs[item];
+    }
+}
 
-        // 限制栈大小，避免内存占用过多
-        if (m_undoStack.size() > 50) { // 增加到50个状态
-            QList<QGraphicsItem*> removedState = m_undoStack.takeFirst();
-            // 清理被移除的状态中的items（如果需要）
-            foreach (QGraphicsItem* item, removedState) {
-                // 注意：这里不能删除item，因为它们可能还在场景中
-            }
+void DrawingTool::releaseEntry(const HistoryEntry &entry)
+{
+    auto release = [this](QGraphicsItem *item) {
+        auto it = m_itemRefs.find(item);
+        if (it == m_itemRefs.end() || --it.value() > 0) {
+            return;
         }
-
-        // 清空重做栈
-        m_redoStack.clear();
+        m_itemRefs.erase(it);
+        // 仍然在场景中的图形由场景持有
+        if (!item->scene()) {
+            deleteItem(item);
+        }
+    };
+    for (QGraphicsItem *item : entry.added) {
+        release(item);
+    }
+    for (QGraphicsItem *item : entry.removed) {
+        release(item);
     }
 }
 
-// 撤销
-void DrawingTool::undo()
+void DrawingTool::discardItem(QGraphicsItem *item)
 {
-    if (m_undoStack.size() > 1) {
-        try {
-            // 保存当前状态到重做栈
-            QList<QGraphicsItem*> currentState;
-            foreach (QGraphicsItem* item, m_scene->items()) {
-                if (item != m_tempItem && item != m_currentPath) {
-                    currentState.append(item);
-                }
-            }
-            m_redoStack.append(currentState);
-
-            // 移除当前状态，获取上一个状态
-            m_undoStack.removeLast();
-            QList<QGraphicsItem*> previousState = m_undoStack.last();
+    if (item && !item->scene() && !m_itemRefs.contains(item)) {
+        deleteItem(item);
+    }
+}
 
-            // 恢复上一个状态
-            restoreState(previousState);
+void DrawingTool::deleteItem(QGraphicsItem *item)
+{
+    QString id = itemId(item);
+    if (!id.isEmpty()) {
+        m_itemsById.remove(id);
+    }
+    delete item;
+    ++m_reclaimedItems;
+}
 
-            // 如果是网络模式，发送撤销请求（包含操作信息）
-            if (m_isOnlineMode) {
-                // 获取最后操作的信息（需要扩展实现）
-                QVariantMap undoData;
-                undoData["operationType"] = "last"; // 或其他标识
-                // undoData["operationId"] = generateOperationId();
+void DrawingTool::assignItemId(QGraphicsItem *item, const QString &id)
+{
+    if (!item || id.isEmpty()) {
+        return;
+    }
+    item->setData(ItemIdRole, id);
+    m_itemsById.insert(id, item);
+}
 
-                DrawingOperation operation;
-                operation.opType = DOT_Undo;
-                operation.data = undoData;
+QStringList DrawingTool::itemIds(const QList<QGraphicsItem*> &items) const
+{
+    QStringList ids;
+    for (QGraphicsItem *item : items) {
+        QString id = itemId(item);
+        if (!id.isEmpty()) {
+            ids.append(id);
+        }
+    }
+    return ids;
+}
 
-                emit undoRequestedWithData(operation);
+bool DrawingTool::setOperationApplied(const QString &operationId, bool applied)
+{
+    // 只改变图形是否在场景中，不产生撤销记录
+    auto place = [this](QGraphicsItem *item, bool inScene) {
+        if (inScene && !item->scene()) {
+            m_scene->addItem(item);
+        } else if (!inScene && item->scene() == m_scene) {
+            m_scene->removeItem(item);
+            // 没有任何记录引用的图形不可能再恢复
+            if (!m_pendingAdded.contains(item)) {
+                discardItem(item);
             }
-
-        } catch (const std::exception& e) {
-            qWarning() << "撤销操作异常:" << e.what();
         }
+    };
+
+    // 擦除操作：应用时移除被擦除的图形，撤销时放回
+    auto erased = m_erasedById.constFind(operationId);
+    if (erased != m_erasedById.cend()) {
+        for (const QString &id : erased.value()) {
+            if (QGraphicsItem *item = m_itemsById.value(id)) {
+                place(item, !applied);
+            }
+        }
+        return true;
     }
+
+    // 创建图形的操作：id就是图形id
+    QGraphicsItem *item = m_itemsById.value(operationId);
+    if (!item) {
+        return false;
+    }
+    place(item, applied);
+    return true;
 }
 
-// 重做
-void DrawingTool::redo()
+DrawingTool::ItemStats DrawingTool::itemStats() const
 {
-    qDebug() << "重做操作，重做栈大小:" << m_redoStack.size();
-
-    if (!m_redoStack.isEmpty()) {
-        try {
-            // 保存当前状态到撤销栈
-            QList<QGraphicsItem*> currentState;
-            foreach (QGraphicsItem* item, m_scene->items()) {
-                if (item != m_tempItem && item != m_currentPath) {
-                    currentState.append(item);
-                }
+    ItemStats stats;
+    stats.reclaimed = m_reclaimedItems;
+    if (m_scene) {
+        const QList<QGraphicsItem*> items = m_scene->items();
+        for (QGraphicsItem *item : items) {
+            if (item->data(Qt::UserRole).toString() != "grid") {
+                ++stats.live;
             }
-            m_undoStack.append(currentState);
+        }
+    }
+    for (auto it = m_itemRefs.cbegin(); it != m_itemRefs.cend(); ++it) {
+        if (!it.key()->scene()) {
+            ++stats.retained;
+        }
+    }
+    return stats;
+}
 
-            // 恢复重做状态
-            QList<QGraphicsItem*> nextState = m_redoStack.takeLast();
-            restoreState(nextState);
+void DrawingTool::resetHistory()
+{
+    // 当前操作移除的图形还没有入栈，不被任何记录引用
+    for (QGraphicsItem *item : std::as_const(m_pendingEntry.removed)) {
+        discardItem(item);
+    }
+    m_pendingEntry = HistoryEntry();
+    m_pendingAdded.clear();
+    for (const HistoryEntry &entry : std::as_const(m_undoHistory)) {
+        releaseEntry(entry);
+    }
+    for (const HistoryEntry &entry : std::as_const(m_redoHistory)) {
+        releaseEntry(entry);
+    }
+    m_undoHistory.clear();
+    m_redoHistory.clear();
+    m_itemRefs.clear();
+    // 场景中的图形随后被场景删除
+    m_itemsById.clear();
+    m_erasedById.clear();
+
+    // 场景中的图形接下来由场景删除，不再保留指针
+    m_tempItem = nullptr;
+    m_currentPath = nullptr;
+    m_remoteStrokes.clear();
+    m_remoteStrokeItems.clear();
+}
 
-            qDebug() << "重做成功，当前重做栈大小:" << m_redoStack.size();
+// 只处理记录中的图形，不遍历场景
+void DrawingTool::applyEntry(const HistoryEntry &entry, bool forward)
+{
+    const QList<QGraphicsItem*> &toRemove = forward ? entry.removed : entry.added;
+    const QList<QGraphicsItem*> &toAdd = forward ? entry.added : entry.removed;
 
-        } catch (const std::exception& e) {
-            qWarning() << "重做操作异常:" << e.what();
-        } catch (...) {
-            qWarning() << "重做操作发生未知异常";
+    for (QGraphicsItem *item : toRemove) {
+        if (item->scene() == m_scene) {
+            m_scene->removeItem(item);
         }
-    } else {
-        qDebug() << "无法重做：重做栈为空";
     }
+    for (QGraphicsItem *item : toAdd) {
+        if (!item->scene()) {
+            m_scene->addItem(item);
+        }
+    }
+}
 
-    // 如果是网络模式，发送重做请求
-    if (m_isOnlineMode) {
-        emit redoRequested();
+bool DrawingTool::undoEntry()
+{
+    // 还没有提交的改变先作为一条记录
+    commitAction();
+    if (m_undoHistory.isEmpty()) {
+        return false;
     }
+
+    HistoryEntry entry = m_undoHistory.takeLast();
+    applyEntry(entry, false);
+    m_redoHistory.append(entry);
+    return true;
 }
 
-// 恢复场景状态（安全的实现）
-void DrawingTool::restoreState(const QList<QGraphicsItem*>& state)
+bool DrawingTool::redoEntry()
 {
-    if (m_scene) {
-        // 清除当前场景（但不删除items，因为它们可能在其他地方被引用）
-        QList<QGraphicsItem*> currentItems = m_scene->items();
-        foreach (QGraphicsItem* item, currentItems) {
-            // 只移除非临时项
-            if (item != m_tempItem && item != m_currentPath
-                &&item->data(Qt::UserRole).toString() != "grid") {
-                m_scene->removeItem(item);
-            }
+    if (m_redoHistory.isEmpty()) {
+        return false;
+    }
+
+    HistoryEntry entry = m_redoHistory.takeLast();
+    applyEntry(entry, true);
+    m_undoHistory.append(entry);
+    return true;
+}
+
+bool DrawingTool::restoreUndone(const QString &operationId)
+{
+    for (int i = m_redoHistory.size() - 1; i >= 0; --i) {
+        if (m_redoHistory[i].operationId == operationId) {
+            HistoryEntry entry = m_redoHistory.takeAt(i);
+            applyEntry(entry, true);
+            m_undoHistory.append(entry);
+            return true;
         }
+    }
+    return false;
+}
 
-        // 添加新状态的items
-        foreach (QGraphicsItem* item, state) {
-            // 确保item没有被删除
-            if (item && !m_scene->items().contains(item)) {
-                m_scene->addItem(item);
-            }
+// 撤销
+void DrawingTool::undo()
+{
+    if (undoEntry()) {
+        // 如果是网络模式，发送撤销请求，服务端和其他客户端按id撤销同一个操作。
+        // 没有id的记录（清除场景等）服务端无法定位，只在本地撤销，不发送
+        const QString &operationId = m_redoHistory.last().operationId;
+        if (m_isOnlineMode && !operationId.isEmpty()) {
+            QVariantMap undoData;
+            undoData["operationType"] = "last";
+
+            DrawingOperation operation;
+            operation.opType = DOT_Undo;
+            operation.operationId = operationId;
+            operation.data = undoData;
+
+            emit undoRequestedWithData(operation);
         }
     }
 }
 
+// 重做
+void DrawingTool::redo()
+{
+    LOG_DEBUG("draw") << "重做操作，重做历史长度:" << m_redoHistory.size();
+
+    if (!redoEntry()) {
+        LOG_DEBUG("draw") << "无法重做：重做历史为空";
+        return;
+    }
+    LOG_DEBUG("draw") << "重做成功，当前重做历史长度:" << m_redoHistory.size();
+
+    // 如果是网络模式，发送重做请求（带上重做的操作id），没有id的记录只在本地重做
+    const QString &operationId = m_undoHistory.last().operationId;
+    if (m_isOnlineMode && !operationId.isEmpty()) {
+        DrawingOperation operation;
+        operation.opType = DOT_Redo;
+        operation.operationId = operationId;
+        emit redoRequestedWithData(operation);
+    }
+}
+
 // 清除场景
 void DrawingTool::clearScene()
 {
     if (m_scene) {
-        // 保存清除前的状态
-        saveState();
+        // 之前未提交的改变单独作为一条记录
+        commitAction();
 
-        // 清除场景（但不删除items）
+        // 清除场景（但不删除items，清除本身作为一条撤销记录）
         QList<QGraphicsItem*> items = m_scene->items();
         foreach (QGraphicsItem* item, items) {
             // 跳过标记为"grid"的项
-            if (item->data(Qt::UserRole).toString() != "grid") {
-                m_scene->removeItem(item);
+            if (item->data(Qt::UserRole).toString() == "grid") {
+                continue;
             }
             m_scene->removeItem(item);
+            // 临时项和未结束的笔画不属于任何一条记录，直接释放
+            if (item != m_tempItem && item != m_currentPath && !m_remoteStrokeItems.contains(item)) {
+                recordRemoved(item);
+            } else {
+                discardItem(item);
+            }
         }
+        commitAction();
 
         emit sceneCleared();
 
@@ -669,10 +833,9 @@ void DrawingTool::clearScene()
         m_isDrawing = false;
         m_isErasing = false;
         m_currentPath = nullptr;
-
-        // 保存空白状态
-        QList<QGraphicsItem*> emptyState;
-        m_undoStack.append(emptyState);
+        // 远端未结束的笔画已经从场景移除，之后的结束笔画消息按完整路径绘制
+        m_remoteStrokes.clear();
+        m_remoteStrokeItems.clear();
     }
 }
 
@@ -738,8 +901,7 @@ QVariantMap DrawingTool::getCurrentOperationData(QGraphicsItem* finishedItem) co
             if (finishedItem) {
                 QGraphicsRectItem *rect = qgraphicsitem_cast<QGraphicsRectItem*>(finishedItem);
                 if (rect) {
-                    std::cout<<"x = "<<rect->rect().x()<<" y = "<<rect->rect().y()<<std::endl;
-                    std::cout<<"width = "<<rect->rect().width()<<" height = "<<rect->rect().height()<<std::endl;
+                    LOG_DEBUG("draw") << "rect =" << rect->rect();
 
                     data["x"] = rect->rect().x();
                     data["y"] = rect->rect().y();
@@ -784,73 +946,142 @@ QVariantMap DrawingTool::getCurrentOperationData(QGraphicsItem* finishedItem) co
 // 具体的绘图操作动作
 void DrawingTool::processNetworkOperation(const DrawingOperation &operation)
 {
-    // 在处理网络操作前保存状态
-    if (operation.opType != DOT_Undo && operation.opType != DOT_Redo) {
-        saveState();
+    // 已经有的操作（例如服务端广播的重做，包括自己的重做）只把对应的图形放回，不重复绘制
+    if (!operation.operationId.isEmpty() && operation.opType != DOT_Undo && operation.opType != DOT_Redo &&
+        setOperationApplied(operation.operationId, true)) {
+        return;
     }
+
+    QGraphicsItem *created = nullptr;
     switch (operation.opType) {
         case DOT_BeginStroke:
-            // qDebug() << "开始笔画操作";
+            // LOG_DEBUG("draw") << "开始笔画操作";
+            beginRemoteStroke(operation);
             break;
         case DOT_AddPoint:
-            // qDebug() << "添加点操作";
+            // LOG_DEBUG("draw") << "添加点操作";
+            appendRemotePoints(operation);
             break;
         case DOT_EndStroke:
-            // qDebug() << "结束笔画操作";
-            if (operation.data.contains("path")) {
-                // qDebug() << "包含路径数据";
-                QVariant pathVar = operation.data["path"];
-                if (pathVar.canConvert<QPainterPath>()) {
-                    // qDebug() << "可以转换为QPainterPath";
-                    QPainterPath path = pathVar.value<QPainterPath>();
-                    // qDebug() << "路径元素数量:" << path.elementCount();
-                }
-            }
-            drawNetworkPath(operation.data);
+            created = endRemoteStroke(operation);
             break;
         case DOT_DrawLine:
-            drawNetworkLine(operation.data);
+            created = drawNetworkLine(operation.data);
             break;
         case DOT_DrawRectangle:
-            std::cout<<"DOT DrawRectangle..."<<std::endl;
-            drawNetworkRectangle(operation.data);
+            created = drawNetworkRectangle(operation.data);
             break;
         case DOT_DrawEllipse:
-            drawNetworkEllipse(operation.data);
+            created = drawNetworkEllipse(operation.data);
             break;
         case DOT_AddText:
-            addNetworkText(operation.data);
+            created = addNetworkText(operation.data);
             break;
-        case DOT_Erase:
-            performNetworkErase(operation.data);
+        case DOT_Erase: {
+            QStringList erasedIds = performNetworkErase(operation.data);
+            if (!operation.operationId.isEmpty() && !erasedIds.isEmpty()) {
+                m_erasedById.insert(operation.operationId, erasedIds);
+            }
             break;
+        }
         case DOT_Undo:
             // 专门处理网络撤销
-            processNetworkUndo(operation.data);
+            processNetworkUndo(operation);
             break;
         case DOT_Redo:
             // 专门处理网络重做
-            processNetworkRedo(operation.data);
+            processNetworkRedo(operation);
             break;
         default:
-            qDebug() << "未知的网络绘图操作类型:" << operation.opType;
+            LOG_DEBUG("draw") << "未知的网络绘图操作类型:" << operation.opType;
         break;
     }
+    // 其他客户端（或服务端）分配的操作id就是图形id
+    assignItemId(created, operation.operationId);
+
+    // 每个完成的网络操作作为一条撤销记录（开始笔画和添加点不改变已完成的内容）
+    if (operation.opType != DOT_Undo && operation.opType != DOT_Redo &&
+        operation.opType != DOT_BeginStroke && operation.opType != DOT_AddPoint) {
+        commitAction(operation.operationId);
+    }
+}
+
+
+QString DrawingTool::remoteStrokeKey(const DrawingOperation &operation)
+{
+    // 没有笔画id的旧客户端同一时间只有一个笔画，只按发送者区分
+    return operation.senderId + "/" + operation.data["strokeId"].toString();
+}
+
+void DrawingTool::beginRemoteStroke(const DrawingOperation &operation)
+{
+    const QVariantMap &data = operation.data;
+    QString key = remoteStrokeKey(operation);
+
+    // 上一个笔画没有收到结束消息，直接结束
+    if (StrokeItem *previous = m_remoteStrokes.take(key)) {
+        previous->finish();
+        m_remoteStrokeItems.remove(previous);
+        recordAdded(previous);
+    }
+
+    QPen pen(data.contains("penColor") ? data["penColor"].value<QColor>() : QColor(Qt::black),
+             data.contains("penWidth") ? data["penWidth"].toInt() : 2,
+             Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+    StrokeItem *stroke = new StrokeItem(QPointF(data["startX"].toDouble(), data["startY"].toDouble()), pen);
+    m_scene->addItem(stroke);
+
+    m_remoteStrokes.insert(key, stroke);
+    m_remoteStrokeItems.insert(stroke);
 }
 
+void DrawingTool::appendRemotePoints(const DrawingOperation &operation)
+{
+    // 中途加入时没有收到开始笔画，等结束笔画时按完整路径绘制
+    StrokeItem *stroke = m_remoteStrokes.value(remoteStrokeKey(operation));
+    if (!stroke) return;
+
+    const QVariantMap &data = operation.data;
+    if (data.contains("points")) {
+        // 批量发送的点
+        const QVariantList points = data["points"].toList();
+        for (const QVariant &pointVar : points) {
+            QVariantMap point = pointVar.toMap();
+            stroke->addPoint(QPointF(point["x"].toDouble(), point["y"].toDouble()));
+        }
+    } else {
+        stroke->addPoint(QPointF(data["x"].toDouble(), data["y"].toDouble()));
+    }
+}
 
-void DrawingTool::drawNetworkPath(const QVariantMap &data)
+QGraphicsItem *DrawingTool::endRemoteStroke(const DrawingOperation &operation)
 {
-    std::cout << "drawNetworkPath - 开始处理网络路径" << std::endl;
-    std::cout<<"drawNetworkPath"<<std::endl;
-    std::cout<<"startX = "<<data["startX"].toDouble()<<" startY = "<<data["startY"].toDouble()<<std::endl;
-    std::cout<<"x = "<<data["x"].toDouble()<<" y = "<<data["y"].toDouble()<<std::endl;
+    StrokeItem *stroke = m_remoteStrokes.take(remoteStrokeKey(operation));
+    if (!stroke) {
+        return drawNetworkPath(operation.data);
+    }
+    m_remoteStrokeItems.remove(stroke);
+    recordAdded(stroke);
+
+    // 增量绘制的点数和完整路径一致时保留已经绘制的结果，否则（例如丢失了部分点）用完整路径校正
+    QPainterPath finalPath = operation.data["path"].value<QPainterPath>();
+    bool complete = finalPath.elementCount() == stroke->points().size();
+    stroke->finish();
+    if (!complete && finalPath.elementCount() > 0) {
+        stroke->setPath(finalPath);
+    }
+    return stroke;
+}
+
+QGraphicsItem *DrawingTool::drawNetworkPath(const QVariantMap &data)
+{
+    LOG_DEBUG("draw") << "drawNetworkPath startX =" << data["startX"].toDouble() << "startY =" << data["startY"].toDouble();
     // 检查是否包含路径数据
     if (data.contains("path")) {
         QVariant pathVariant = data["path"];
         if (pathVariant.canConvert<QPainterPath>()) {
             QPainterPath path = pathVariant.value<QPainterPath>();
-            std::cout << "路径元素数量: " << path.elementCount() << std::endl;
+            LOG_DEBUG("draw") << "路径元素数量:" << path.elementCount();
 
             QGraphicsPathItem *pathItem = new QGraphicsPathItem(path);
 
@@ -873,11 +1104,9 @@ void DrawingTool::drawNetworkPath(const QVariantMap &data)
 
             pathItem->setPen(pen);
             m_scene->addItem(pathItem);
+            recordAdded(pathItem);
 
-            m_currentNetworkPath = pathItem;
-
-            std::cout << "成功添加路径到场景" << std::endl;
-            return;
+            return pathItem;
         }
     }
 
@@ -902,85 +1131,59 @@ void DrawingTool::drawNetworkPath(const QVariantMap &data)
                 QPen pen(Qt::black, 2, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
                 pathItem->setPen(pen);
                 m_scene->addItem(pathItem);
+                recordAdded(pathItem);
 
-                m_currentNetworkPath = pathItem;
-
-                std::cout << "使用备用方法添加路径" << std::endl;
-                return;
+                LOG_DEBUG("draw") << "使用备用方法添加路径";
+                return pathItem;
             }
         }
     }
 
-    std::cout << "无法解析路径数据" << std::endl;
+    LOG_WARNING("draw") << "无法解析路径数据";
+    return nullptr;
 }
 
-void DrawingTool::processNetworkUndo(const QVariantMap &data)
+void DrawingTool::processNetworkUndo(const DrawingOperation &operation)
 {
-    if (m_undoStack.size() > 1) {
-        // 保存当前状态到重做栈
-        QList<QGraphicsItem*> currentState = getCurrentSceneState();
-        m_redoStack.append(currentState);
-
-        // 恢复到上一个状态
-        m_undoStack.removeLast();
-        QList<QGraphicsItem*> previousState = m_undoStack.last();
-        restoreState(previousState);
-    }
-}
-
-void DrawingTool::processNetworkRedo(const QVariantMap &data)
-{
-    qDebug() << "处理网络重做操作";
-
-    if (m_redoStack.isEmpty()) {
-        qDebug() << "重做栈为空，无法执行重做";
+    // 服务端已经没有这个操作，本地的撤销没有生效，恢复画面和撤销历史
+    if (operation.data.value("rejected").toBool()) {
+        if (!restoreUndone(operation.operationId)) {
+            LOG_DEBUG("draw") << "被拒绝的撤销不在重做历史中:" << operation.operationId;
+        }
         return;
     }
-
-    try {
-        // 保存当前状态到撤销栈
-        QList<QGraphicsItem*> currentState = getCurrentSceneState();
-        m_undoStack.append(currentState);
-
-        // 从重做栈获取下一个状态
-        QList<QGraphicsItem*> nextState = m_redoStack.takeLast();
-
-        // 恢复状态
-        restoreState(nextState);
-
-        qDebug() << "网络重做成功，重做栈大小:" << m_redoStack.size();
-
-    } catch (const std::exception& e) {
-        qWarning() << "网络重做操作异常:" << e.what();
-    } catch (...) {
-        qWarning() << "网络重做操作发生未知异常";
+    // 按id撤销其他客户端的操作，不影响本地的撤销历史
+    if (!operation.operationId.isEmpty()) {
+        if (!setOperationApplied(operation.operationId, false)) {
+            LOG_DEBUG("draw") << "撤销的操作不存在:" << operation.operationId;
+        }
+        return;
     }
+    // 旧版本客户端不带操作id，撤销最后一条记录
+    undoEntry();
 }
 
-QList<QGraphicsItem*> DrawingTool::getCurrentSceneState() const
+void DrawingTool::processNetworkRedo(const DrawingOperation &operation)
 {
-    QList<QGraphicsItem*> currentState;
-
-    if (!m_scene) return currentState;
-
-    // 收集当前场景中的所有项（不包含临时项和网格）
-    foreach (QGraphicsItem* item, m_scene->items()) {
-        if (item != m_tempItem &&
-            item != m_currentPath &&
-            item != m_currentNetworkPath &&
-            item->data(Qt::UserRole).toString() != "grid") {
-            currentState.append(item);
+    LOG_DEBUG("draw") << "处理网络重做操作";
+    if (!operation.operationId.isEmpty()) {
+        if (!setOperationApplied(operation.operationId, true)) {
+            LOG_DEBUG("draw") << "重做的操作不存在:" << operation.operationId;
         }
+        return;
     }
 
-    return currentState;
+    if (redoEntry()) {
+        LOG_DEBUG("draw") << "网络重做成功，重做历史长度:" << m_redoHistory.size();
+    } else {
+        LOG_DEBUG("draw") << "重做历史为空，无法执行重做";
+    }
 }
 
-void DrawingTool::drawNetworkLine(const QVariantMap &data)
+QGraphicsItem *DrawingTool::drawNetworkLine(const QVariantMap &data)
 {
-    std::cout<<"drawNetworkLine"<<std::endl;
-    std::cout<<"x1 = "<<data["x1"].toDouble()<<" y1 = "<<data["y1"].toDouble()<<std::endl;
-    std::cout<<"x2 = "<<data["x2"].toDouble()<<" y2 = "<<data["y2"].toDouble()<<std::endl;
+    LOG_DEBUG("draw") << "drawNetworkLine" << data["x1"].toDouble() << data["y1"].toDouble()
+                      << data["x2"].toDouble() << data["y2"].toDouble();
     QGraphicsLineItem *line = new QGraphicsLineItem(
         data["x1"].toDouble(),
         data["y1"].toDouble(),
@@ -992,13 +1195,14 @@ void DrawingTool::drawNetworkLine(const QVariantMap &data)
         data["penWidth"].toInt()
         ));
     m_scene->addItem(line);
+    recordAdded(line);
+    return line;
 }
 
-void DrawingTool::drawNetworkRectangle(const QVariantMap &data)
+QGraphicsItem *DrawingTool::drawNetworkRectangle(const QVariantMap &data)
 {
-    std::cout<<"drawNetworkRectangle"<<std::endl;
-    std::cout<<"x = "<<data["x"].toDouble()<<" y = "<<data["y"].toDouble()<<std::endl;
-    std::cout<<"width = "<<data["width"].toDouble()<<" height = "<<data["height"].toDouble()<<std::endl;
+    LOG_DEBUG("draw") << "drawNetworkRectangle" << data["x"].toDouble() << data["y"].toDouble()
+                      << data["width"].toDouble() << data["height"].toDouble();
     QGraphicsRectItem *rect = new QGraphicsRectItem(
         data["x"].toDouble(),
         data["y"].toDouble(),
@@ -1015,13 +1219,14 @@ void DrawingTool::drawNetworkRectangle(const QVariantMap &data)
     }
 
     m_scene->addItem(rect);
+    recordAdded(rect);
+    return rect;
 }
 
-void DrawingTool::drawNetworkEllipse(const QVariantMap &data)
+QGraphicsItem *DrawingTool::drawNetworkEllipse(const QVariantMap &data)
 {
-    std::cout<<"drawNetworkEllipse"<<std::endl;
-    std::cout<<"x = "<<data["x"].toDouble()<<" y = "<<data["y"].toDouble()<<std::endl;
-    std::cout<<"width = "<<data["width"].toDouble()<<" height = "<<data["height"].toDouble()<<std::endl;
+    LOG_DEBUG("draw") << "drawNetworkEllipse" << data["x"].toDouble() << data["y"].toDouble()
+                      << data["width"].toDouble() << data["height"].toDouble();
     QGraphicsEllipseItem *ellipse = new QGraphicsEllipseItem(
         data["x"].toDouble(),
         data["y"].toDouble(),
@@ -1038,14 +1243,15 @@ void DrawingTool::drawNetworkEllipse(const QVariantMap &data)
     }
 
     m_scene->addItem(ellipse);
+    recordAdded(ellipse);
+    return ellipse;
 }
 
-void DrawingTool::addNetworkText(const QVariantMap &data)
+QGraphicsItem *DrawingTool::addNetworkText(const QVariantMap &data)
 {
     QGraphicsTextItem *text = new QGraphicsTextItem(data["content"].toString());
-    std::cout<<"addNetworkText"<<std::endl;
-    std::cout<<"x = "<<data["x"].toDouble()<<" y = "<<data["y"].toDouble()<<std::endl;
-    std::cout<<"text = "<<data["content"].toString().toStdString()<<std::endl;
+    LOG_DEBUG("draw") << "addNetworkText" << data["x"].toDouble() << data["y"].toDouble()
+                      << data["content"].toString();
 
     text->setPos(
         data["x"].toDouble(),
@@ -1057,11 +1263,29 @@ void DrawingTool::addNetworkText(const QVariantMap &data)
     text->setFont(font); // 应用新字体
     text->setDefaultTextColor(data["color"].value<QColor>());
     m_scene->addItem(text);
+    recordAdded(text);
+    return text;
 }
 
-void DrawingTool::performNetworkErase(const QVariantMap &data)
+QStringList DrawingTool::performNetworkErase(const QVariantMap &data)
 {
-    std::cout << "performNetworkErase" << std::endl;
+    LOG_DEBUG("draw") << "performNetworkErase";
+    QStringList erasedIds;
+
+    // 按id擦除：直接定位被擦除的图形，和发送方擦除的图形完全一致
+    if (data.contains("itemIds")) {
+        const QStringList ids = data["itemIds"].toStringList();
+        for (const QString &id : ids) {
+            QGraphicsItem *item = m_itemsById.value(id);
+            if (item && item->scene() == m_scene) {
+                m_scene->removeItem(item);
+                recordRemoved(item);
+                erasedIds.append(id);
+            }
+        }
+        return erasedIds;
+    }
+
     QRectF eraserArea(
         data["positionX"].toDouble() - data["eraserSize"].toDouble() / 2,
         data["positionY"].toDouble() - data["eraserSize"].toDouble() / 2,
@@ -1071,18 +1295,24 @@ void DrawingTool::performNetworkErase(const QVariantMap &data)
     // 查找与指定矩形区域相交的所有图形项，比如有直线，椭圆，矩形，如果删除区域和矩形存在交集，那么“图形项”中就只有“矩形”
     QList<QGraphicsItem*> itemsInArea = m_scene->items(eraserArea, Qt::IntersectsItemShape);
     for (QGraphicsItem* item : itemsInArea) {
-        if (item->data(Qt::UserRole).toString() == "grid") continue;
+        // 未结束的远端笔画还在绘制中，不参与擦除
+        if (item->data(Qt::UserRole).toString() == "grid" || m_remoteStrokeItems.contains(item)) continue;
 
         // 对路径项进行精确碰撞检测
         if (QGraphicsPathItem* pathItem = qgraphicsitem_cast<QGraphicsPathItem*>(item)) {
-            if (isPathIntersecting(pathItem, eraserArea)) {
-                m_scene->removeItem(item);
-            }
-        } else if (item->shape().intersects(eraserArea)) {
+            if (!isPathIntersecting(pathItem, eraserArea)) continue;
+        } else if (!item->shape().intersects(eraserArea)) {
             // 其他图形项的精确检测
-            m_scene->removeItem(item);
+            continue;
+        }
+        QString id = itemId(item);
+        if (!id.isEmpty()) {
+            erasedIds.append(id);
         }
+        m_scene->removeItem(item);
+        recordRemoved(item);
     }
+    return erasedIds;
 }
 
 bool DrawingTool::isPathIntersecting(QGraphicsPathItem* pathItem, const QRectF& eraserArea)
@@ -4,17 +4,22 @@
 
 #include <QObject>
 #include <map>
-#include <iostream>
 #include <QVariantMap>
+#include <QHash>
+#include <QSet>
 #include <QGraphicsScene>
 #include <QInputDialog>
 #include <QGraphicsSceneMouseEvent>
 
 #include "networkprotocol.h"
+#include "strokeitem.h"
+#include "asynclogger.h"
 
 class DrawingTool : public QObject
 {
     Q_OBJECT
+    // 绘制压测直接调用擦除等内部方法
+    friend class RenderBenchmark;
 public:
     enum ToolType { Pencil, Line, Rectangle, Ellipse, Text, Select, Eraser };
 
@@ -52,8 +57,29 @@ public:
     void clearScene();  // 清除场景
     void undo();  // 撤销
     void redo();  // 重做
-    void saveState();  // 保存当前状态
-    void restoreState(const QList<QGraphicsItem*>& state);
+    // 把当前操作累积的改变（加入/移除的图形）作为一条撤销记录，并清空重做历史；
+    // operationId为产生这次改变的网络操作id，撤销/重做时据此通知其他客户端
+    void commitAction(const QString &operationId = QString());
+    // 丢弃撤销/重做历史，释放只被历史引用的图形，场景中的图形留给场景释放；
+    // 必须在场景被外部清空（新建/打开文件）或者销毁之前调用
+    void resetHistory();
+    int undoDepth() const { return m_undoHistory.size(); }
+    int redoDepth() const { return m_redoHistory.size(); }
+
+    // 图形生命周期统计，统计时遍历场景和历史引用，不要在热路径中调用
+    struct ItemStats {
+        int live = 0;           // 场景中的图形（不包括网格）
+        int retained = 0;       // 不在场景中、只为撤销/重做保留的图形
+        qint64 reclaimed = 0;   // 已经释放的图形
+    };
+    ItemStats itemStats() const;
+
+    // 图形id：创建图形的操作id，保存在图形的ItemIdRole数据中，所有客户端和服务端用同一个id指代同一个图形，
+    // 擦除、撤销、重做（以及以后的移动/编辑）通过id直接定位图形，不再按位置查找
+    static constexpr int ItemIdRole = Qt::UserRole + 1;
+    static QString itemId(const QGraphicsItem *item) { return item->data(ItemIdRole).toString(); }
+    // 场景中或者为撤销/重做保留的图形，已经释放的图形返回nullptr
+    QGraphicsItem *itemById(const QString &id) const { return m_itemsById.value(id); }
 
     // 添加网络相关方法
     void setOnlineMode(bool online);
@@ -87,8 +113,9 @@ signals:
 
 private:
     QGraphicsScene *m_scene;
-    // 绘制自由曲线、多边形、贝塞尔曲线等
-    QGraphicsPathItem *m_currentPath;
+    // 正在绘制的铅笔笔画，点追加到笔画项的点缓冲中
+    StrokeItem *m_currentPath;
+    QString m_strokeId;     // 当前笔画的id，开始/添加点/结束消息中携带
     ToolType m_currentTool;
     QPen m_pen;
     QBrush m_brush;
@@ -115,31 +142,76 @@ private:
     void drawEllipse(QGraphicsSceneMouseEvent *event);
     void drawText(QGraphicsSceneMouseEvent *event);
 
-    QList<QGraphicsItem*> m_erasedItems; // 存储被擦除的项（用于可能的撤销）
     bool m_isErasing;                    // 标记是否正在擦除
     // 橡皮擦方法
     void eraseAtPosition(const QPointF &position);
     void drawEraser(QGraphicsSceneMouseEvent *event);
 
-    // 用于保存撤销和重做结果
-    QList<QList<QGraphicsItem*>> m_undoStack;  // 撤销栈
-    QList<QList<QGraphicsItem*>> m_redoStack;  // 重做栈
+    // 撤销/重做历史：每条记录只保存一次操作加入和移除的图形，撤销时反向应用，
+    // 耗时和内存只和操作本身涉及的图形数量有关，和场景大小无关，深度不限
+    struct HistoryEntry {
+        QList<QGraphicsItem*> added;    // 操作加入场景的图形
+        QList<QGraphicsItem*> removed;  // 操作从场景移除的图形
+        QString operationId;            // 对应的网络操作id，没有时撤销/重做按栈顶处理
+        bool isEmpty() const { return added.isEmpty() && removed.isEmpty(); }
+    };
+    HistoryEntry m_pendingEntry;            // 当前操作（例如一次橡皮擦拖动）累积的改变，commitAction时入栈
+    QSet<QGraphicsItem*> m_pendingAdded;    // m_pendingEntry.added的成员索引，移除时O(1)判断是否抵消
+    QList<HistoryEntry> m_undoHistory;      // 撤销历史
+    QList<HistoryEntry> m_redoHistory;      // 重做历史
+    void recordAdded(QGraphicsItem *item);
+    void recordRemoved(QGraphicsItem *item);
+
+    // 图形所有权：不在场景中的图形由历史持有，每条记录对其中的图形计一次引用，
+    // 记录被丢弃（重做历史被新操作清空、历史重置）时减少引用，
+    // 引用为0且不在场景中的图形不可能再被撤销/重做恢复，直接释放
+    QHash<QGraphicsItem*, int> m_itemRefs;
+    qint64 m_reclaimedItems;
+    void retainEntry(const HistoryEntry &entry);
+    void releaseEntry(const HistoryEntry &entry);
+    // 释放已经移出场景、不属于任何记录的图形（临时项、未结束的笔画、同一操作中加入又移除的图形）
+    void discardItem(QGraphicsItem *item);
+    void deleteItem(QGraphicsItem *item);
+
+    // id -> 图形的索引，图形释放时移除；擦除操作id -> 被擦除的图形id，用于按id撤销/重做擦除
+    QHash<QString, QGraphicsItem*> m_itemsById;
+    QHash<QString, QStringList> m_erasedById;
+    // id为空时不建立索引（旧版本服务端转发的操作没有id）
+    void assignItemId(QGraphicsItem *item, const QString &id);
+    QStringList itemIds(const QList<QGraphicsItem*> &items) const;
+    // 按id应用（applied为true）或者撤销其他客户端的操作，不产生本地撤销记录；id未知时返回false
+    bool setOperationApplied(const QString &operationId, bool applied);
+    // forward为true时重新应用记录（重做），否则反向应用（撤销）
+    void applyEntry(const HistoryEntry &entry, bool forward);
+    bool undoEntry();
+    bool redoEntry();
+    // 服务端拒绝了本地按id的撤销时，把这条记录从重做历史恢复到撤销历史
+    bool restoreUndone(const QString &operationId);
 
     // 添加在线模式标志
     bool m_isOnlineMode;
     // 添加网络绘图相关的辅助方法
-    QGraphicsPathItem *m_currentNetworkPath; // 用于跟踪网络接收的当前路径
-    void drawNetworkPath(const QVariantMap &data);
-    void drawNetworkLine(const QVariantMap &data);
-    void drawNetworkRectangle(const QVariantMap &data);
-    void drawNetworkEllipse(const QVariantMap &data);
-    void addNetworkText(const QVariantMap &data);
-    void performNetworkErase(const QVariantMap &data);
+    // 网络绘图方法返回创建的图形，由processNetworkOperation按操作id建立索引
+    QGraphicsItem *drawNetworkPath(const QVariantMap &data);
+    QGraphicsItem *drawNetworkLine(const QVariantMap &data);
+    QGraphicsItem *drawNetworkRectangle(const QVariantMap &data);
+    QGraphicsItem *drawNetworkEllipse(const QVariantMap &data);
+    QGraphicsItem *addNetworkText(const QVariantMap &data);
+    // 带有itemIds时按id擦除，否则按橡皮擦位置擦除；返回被擦除图形的id
+    QStringList performNetworkErase(const QVariantMap &data);
     bool isPathIntersecting(QGraphicsPathItem* pathItem, const QRectF& eraserArea);
     bool isLineIntersectingRect(const QPointF& p1, const QPointF& p2, const QRectF& rect);
-    void processNetworkUndo(const QVariantMap &data);
-    void processNetworkRedo(const QVariantMap &data);
-    QList<QGraphicsItem*> getCurrentSceneState() const;
+    void processNetworkUndo(const DrawingOperation &operation);
+    void processNetworkRedo(const DrawingOperation &operation);
+
+    // 远端正在绘制的笔画，按 发送者/笔画id 区分，收到开始笔画和添加点时增量绘制，
+    // 收到结束笔画时只校正路径，不再重新绘制
+    QHash<QString, StrokeItem*> m_remoteStrokes;
+    QSet<QGraphicsItem*> m_remoteStrokeItems;  // 未结束的远端笔画项，不参与撤销状态
+    static QString remoteStrokeKey(const DrawingOperation &operation);
+    void beginRemoteStroke(const DrawingOperation &operation);
+    void appendRemotePoints(const DrawingOperation &operation);
+    QGraphicsItem *endRemoteStroke(const DrawingOperation &operation);
 
 };
 
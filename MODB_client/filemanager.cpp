@@ -21,6 +21,7 @@ bool FileManager::newFile(QGraphicsScene *scene)
 {
     if (maybeSave(scene)) {
         // 清除原来的内容，然后发送一个信号
+        emit sceneAboutToBeCleared();
         scene->clear();
         m_currentFilePath = "";
         m_isModified = false;
@@ -167,6 +168,7 @@ bool FileManager::loadFromFile(QGraphicsScene *scene, const QString &fileName)
         return false;
     }
     // 清除原来的内容之后使用打开的文件内容代替
+    emit sceneAboutToBeCleared();
     scene->clear();
     // 对序列化的内容进行反序列化，得到原始的字符
     deserializeScene(scene, doc.array());
@@ -39,6 +39,8 @@ signals:
     void fileModified(bool modified);
     void errorOccurred(const QString &message);
     void gridStateChanged(bool showGrid);
+    // 场景即将被清空（新建/打开文件），场景中的图形随后被删除
+    void sceneAboutToBeCleared();
 
 private:
     // 内部实现方法
@@ -0,0 +1,101 @@
+﻿#include "renderbenchmark.h"
+#include "asynclogger.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QFile>
+#include <cstdio>
+
+// 客户端绘制压测：默认使用离屏平台，结果以JSON输出到标准输出或--output指定的文件
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+    QApplication::setApplicationName("MODB_renderbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("MODB whiteboard client rendering benchmark");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "场景图形数量，逗号分隔，默认1000,10000,100000", "counts", "1000,10000,100000");
+    QCommandLineOption opsOption("ops", "每个场景处理的网络绘图操作数量，默认500", "count", "500");
+    QCommandLineOption framesOption("frames", "每种视图绘制的帧数，默认30", "count", "30");
+    QCommandLineOption eraseOption("erase-steps", "橡皮擦经过的位置数量，默认200", "count", "200");
+    QCommandLineOption undoOption("undo-loops", "撤销/重做的次数，默认20", "count", "20");
+    QCommandLineOption gridOption("grid-toggles", "网格显示切换的次数，默认20", "count", "20");
+    QCommandLineOption labelOption("label", "写入结果中的标签，例如提交号", "label");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "结果文件，默认输出到标准输出", "file");
+    QCommandLineOption logOption("log-level", "日志级别: debug/info/warning/error/off，默认为环境变量MODB_LOG_LEVEL或info", "level");
+    parser.addOption(sizesOption);
+    parser.addOption(opsOption);
+    parser.addOption(framesOption);
+    parser.addOption(eraseOption);
+    parser.addOption(undoOption);
+    parser.addOption(gridOption);
+    parser.addOption(labelOption);
+    parser.addOption(outputOption);
+    parser.addOption(logOption);
+    parser.process(a);
+
+    LogLevel logLevel = AsyncLogger::levelFromName(qEnvironmentVariable("MODB_LOG_LEVEL"), LL_Info);
+    if (parser.isSet(logOption)) {
+        logLevel = AsyncLogger::levelFromName(parser.value(logOption), logLevel);
+    }
+    AsyncLogger::setLevel(logLevel);
+    AsyncLogger::instance().start();
+
+    RenderBenchConfig config;
+    bool ok = true;
+    auto countValue = [&parser, &ok](const QCommandLineOption &option, int minimum) {
+        bool valid = false;
+        int value = parser.value(option).toInt(&valid);
+        if (!valid || value < minimum) {
+            qCritical() << "无效的参数" << option.names().last() << ":" << parser.value(option);
+            ok = false;
+        }
+        return value;
+    };
+    config.sizes.clear();
+    const QStringList sizes = parser.value(sizesOption).split(',', Qt::SkipEmptyParts);
+    for (const QString &size : sizes) {
+        bool valid = false;
+        int value = size.trimmed().toInt(&valid);
+        if (!valid || value < 0) {
+            qCritical() << "无效的场景图形数量:" << size;
+            ok = false;
+        }
+        config.sizes.append(value);
+    }
+    config.ops = countValue(opsOption, 0);
+    config.frames = countValue(framesOption, 0);
+    config.eraseSteps = countValue(eraseOption, 0);
+    config.undoLoops = countValue(undoOption, 0);
+    config.gridToggles = countValue(gridOption, 0);
+    config.label = parser.value(labelOption);
+    if (!ok || config.sizes.isEmpty()) {
+        AsyncLogger::instance().stop();
+        return 1;
+    }
+
+    RenderBenchmark benchmark(config);
+    QByteArray json = QJsonDocument(benchmark.run()).toJson(QJsonDocument::Indented);
+
+    int result = 0;
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(json) == json.size()) {
+            LOG_INFO("bench") << "结果已写入" << file.fileName();
+        } else {
+            qCritical() << "写入结果失败:" << file.fileName() << file.errorString();
+            result = 1;
+        }
+    } else {
+        std::fwrite(json.constData(), 1, json.size(), stdout);
+        std::fflush(stdout);
+    }
+
+    AsyncLogger::instance().stop();
+    return result;
+}
@@ -0,0 +1,325 @@
+﻿#include "renderbenchmark.h"
+#include "client.h"
+#include "drawingtool.h"
+#include "strokeitem.h"
+#include "asynclogger.h"
+
+#include <QApplication>
+#include <QGraphicsView>
+#include <QGraphicsRectItem>
+#include <QGraphicsEllipseItem>
+#include <QGraphicsLineItem>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QPixmap>
+#include <algorithm>
+#include <cmath>
+
+RenderBenchmark::RenderBenchmark(const RenderBenchConfig &config)
+    : m_config(config)
+    , m_random(20240601)
+    , m_strokeSerial(0)
+{
+}
+
+QJsonObject RenderBenchmark::run()
+{
+    QJsonArray results;
+    for (int items : std::as_const(m_config.sizes)) {
+        runSize(items, results);
+    }
+
+    return QJsonObject{
+        {"benchmark", "MODB_renderbench"},
+        {"label", m_config.label},
+        {"qtVersion", QString(qVersion())},
+        {"platform", QGuiApplication::platformName()},
+        {"timestamp", QDateTime::currentDateTime().toString(Qt::ISODate)},
+        {"config", QJsonObject{
+            {"ops", m_config.ops},
+            {"frames", m_config.frames},
+            {"eraseSteps", m_config.eraseSteps},
+            {"undoLoops", m_config.undoLoops},
+            {"gridToggles", m_config.gridToggles},
+            {"viewWidth", m_config.viewSize.width()},
+            {"viewHeight", m_config.viewSize.height()}
+        }},
+        {"results", results}
+    };
+}
+
+// 每种规模使用新的客户端窗口，擦除会破坏场景，放在最后
+void RenderBenchmark::runSize(int items, QJsonArray &results)
+{
+    Client client;
+    client.resize(m_config.viewSize);
+    client.show();
+    QApplication::processEvents();
+
+    QGraphicsScene *scene = client.m_drawingTool->m_scene;
+    scene->setSceneRect(0, 0, SceneWidth, SceneHeight);
+    client.updateGrid();
+    populate(scene, items);
+    LOG_INFO("bench") << "场景图形数量:" << items << "（包括网格）" << scene->items().size();
+
+    benchFrames(client, items, results);
+    benchIngest(client, items, results);
+    benchGrid(client, items, results);
+    benchUndoRedo(client, items, results);
+    benchErase(client, items, results);
+
+    // 图形生命周期：擦除的图形为撤销保留，被撤销后又有新操作的图形已经释放
+    DrawingTool::ItemStats stats = client.m_drawingTool->itemStats();
+    results.append(QJsonObject{
+        {"case", "item_lifetime"},
+        {"items", items},
+        {"live", stats.live},
+        {"retained", stats.retained},
+        {"reclaimed", stats.reclaimed},
+        {"undoDepth", client.m_drawingTool->undoDepth()},
+        {"redoDepth", client.m_drawingTool->redoDepth()}
+    });
+}
+
+void RenderBenchmark::populate(QGraphicsScene *scene, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        QPointF origin = randomPoint();
+        QPen pen(QColor::fromRgb(m_random.generate() | 0xFF000000), 1 + m_random.bounded(4));
+        int kind = m_random.bounded(100);
+        if (kind < 60) {
+            StrokeItem *stroke = new StrokeItem(origin, QPen(pen.color(), pen.width(), Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+            QPointF point = origin;
+            for (int p = 0; p < StrokeBatches * PointsPerBatch; ++p) {
+                point += QPointF(m_random.bounded(12.0) - 6.0, m_random.bounded(12.0) - 6.0);
+                stroke->addPoint(point);
+            }
+            stroke->finish();
+            scene->addItem(stroke);
+        } else if (kind < 85) {
+            QGraphicsRectItem *rect = new QGraphicsRectItem(origin.x(), origin.y(),
+                                                            10 + m_random.bounded(190.0), 10 + m_random.bounded(190.0));
+            rect->setPen(pen);
+            scene->addItem(rect);
+        } else if (kind < 95) {
+            QGraphicsEllipseItem *ellipse = new QGraphicsEllipseItem(origin.x(), origin.y(),
+                                                                     10 + m_random.bounded(190.0), 10 + m_random.bounded(190.0));
+            ellipse->setPen(pen);
+            scene->addItem(ellipse);
+        } else {
+            QPointF end = randomPoint();
+            QGraphicsLineItem *line = new QGraphicsLineItem(origin.x(), origin.y(), end.x(), end.y());
+            line->setPen(pen);
+            scene->addItem(line);
+        }
+    }
+}
+
+QList<DrawingOperation> RenderBenchmark::syntheticOps(int count)
+{
+    QList<DrawingOperation> ops;
+    while (ops.size() < count) {
+        int kind = m_random.bounded(100);
+        if (kind < 60) {
+            // 完整的远端笔画：开始、按批添加点、带完整路径的结束
+            QString strokeId = QString::number(++m_strokeSerial);
+            QPointF point = randomPoint();
+            QPainterPath path(point);
+            ops.append(makeOperation(DOT_BeginStroke, QJsonObject{
+                {"startX", point.x()},
+                {"startY", point.y()},
+                {"penColor", "#1e90ff"},
+                {"penWidth", 3},
+                {"strokeId", strokeId}
+            }));
+            for (int batch = 0; batch < StrokeBatches; ++batch) {
+                QJsonArray points;
+                for (int p = 0; p < PointsPerBatch; ++p) {
+                    point += QPointF(m_random.bounded(12.0) - 6.0, m_random.bounded(12.0) - 6.0);
+                    points.append(QJsonObject{{"x", point.x()}, {"y", point.y()}});
+                    path.lineTo(point);
+                }
+                ops.append(makeOperation(DOT_AddPoint, QJsonObject{{"points", points}, {"strokeId", strokeId}}));
+            }
+            ops.append(makeOperation(DOT_EndStroke, QJsonObject{
+                {"path", DrawingOperation::encodePath(path)},
+                {"penColor", "#1e90ff"},
+                {"penWidth", 3},
+                {"strokeId", strokeId}
+            }));
+        } else if (kind < 95) {
+            QPointF topLeft = randomPoint();
+            ops.append(makeOperation(kind < 85 ? DOT_DrawRectangle : DOT_DrawEllipse, QJsonObject{
+                {"x", topLeft.x()},
+                {"y", topLeft.y()},
+                {"width", 10 + m_random.bounded(190.0)},
+                {"height", 10 + m_random.bounded(190.0)},
+                {"penColor", "#ff4500"},
+                {"penWidth", 2},
+                {"isFilled", false}
+            }));
+        } else {
+            QPointF p1 = randomPoint();
+            QPointF p2 = randomPoint();
+            ops.append(makeOperation(DOT_DrawLine, QJsonObject{
+                {"x1", p1.x()}, {"y1", p1.y()},
+                {"x2", p2.x()}, {"y2", p2.y()},
+                {"penColor", "#228b22"},
+                {"penWidth", 2}
+            }));
+        }
+    }
+    return ops.mid(0, count);
+}
+
+DrawingOperation RenderBenchmark::makeOperation(DrawingOperationType opType, const QJsonObject &data) const
+{
+    DrawingOperation op = DrawingOperation::fromJson(QJsonObject{
+        {"opType", static_cast<int>(opType)},
+        {"data", data}
+    });
+    op.senderId = "bench";
+    return op;
+}
+
+QPointF RenderBenchmark::randomPoint()
+{
+    return QPointF(m_random.bounded(SceneWidth - 200), m_random.bounded(SceneHeight - 200));
+}
+
+// 视图绘制一帧的耗时：1:1显示场景中心，以及缩放到整个场景（所有图形都需要绘制）
+void RenderBenchmark::benchFrames(Client &client, int items, QJsonArray &results)
+{
+    QGraphicsView *view = client.findChild<QGraphicsView*>("whiteBoard");
+    if (!view) {
+        LOG_WARNING("bench") << "找不到白板视图，跳过帧耗时";
+        return;
+    }
+
+    const QList<QPair<QString, bool>> modes{{"frame_view", false}, {"frame_fit", true}};
+    for (const auto &mode : modes) {
+        view->resetTransform();
+        if (mode.second) {
+            view->fitInView(view->scene()->sceneRect(), Qt::KeepAspectRatio);
+        } else {
+            view->centerOn(SceneWidth / 2, SceneHeight / 2);
+        }
+        QApplication::processEvents();
+
+        QVector<qint64> samples;
+        QElapsedTimer timer;
+        for (int i = 0; i < m_config.frames; ++i) {
+            timer.start();
+            QPixmap frame = view->viewport()->grab();
+            samples.append(timer.nsecsElapsed());
+        }
+        results.append(summarize(mode.first, items, samples));
+    }
+    view->resetTransform();
+}
+
+// 网络绘图操作的处理吞吐：每个操作都经过processNetworkOperation（包括保存撤销状态）
+void RenderBenchmark::benchIngest(Client &client, int items, QJsonArray &results)
+{
+    const QList<DrawingOperation> ops = syntheticOps(m_config.ops);
+    QVector<qint64> samples;
+    QElapsedTimer timer;
+    for (const DrawingOperation &op : ops) {
+        timer.start();
+        client.m_drawingTool->processNetworkOperation(op);
+        samples.append(timer.nsecsElapsed());
+    }
+    results.append(summarize("ingest", items, samples));
+}
+
+void RenderBenchmark::benchGrid(Client &client, int items, QJsonArray &results)
+{
+    QVector<qint64> samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < m_config.gridToggles; ++i) {
+        client.m_showGrid = !client.m_showGrid;
+        timer.start();
+        client.updateGrid();
+        samples.append(timer.nsecsElapsed());
+    }
+    // 恢复显示网格
+    if (!client.m_showGrid) {
+        client.m_showGrid = true;
+        client.updateGrid();
+    }
+    results.append(summarize("grid_toggle", items, samples));
+}
+
+void RenderBenchmark::benchUndoRedo(Client &client, int items, QJsonArray &results)
+{
+    QVector<qint64> undoSamples;
+    QVector<qint64> redoSamples;
+    QElapsedTimer timer;
+    for (int i = 0; i < m_config.undoLoops; ++i) {
+        timer.start();
+        client.m_drawingTool->undo();
+        undoSamples.append(timer.nsecsElapsed());
+
+        timer.start();
+        client.m_drawingTool->redo();
+        redoSamples.append(timer.nsecsElapsed());
+    }
+    results.append(summarize("undo", items, undoSamples));
+    results.append(summarize("redo", items, redoSamples));
+}
+
+// 橡皮擦按行扫过整个场景
+void RenderBenchmark::benchErase(Client &client, int items, QJsonArray &results)
+{
+    QGraphicsScene *scene = client.m_drawingTool->m_scene;
+    int before = scene->items().size();
+
+    int rows = qMax(1, qRound(std::sqrt(m_config.eraseSteps * SceneHeight / SceneWidth)));
+    int columns = qMax(1, (m_config.eraseSteps + rows - 1) / rows);
+    QVector<qint64> samples;
+    QElapsedTimer timer;
+    for (int step = 0; step < m_config.eraseSteps; ++step) {
+        int row = step / columns;
+        int column = step % columns;
+        QPointF position((column + 0.5) * SceneWidth / columns, (row + 0.5) * SceneHeight / rows);
+        timer.start();
+        client.m_drawingTool->eraseAtPosition(position);
+        samples.append(timer.nsecsElapsed());
+    }
+
+    QJsonObject result = summarize("erase_sweep", items, samples);
+    result["erased"] = before - scene->items().size();
+    results.append(result);
+}
+
+QJsonObject RenderBenchmark::summarize(const QString &name, int items, const QVector<qint64> &samplesNs)
+{
+    QVector<qint64> sorted = samplesNs;
+    std::sort(sorted.begin(), sorted.end());
+    qint64 total = 0;
+    for (qint64 sample : std::as_const(sorted)) {
+        total += sample;
+    }
+    auto percentileUs = [&sorted](double quantile) {
+        if (sorted.isEmpty()) return 0.0;
+        int index = qBound(0, static_cast<int>(std::ceil(quantile * sorted.size())) - 1, static_cast<int>(sorted.size()) - 1);
+        return sorted[index] / 1000.0;
+    };
+
+    int count = sorted.size();
+    QJsonObject result{
+        {"case", name},
+        {"items", items},
+        {"samples", count},
+        {"totalMs", total / 1e6},
+        {"perSecond", total > 0 ? count * 1e9 / total : 0.0},
+        {"meanUs", count > 0 ? total / 1000.0 / count : 0.0},
+        {"p50Us", percentileUs(0.5)},
+        {"p95Us", percentileUs(0.95)},
+        {"p99Us", percentileUs(0.99)},
+        {"maxUs", sorted.isEmpty() ? 0.0 : sorted.last() / 1000.0}
+    };
+    LOG_INFO("bench") << name << "图形" << items << "次数" << count
+                      << "平均" << result["meanUs"].toDouble() << "us p99" << result["p99Us"].toDouble() << "us";
+    return result;
+}
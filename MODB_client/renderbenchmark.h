@@ -0,0 +1,67 @@
+﻿#ifndef RENDERBENCHMARK_H
+#define RENDERBENCHMARK_H
+
+#include <QList>
+#include <QVector>
+#include <QSize>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QGraphicsScene>
+
+#include "networkprotocol.h"
+
+class Client;
+
+// 压测配置
+struct RenderBenchConfig {
+    QList<int> sizes{1000, 10000, 100000};  // 场景中的图形数量
+    int ops = 500;                  // 每个场景处理的网络绘图操作数量
+    int frames = 30;                // 每种视图绘制的帧数
+    int eraseSteps = 200;           // 橡皮擦经过的位置数量
+    int undoLoops = 20;             // 撤销/重做的次数
+    int gridToggles = 20;           // 网格显示切换的次数
+    QSize viewSize{1280, 800};
+    QString label;                  // 写入结果中，用于区分不同提交的结果
+};
+
+// 客户端绘制压测：在离屏平台上创建完整的客户端窗口，按不同的场景规模测量
+// 网络绘图操作的处理吞吐、视图绘制的帧耗时、橡皮擦、撤销/重做和网格切换的耗时，
+// 结果为JSON，便于不同提交之间对比
+class RenderBenchmark
+{
+public:
+    explicit RenderBenchmark(const RenderBenchConfig &config);
+
+    QJsonObject run();
+
+private:
+    static constexpr qreal SceneWidth = 4000;
+    static constexpr qreal SceneHeight = 3000;
+    static constexpr int StrokeBatches = 4;
+    static constexpr int PointsPerBatch = 8;
+
+    RenderBenchConfig m_config;
+    QRandomGenerator m_random;
+    int m_strokeSerial;
+
+    void runSize(int items, QJsonArray &results);
+
+    // 直接往场景中添加和网络绘图相同类型的图形，作为测量的初始场景
+    void populate(QGraphicsScene *scene, int count);
+    // 和服务端转发的消息相同：按JSON构造再解析（包括路径解码）
+    QList<DrawingOperation> syntheticOps(int count);
+    DrawingOperation makeOperation(DrawingOperationType opType, const QJsonObject &data) const;
+    QPointF randomPoint();
+
+    void benchFrames(Client &client, int items, QJsonArray &results);
+    void benchIngest(Client &client, int items, QJsonArray &results);
+    void benchGrid(Client &client, int items, QJsonArray &results);
+    void benchUndoRedo(Client &client, int items, QJsonArray &results);
+    void benchErase(Client &client, int items, QJsonArray &results);
+
+    // 单次耗时（纳秒）汇总成一条结果：总耗时、每秒次数、平均值和分位数（微秒）
+    static QJsonObject summarize(const QString &name, int items, const QVector<qint64> &samplesNs);
+};
+
+#endif // RENDERBENCHMARK_H
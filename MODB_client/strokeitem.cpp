@@ -0,0 +1,150 @@
+﻿#include "strokeitem.h"
+#include <QPainter>
+#include <QPainterPathStroker>
+#include <QStyleOptionGraphicsItem>
+
+StrokeItem::StrokeItem(const QPointF &start, const QPen &pen, QGraphicsItem *parent)
+    : QGraphicsPathItem(parent)
+    , m_finished(false)
+    , m_shapePoints(0)
+{
+    setPen(pen);
+    // 需要exposedRect来只绘制刷新区域内的线段
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+
+    m_points.reserve(256);
+    m_points.append(start);
+    qreal margin = penMargin();
+    m_bounds = QRectF(start, start).adjusted(-margin, -margin, margin, margin);
+    m_shapeCache.setFillRule(Qt::WindingFill);
+}
+
+qreal StrokeItem::penMargin() const
+{
+    return qMax<qreal>(pen().widthF(), 1.0) / 2 + 1;
+}
+
+void StrokeItem::addPoint(const QPointF &point)
+{
+    if (m_finished) return;
+
+    QPointF last = m_points.last();
+    m_points.append(point);
+
+    qreal margin = penMargin();
+    QRectF segment = QRectF(last, point).normalized().adjusted(-margin, -margin, margin, margin);
+    if (!m_bounds.contains(segment)) {
+        // 按当前大小的一半扩展，扩展次数随笔画长度对数增长
+        qreal grow = qMax(MinGrowMargin, qMax(m_bounds.width(), m_bounds.height()) / 2);
+        prepareGeometryChange();
+        m_bounds = m_bounds.united(segment.adjusted(-grow, -grow, grow, grow));
+    }
+    int chunk = (m_points.size() - 2) / ChunkSize;
+    if (chunk == m_chunkBounds.size()) {
+        m_chunkBounds.append(segment);
+    } else {
+        m_chunkBounds[chunk] = m_chunkBounds[chunk].united(segment);
+    }
+    // 只刷新新增的线段
+    update(segment);
+}
+
+void StrokeItem::finish()
+{
+    if (m_finished) return;
+
+    prepareGeometryChange();
+    m_finished = true;
+    setPath(buildPath());
+    // 路径生成之后不再需要点缓冲和绘制过程中的索引
+    m_points = QVector<QPointF>();
+    m_chunkBounds = QVector<QRectF>();
+    m_shapeCache = QPainterPath();
+    m_shapePoints = 0;
+}
+
+QPainterPath StrokeItem::buildPath() const
+{
+    if (m_finished) {
+        return path();
+    }
+    QPainterPath result;
+    result.reserve(m_points.size());
+    result.moveTo(m_points.first());
+    for (int i = 1; i < m_points.size(); ++i) {
+        result.lineTo(m_points[i]);
+    }
+    return result;
+}
+
+QRectF StrokeItem::boundingRect() const
+{
+    if (m_finished) {
+        return QGraphicsPathItem::boundingRect();
+    }
+    return m_bounds;
+}
+
+QPainterPath StrokeItem::shape() const
+{
+    if (m_finished) {
+        return QGraphicsPathItem::shape();
+    }
+    // 只描边上次之后新增的线段（从上次的最后一个点开始，保证相邻部分连接）
+    if (m_shapePoints < m_points.size()) {
+        int start = qMax(0, m_shapePoints - 1);
+        QPainterPath tail;
+        tail.moveTo(m_points[start]);
+        for (int i = start + 1; i < m_points.size(); ++i) {
+            tail.lineTo(m_points[i]);
+        }
+        QPainterPathStroker stroker(pen());
+        m_shapeCache.addPath(stroker.createStroke(tail));
+        m_shapePoints = m_points.size();
+    }
+    return m_shapeCache;
+}
+
+void StrokeItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    if (m_finished) {
+        QGraphicsPathItem::paint(painter, option, widget);
+        return;
+    }
+
+    painter->setPen(pen());
+    painter->setBrush(Qt::NoBrush);
+    if (m_points.size() == 1) {
+        painter->drawPoint(m_points.first());
+        return;
+    }
+
+    // 只绘制和刷新区域相交的连续线段，不相交的块整体跳过，
+    // 追加一个点时通常只需要检查最后一块
+    qreal margin = penMargin();
+    QRectF exposed = option->exposedRect;
+    int runStart = -1;
+    for (int chunk = 0; chunk < m_chunkBounds.size(); ++chunk) {
+        int first = chunk * ChunkSize + 1;
+        if (!exposed.intersects(m_chunkBounds[chunk])) {
+            if (runStart >= 0) {
+                painter->drawPolyline(m_points.constData() + runStart, first - runStart);
+                runStart = -1;
+            }
+            continue;
+        }
+        int last = qMin(first + ChunkSize, static_cast<int>(m_points.size()));
+        for (int i = first; i < last; ++i) {
+            QRectF segment = QRectF(m_points[i - 1], m_points[i]).normalized().adjusted(-margin, -margin, margin, margin);
+            if (exposed.intersects(segment)) {
+                if (runStart < 0) runStart = i - 1;
+            } else if (runStart >= 0) {
+                painter->drawPolyline(m_points.constData() + runStart, i - runStart);
+                runStart = -1;
+            }
+        }
+    }
+    if (runStart >= 0) {
+        painter->drawPolyline(m_points.constData() + runStart, m_points.size() - runStart);
+    }
+}
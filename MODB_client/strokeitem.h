@@ -0,0 +1,47 @@
+﻿#ifndef STROKEITEM_H
+#define STROKEITEM_H
+
+#include <QGraphicsPathItem>
+#include <QVector>
+#include <QPen>
+
+// 铅笔笔画项：绘制过程中点追加到点缓冲中，每次只刷新新增线段的区域，
+// 不再每个点都复制整条路径再setPath。笔画结束时调用finish()一次性生成路径，
+// 之后和普通的QGraphicsPathItem一样参与擦除、撤销和保存
+class StrokeItem : public QGraphicsPathItem
+{
+public:
+    StrokeItem(const QPointF &start, const QPen &pen, QGraphicsItem *parent = nullptr);
+
+    // 追加一个点，只刷新新增的线段
+    void addPoint(const QPointF &point);
+    // 结束笔画，把点缓冲转换成路径
+    void finish();
+    bool isFinished() const { return m_finished; }
+
+    const QVector<QPointF> &points() const { return m_points; }
+    QPainterPath buildPath() const;
+
+    QRectF boundingRect() const override;
+    QPainterPath shape() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+private:
+    // 边界不够时一次多扩展一些，避免每个点都prepareGeometryChange导致整个笔画重绘
+    static constexpr qreal MinGrowMargin = 64;
+    // 每ChunkSize条线段记录一个边界，绘制时先按块排除，只检查和刷新区域相交的块中的线段
+    static constexpr int ChunkSize = 64;
+
+    QVector<QPointF> m_points;
+    QVector<QRectF> m_chunkBounds;  // 第i块包含线段 [i*ChunkSize+1, (i+1)*ChunkSize]（线段k连接点k-1和点k）
+    QRectF m_bounds;        // 绘制过程中的边界（包含画笔宽度和预留的余量）
+    bool m_finished;
+
+    // 绘制过程中的形状缓存，每次只描边新增的线段追加进去
+    mutable QPainterPath m_shapeCache;
+    mutable int m_shapePoints;      // 已经描边的点数
+
+    qreal penMargin() const;
+};
+
+#endif // STROKEITEM_H
@@ -2,16 +2,24 @@
 #include <QUrl>
 #include <QJsonDocument>
 #include <QJsonArray>
+#include <QElapsedTimer>
 
 WebSocketManager::WebSocketManager(QObject *parent)
     : QObject(parent)
     , m_webSocket(new QWebSocket())
     , m_heartbeatTimer(new QTimer(this))
+    , m_roundTripMs(-1)
     , m_userId("")
     , m_userName("")
     , m_roomId("")
     , m_currentRole(UR_Editor)
     , m_isConnected(false)
+    , m_wireFormat(WF_Json)
+    , m_preferredWireFormat(WF_Binary)
+    , m_pointFlushTimer(new QTimer(this))
+    , m_historyTimer(new QTimer(this))
+    , m_historyChunkPos(0)
+    , m_historySyncing(false)
 {
     // 重要：禁用代理，直接连接
     m_webSocket->setProxy(QNetworkProxy::NoProxy);
@@ -19,12 +27,21 @@ WebSocketManager::WebSocketManager(QObject *parent)
     connect(m_webSocket, &QWebSocket::connected, this, &WebSocketManager::onConnected);
     connect(m_webSocket, &QWebSocket::disconnected, this, &WebSocketManager::onDisconnected);
     connect(m_webSocket, &QWebSocket::textMessageReceived, this, &WebSocketManager::onTextMessageReceived);
+    connect(m_webSocket, &QWebSocket::binaryMessageReceived, this, &WebSocketManager::onBinaryMessageReceived);
     connect(m_webSocket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::errorOccurred),
             this, &WebSocketManager::onErrorOccurred);
 
     // 30秒自动检查一次连接是否还在继续
     m_heartbeatTimer->setInterval(30000); // 30秒心跳
     connect(m_heartbeatTimer, &QTimer::timeout, this, &WebSocketManager::sendHeartbeat);
+
+    m_pointFlushTimer->setSingleShot(true);
+    m_pointFlushTimer->setInterval(PointFlushInterval);
+    connect(m_pointFlushTimer, &QTimer::timeout, this, &WebSocketManager::flushPendingPoints);
+
+    // 0毫秒定时器：每次事件循环空闲时处理一个时间片的历史操作
+    m_historyTimer->setInterval(0);
+    connect(m_historyTimer, &QTimer::timeout, this, &WebSocketManager::applyHistorySlice);
 }
 
 WebSocketManager::~WebSocketManager()
@@ -63,6 +80,9 @@ void WebSocketManager::onConnected()
     // 修改连接状态和启动定时器
     m_isConnected = true;
     m_heartbeatTimer->start();
+    // 协商线协议格式，回复到达之前仍然使用JSON
+    m_wireFormat = WF_Json;
+    sendProtocolHello();
     // 发送连接成功的消息给客户端client
     emit connected();
 }
@@ -74,6 +94,11 @@ void WebSocketManager::onDisconnected()
     m_heartbeatTimer->stop();
     m_userId = "";
     m_roomId = "";
+    m_wireFormat = WF_Json;
+    // 断开之后未发送的笔画点直接丢弃
+    m_pointFlushTimer->stop();
+    m_pendingPoints = QJsonArray();
+    resetHistorySync();
     emit disconnected();
 }
 
@@ -88,12 +113,31 @@ void WebSocketManager::onTextMessageReceived(const QString &message)
     processMessage(networkMsg);
 }
 
+void WebSocketManager::onBinaryMessageReceived(const QByteArray &message)
+{
+    // 接收来自服务端的二进制帧
+    NetworkMessage networkMsg;
+    if (!BinaryCodec::decode(message, networkMsg)) {
+        LOG_WARNING("net") << "无法解析的二进制帧，长度:" << message.size();
+        return;
+    }
+    processMessage(networkMsg);
+}
+
 void WebSocketManager::processMessage(const NetworkMessage &message)
 {
+    // 历史同步完成之前，改变画布的实时消息先缓存，保证在历史之后处理
+    if (m_historySyncing &&
+        (message.type == MT_DrawingOperation || message.type == MT_ClearScene ||
+         message.type == MT_UndoRequest || message.type == MT_RedoRequest)) {
+        m_deferredMessages.append(message);
+        return;
+    }
+
     // 根据消息类型来进行处理
     switch (message.type) {
         case MT_JoinResponse: // 加入房间消息
-            std::cout<<"join room = "<<message.data["roomId"].toString().toStdString()<<std::endl;
+            LOG_DEBUG("net") << "join room =" << message.data["roomId"].toString();
             if (message.data["success"].toBool()) {
                 // 成功加入指定房间号
                 m_userId = message.data["userId"].toString();
@@ -104,6 +148,10 @@ void WebSocketManager::processMessage(const NetworkMessage &message)
                 // 发送信号通知有用户加入
                 emit userJoined(m_userId, userName, role);
 
+                // 分块同步时历史随后按块到达
+                resetHistorySync();
+                m_historySyncing = message.data["historySize"].toInt() > 0;
+
                 // 如果包含历史绘图，就需要处理历史绘图在当前布局中
                 if (message.data.contains("drawingHistory")) {
                     QJsonArray history = message.data["drawingHistory"].toArray();
@@ -125,11 +173,13 @@ void WebSocketManager::processMessage(const NetworkMessage &message)
         case MT_DrawingOperation:
         {
             DrawingOperation op = DrawingOperation::fromJson(message.data);
+            // 远端正在进行的笔画按发送者区分
+            op.senderId = message.senderId;
             // qDebug() << "绘图操作类型:" << op.opType;
             // qDebug() << "操作数据键值:" << op.data.keys();
 
             if (op.data.contains("path")) {
-                qDebug() << "包含路径数据";
+                LOG_DEBUG("net") << "包含路径数据";
             }
 
             emit drawingOperationReceived(op);
@@ -139,11 +189,19 @@ void WebSocketManager::processMessage(const NetworkMessage &message)
             emit clearSceneReceived();
             break;
         case MT_UndoRequest:
-            emit undoRequestReceived();
-            break;
         case MT_RedoRequest:
-            emit redoRequestReceived();
-            break;
+        {
+            DrawingOperation op = DrawingOperation::fromJson(message.data);
+            op.senderId = message.senderId;
+            if (message.type == MT_UndoRequest) {
+                op.opType = DOT_Undo;
+                emit undoRequestReceived(op);
+            } else {
+                op.opType = DOT_Redo;
+                emit redoRequestReceived(op);
+            }
+        }
+        break;
         case MT_ChatMessage:// 发送聊天信息
             emit chatMessageReceived(message.data["userName"].toString(), message.data["message"].toString());
             break;
@@ -167,7 +225,7 @@ void WebSocketManager::processMessage(const NetworkMessage &message)
                 m_userId = message.data["userId"].toString();
 
                 if (success) {
-                    std::cout<<"create room = "<<roomId.toStdString()<<std::endl;
+                    LOG_DEBUG("net") << "create room =" << roomId;
                     m_currentRoomId = roomId;
                     m_currentRoomName = roomName;
                     emit roomCreated(roomId, roomName);
@@ -195,6 +253,30 @@ void WebSocketManager::processMessage(const NetworkMessage &message)
         case MT_RoomError:
             emit roomError(message.data["error"].toString());
             break;
+
+        case MT_ProtocolHello:
+            // 服务端选定的线协议格式，之后的消息都按此格式发送
+            m_wireFormat = BinaryCodec::formatFromName(message.data["format"].toString());
+            break;
+        case MT_HistoryChunk:
+            // 分块到达后排队，由定时器分时处理
+            if (m_historySyncing) {
+                m_historyChunks.enqueue(HistoryChunk{
+                    message.data["offset"].toInt(),
+                    message.data["ops"].toArray(),
+                    message.data["last"].toBool()
+                });
+                if (!m_historyTimer->isActive()) {
+                    m_historyTimer->start();
+                }
+            }
+            break;
+        case MT_Heartbeat:
+            // 服务端带回了心跳的发送时间
+            if (message.data.contains("clientTime")) {
+                m_roundTripMs = QDateTime::currentMSecsSinceEpoch() - message.data["clientTime"].toInteger();
+            }
+            break;
         default:
             break;
     }
@@ -229,7 +311,7 @@ void WebSocketManager::processClientList(const QJsonObject &data)
                     // 添加到返回列表
                     clientList.append(clientObj);
 
-                    qDebug() << "房间用户:" << userName << "(" << userId << "), 角色:" << role;
+                    LOG_DEBUG("net") << "房间用户:" << userName << "(" << userId << "), 角色:" << role;
                 }
             }
 
@@ -237,7 +319,7 @@ void WebSocketManager::processClientList(const QJsonObject &data)
             emit clientListReceived(clientList);
         }
     } catch (const std::exception &e) {
-        qWarning() << "处理客户端列表错误:" << e.what();
+        LOG_WARNING("net") << "处理客户端列表错误:" << e.what();
     }
 }
 
@@ -249,15 +331,68 @@ void WebSocketManager::joinRoom(const QString &roomId, const QString &userName)
 
     NetworkMessage message;
     message.type = MT_JoinRequest;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
     message.data = QJsonObject{
         {"roomId", roomId},
-        {"userName", userName}
+        {"userName", userName},
+        {"historyChunks", true}     // 历史按块同步
     };
 
     sendNetworkMessage(message);
 }
 
+// 处理一个时间片的历史操作，处理完一个分块后向服务端确认
+void WebSocketManager::applyHistorySlice()
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    while (!m_historyChunks.isEmpty() && elapsed.elapsed() < HistorySliceMs) {
+        HistoryChunk &chunk = m_historyChunks.head();
+        if (m_historyChunkPos < chunk.ops.size()) {
+            DrawingOperation op = DrawingOperation::fromJson(chunk.ops.at(m_historyChunkPos++).toObject());
+            emit drawingOperationReceived(op);
+            continue;
+        }
+
+        // 当前分块处理完毕
+        NetworkMessage ack;
+        ack.type = MT_HistoryAck;
+        ack.timestamp = QDateTime::currentMSecsSinceEpoch();
+        ack.data = QJsonObject{{"offset", chunk.offset}};
+        sendNetworkMessage(ack);
+
+        bool last = chunk.last;
+        m_historyChunks.dequeue();
+        m_historyChunkPos = 0;
+
+        if (last) {
+            // 历史同步完成，按顺序处理同步期间缓存的实时消息
+            m_historySyncing = false;
+            m_historyTimer->stop();
+            QList<NetworkMessage> deferred = m_deferredMessages;
+            m_deferredMessages.clear();
+            for (const NetworkMessage &message : deferred) {
+                processMessage(message);
+            }
+            return;
+        }
+    }
+
+    if (m_historyChunks.isEmpty()) {
+        m_historyTimer->stop();
+    }
+}
+
+void WebSocketManager::resetHistorySync()
+{
+    m_historyTimer->stop();
+    m_historyChunks.clear();
+    m_historyChunkPos = 0;
+    m_historySyncing = false;
+    m_deferredMessages.clear();
+}
+
 void WebSocketManager::sendDrawingOperation(const DrawingOperation &operation)
 {
     // qDebug() << "准备发送绘图操作，操作类型:" << operation.opType;
@@ -265,10 +400,31 @@ void WebSocketManager::sendDrawingOperation(const DrawingOperation &operation)
     // qDebug() << "当前连接状态:" << m_webSocket->state();
     // qDebug() << "是否已连接:" << m_webSocket->isValid();
 
+    // 添加点的消息先累积起来，由定时器或者点数上限触发批量发送
+    if (operation.opType == DOT_AddPoint) {
+        if (!m_isConnected) return;
+        // 一批点只属于一个笔画
+        QString strokeId = operation.data["strokeId"].toString();
+        if (!m_pendingPoints.isEmpty() && strokeId != m_pendingStrokeId) {
+            flushPendingPoints();
+        }
+        m_pendingStrokeId = strokeId;
+        m_pendingPoints.append(QJsonObject{
+            {"x", operation.data["x"].toDouble()},
+            {"y", operation.data["y"].toDouble()}
+        });
+        if (m_pendingPoints.size() >= MaxBatchedPoints) {
+            flushPendingPoints();
+        } else if (!m_pointFlushTimer->isActive()) {
+            m_pointFlushTimer->start();
+        }
+        return;
+    }
+
     NetworkMessage message;
     // 当前是绘图操作
     message.type = MT_DrawingOperation;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
     // 转换为指定的格式之后再发送数据（包括当前具体操作类型，比如是画笔，矩形等）
     message.data = operation.toJson();
 
@@ -284,21 +440,49 @@ void WebSocketManager::sendChatMessage(const QString &messageText)
 
     NetworkMessage message;
     message.type = MT_ChatMessage;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
     message.senderId = m_userId;
     message.data = QJsonObject{
         {"message", messageText},
-        {"userName", m_userName},
-        {"timestamp", QDateTime::currentDateTime().toString(Qt::ISODate)}
+        {"userName", m_userName}
     };
 
     sendNetworkMessage(message);
 }
 
+// 把累积的笔画点合并成一条DOT_AddPoint消息发送，data中的points为按顺序排列的点，strokeId为所属笔画
+void WebSocketManager::flushPendingPoints()
+{
+    m_pointFlushTimer->stop();
+    if (m_pendingPoints.isEmpty()) return;
+
+    QJsonArray points = m_pendingPoints;
+    m_pendingPoints = QJsonArray();
+
+    NetworkMessage message;
+    message.type = MT_DrawingOperation;
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
+    message.data = QJsonObject{
+        {"opType", static_cast<int>(DOT_AddPoint)},
+        {"data", QJsonObject{{"points", points}, {"strokeId", m_pendingStrokeId}}}
+    };
+    sendNetworkMessage(message);
+}
+
 void WebSocketManager::sendNetworkMessage(const NetworkMessage &message)
 {
     if (!m_isConnected) {
-        qWarning() << "网络未连接，无法发送消息";
+        LOG_WARNING("net") << "网络未连接，无法发送消息";
+        return;
+    }
+
+    // 先发送之前累积的笔画点，保证消息顺序（例如结束笔画一定在最后一批点之后）
+    if (!m_pendingPoints.isEmpty()) {
+        flushPendingPoints();
+    }
+
+    if (m_wireFormat == WF_Binary) {
+        m_webSocket->sendBinaryMessage(BinaryCodec::encode(message));
         return;
     }
 
@@ -307,11 +491,30 @@ void WebSocketManager::sendNetworkMessage(const NetworkMessage &message)
     m_webSocket->sendTextMessage(data);
 }
 
+void WebSocketManager::sendProtocolHello()
+{
+    QJsonArray formats;
+    if (m_preferredWireFormat == WF_Binary) {
+        formats.append(BinaryCodec::formatName(WF_Binary));
+    }
+    formats.append(BinaryCodec::formatName(WF_Json));
+
+    NetworkMessage message;
+    message.type = MT_ProtocolHello;
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
+    message.data = QJsonObject{
+        {"formats", formats},
+        {"binaryVersion", BinaryCodec::FrameVersion}
+    };
+    sendNetworkMessage(message);
+}
+
 void WebSocketManager::sendHeartbeat()
 {
     NetworkMessage message;
     message.type = MT_Heartbeat;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
+    message.data = QJsonObject{{"clientTime", message.timestamp}};
     sendNetworkMessage(message);
 }
 
@@ -326,7 +529,7 @@ void WebSocketManager::sendClearScene()
 {
     NetworkMessage message;
     message.type = MT_ClearScene;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
     sendNetworkMessage(message);
 }
 
@@ -334,7 +537,7 @@ void WebSocketManager::sendUndoRequest()
 {
     NetworkMessage message;
     message.type = MT_UndoRequest;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
     sendNetworkMessage(message);
 }
 
@@ -342,7 +545,7 @@ void WebSocketManager::sendRedoRequest()
 {
     NetworkMessage message;
     message.type = MT_RedoRequest;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
     sendNetworkMessage(message);
 }
 
@@ -359,7 +562,7 @@ QString WebSocketManager::createRoom(const QString &roomName)
     // 创建房间创建消息
     NetworkMessage message;
     message.type = MessageType::MT_CreateRoom;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
     message.data = QJsonObject{
         {"roomId", roomId},
         {"roomName", roomName},
@@ -384,12 +587,14 @@ void WebSocketManager::leaveRoom()
 
     NetworkMessage message;
     message.type = MT_LeaveRequest;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
     message.data = QJsonObject{
         {"roomId", m_currentRoomId}
     };
 
     sendNetworkMessage(message);
+    // 离开房间后不再接收历史
+    resetHistorySync();
     // 清除房间id，房间名称
     m_currentRoomId.clear();
     m_currentRoomName.clear();
@@ -4,8 +4,10 @@
 #include <QObject>
 #include <QtWebSockets/QtWebSockets>
 #include <QTimer>
-#include <iostream>
+#include <QQueue>
 #include "networkprotocol.h"
+#include "binaryprotocol.h"
+#include "asynclogger.h"
 
 class WebSocketManager : public QObject
 {
@@ -51,6 +53,13 @@ public:
         return this -> m_webSocket;
     }
 
+    // 线协议格式：偏好格式在连接时协商，服务端不支持二进制时自动回退到JSON
+    void setPreferredWireFormat(WireFormat format){ m_preferredWireFormat = format; }
+    WireFormat getWireFormat() const{ return m_wireFormat; }
+
+    // 最近一次心跳的往返延迟（毫秒），还没有测量时为-1
+    qint64 getRoundTripMs() const{ return m_roundTripMs; }
+
 signals:
     void connected();
     void disconnected();
@@ -61,8 +70,9 @@ signals:
 
     void drawingOperationReceived(const DrawingOperation &operation);
     void clearSceneReceived();
-    void undoRequestReceived();
-    void redoRequestReceived();
+    // 带有被撤销/重做的操作id，没有id时按栈顶处理
+    void undoRequestReceived(const DrawingOperation &operation);
+    void redoRequestReceived(const DrawingOperation &operation);
     void chatMessageReceived(const QString &userId, const QString &message);
     void userRoleChanged(const QString &userId, UserRole newRole);
 
@@ -78,18 +88,52 @@ private slots:
     void onConnected();
     void onDisconnected();
     void onTextMessageReceived(const QString &message);
+    void onBinaryMessageReceived(const QByteArray &message);
     void onErrorOccurred(QAbstractSocket::SocketError error);
     void sendHeartbeat();
+    // 发送累积的笔画点
+    void flushPendingPoints();
+    // 分时应用历史分块
+    void applyHistorySlice();
 
 private:
     QWebSocket *m_webSocket;
     QTimer *m_heartbeatTimer;
+    qint64 m_roundTripMs;
     QString m_userId;
     QString m_userName;
     QString m_roomId;
     UserRole m_currentRole;
     bool m_isConnected;
 
+    // 当前使用的和偏好的线协议格式
+    WireFormat m_wireFormat;
+    WireFormat m_preferredWireFormat;
+    void sendProtocolHello();
+
+    // 笔画点批量发送：同一笔画的DOT_AddPoint在一个发送间隔内（或达到点数上限时）合并成一条消息，
+    // 其他任何消息发送之前先发送累积的点，保证消息顺序不变
+    static constexpr int PointFlushInterval = 16;   // 毫秒，约一帧
+    static constexpr int MaxBatchedPoints = 64;
+    QTimer *m_pointFlushTimer;
+    QJsonArray m_pendingPoints;
+    QString m_pendingStrokeId;
+
+    // 加入房间后的历史分块同步：收到的分块进入队列，每次事件循环只处理一个时间片，
+    // 处理完一块再向服务端确认；同步完成之前到达的实时操作先缓存，之后按顺序处理
+    struct HistoryChunk {
+        int offset;
+        QJsonArray ops;
+        bool last;
+    };
+    static constexpr int HistorySliceMs = 8;
+    QTimer *m_historyTimer;
+    QQueue<HistoryChunk> m_historyChunks;
+    int m_historyChunkPos;              // 队首分块中下一个要处理的操作
+    bool m_historySyncing;
+    QList<NetworkMessage> m_deferredMessages;
+    void resetHistorySync();
+
     // 添加房间相关成员变量
     QString m_currentRoomId;
     QString m_currentRoomName;
@@ -0,0 +1,40 @@
+# 服务端压测：模拟客户端和服务端共用协议源码，默认在本进程中启动服务端，不链接 widgets
+QT       = core gui websockets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = MODB_loadgen
+
+SOURCES += \
+    asynclogger.cpp \
+    binaryprotocol.cpp \
+    loadgen_main.cpp \
+    loadgenerator.cpp \
+    networkprotocol.cpp \
+    roomsnapshot.cpp \
+    roomstore.cpp \
+    roomworker.cpp \
+    serverclock.cpp \
+    servermetrics.cpp \
+    snapshotfile.cpp \
+    websocketserver.cpp
+
+HEADERS += \
+    asynclogger.h \
+    binaryprotocol.h \
+    loadgenerator.h \
+    networkprotocol.h \
+    roomhistory.h \
+    roomsnapshot.h \
+    roomstore.h \
+    roomworker.h \
+    serverclock.h \
+    servermetrics.h \
+    snapshotfile.h \
+    websocketserver.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
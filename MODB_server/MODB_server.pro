@@ -9,16 +9,33 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    asynclogger.cpp \
+    binaryprotocol.cpp \
     ledindicator.cpp \
     main.cpp \
     networkprotocol.cpp \
+    roomsnapshot.cpp \
+    roomstore.cpp \
+    roomworker.cpp \
+    serverclock.cpp \
+    servermetrics.cpp \
+    snapshotfile.cpp \
     server.cpp \
     websocketmanager.cpp \
     websocketserver.cpp
 
 HEADERS += \
+    asynclogger.h \
+    binaryprotocol.h \
     ledindicator.h \
     networkprotocol.h \
+    roomhistory.h \
+    roomsnapshot.h \
+    roomstore.h \
+    roomworker.h \
+    serverclock.h \
+    servermetrics.h \
+    snapshotfile.h \
     server.h \
     websocketmanager.h \
     websocketserver.h
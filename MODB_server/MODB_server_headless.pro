@@ -0,0 +1,38 @@
+# 无界面服务端，和 MODB_server.pro 共用服务端源码，不链接 widgets
+QT       = core gui websockets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = MODB_server_headless
+
+SOURCES += \
+    asynclogger.cpp \
+    binaryprotocol.cpp \
+    headless_main.cpp \
+    networkprotocol.cpp \
+    roomsnapshot.cpp \
+    roomstore.cpp \
+    roomworker.cpp \
+    serverclock.cpp \
+    servermetrics.cpp \
+    snapshotfile.cpp \
+    websocketserver.cpp
+
+HEADERS += \
+    asynclogger.h \
+    binaryprotocol.h \
+    networkprotocol.h \
+    roomhistory.h \
+    roomsnapshot.h \
+    roomstore.h \
+    roomworker.h \
+    serverclock.h \
+    servermetrics.h \
+    snapshotfile.h \
+    websocketserver.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
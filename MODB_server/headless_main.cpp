@@ -0,0 +1,175 @@
+﻿#include "websocketserver.h"
+#include "asynclogger.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QTimer>
+#include <csignal>
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// 信号处理函数中只能调用异步信号安全的函数：unix下向自管道写一个字节，
+// 事件循环中的QSocketNotifier读到之后再退出；其他平台只设置标志，由定时器检查
+#ifdef Q_OS_UNIX
+int g_signalPipe[2] = {-1, -1};
+
+void onQuitSignal(int)
+{
+    char byte = 1;
+    ssize_t written = ::write(g_signalPipe[0], &byte, 1);
+    (void)written;
+}
+#else
+volatile std::sig_atomic_t g_quitRequested = 0;
+
+void onQuitSignal(int)
+{
+    g_quitRequested = 1;
+}
+#endif
+
+}
+
+// 无界面服务端：不依赖QtWidgets，通过命令行参数启动，状态输出到日志
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("MODB_server_headless");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("MODB whiteboard server (headless)");
+    parser.addHelpOption();
+    QCommandLineOption ipOption(QStringList() << "i" << "ip", "监听地址，默认监听所有地址", "ip");
+    QCommandLineOption portOption(QStringList() << "p" << "port", "监听端口，默认8080", "port", "8080");
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads", "房间工作线程数量，默认为CPU核心数", "threads");
+    QCommandLineOption dataOption(QStringList() << "d" << "data-dir", "房间数据目录（操作日志和快照），默认为程序目录下的rooms，为空时不持久化", "dir");
+    QCommandLineOption idleOption("room-idle", "没有成员的房间空闲多少分钟后换出到磁盘，0表示不换出", "minutes", "30");
+    QCommandLineOption metricsOption("metrics-port", "指标接口端口（只监听本机地址），0表示不开启", "port", "0");
+    QCommandLineOption logOption("log-level", "日志级别: debug/info/warning/error/off，默认为环境变量MODB_LOG_LEVEL或info", "level");
+    QCommandLineOption statusOption("status-interval", "状态日志输出间隔（秒），0表示不输出", "seconds", "5");
+    parser.addOption(ipOption);
+    parser.addOption(portOption);
+    parser.addOption(threadsOption);
+    parser.addOption(dataOption);
+    parser.addOption(idleOption);
+    parser.addOption(metricsOption);
+    parser.addOption(logOption);
+    parser.addOption(statusOption);
+    parser.process(a);
+
+    LogLevel logLevel = AsyncLogger::levelFromName(qEnvironmentVariable("MODB_LOG_LEVEL"), LL_Info);
+    if (parser.isSet(logOption)) {
+        logLevel = AsyncLogger::levelFromName(parser.value(logOption), logLevel);
+    }
+    AsyncLogger::setLevel(logLevel);
+    AsyncLogger::instance().start();
+
+    bool ok = false;
+    quint16 port = parser.value(portOption).toUShort(&ok);
+    if (!ok || port == 0) {
+        qCritical() << "无效的端口号:" << parser.value(portOption);
+        return 1;
+    }
+
+    WebSocketServer server;
+    if (parser.isSet(threadsOption)) {
+        int threads = parser.value(threadsOption).toInt(&ok);
+        if (!ok || threads <= 0) {
+            qCritical() << "无效的线程数量:" << parser.value(threadsOption);
+            return 1;
+        }
+        server.setWorkerThreadCount(threads);
+    }
+    if (parser.isSet(dataOption)) {
+        server.setDataDirectory(parser.value(dataOption));
+    }
+    int idleMinutes = parser.value(idleOption).toInt(&ok);
+    if (!ok || idleMinutes < 0) {
+        qCritical() << "无效的房间空闲时间:" << parser.value(idleOption);
+        return 1;
+    }
+    server.setRoomIdleMinutes(idleMinutes);
+    quint16 metricsPort = parser.value(metricsOption).toUShort(&ok);
+    if (!ok) {
+        qCritical() << "无效的指标接口端口:" << parser.value(metricsOption);
+        return 1;
+    }
+    server.setMetricsPort(metricsPort);
+
+    QObject::connect(&server, &WebSocketServer::clientConnected, [](const QString &clientId) {
+        qInfo() << "客户端连接:" << clientId;
+    });
+    QObject::connect(&server, &WebSocketServer::clientDisconnected, [](const QString &clientId) {
+        qInfo() << "客户端断开:" << clientId;
+    });
+    QObject::connect(&server, &WebSocketServer::errorOccurred, [](const QString &errorMessage) {
+        qWarning() << "错误:" << errorMessage;
+    });
+
+    if (!server.startServer(parser.value(ipOption), port)) {
+        qCritical() << "服务器启动失败，端口:" << port;
+        return 1;
+    }
+    qInfo() << "服务器启动成功，监听端口:" << port << "工作线程:" << server.getWorkerThreadCount();
+
+    // 定时输出当前连接数和房间数，代替界面上的状态显示
+    QTimer statusTimer;
+    int interval = parser.value(statusOption).toInt();
+    if (interval > 0) {
+        QObject::connect(&statusTimer, &QTimer::timeout, [&server]() {
+            RoomDirectory::Stats stats = server.getRoomStats();
+            qInfo() << "服务器状态: 运行中" << server.getClientCount() << "个客户端连接,"
+                    << server.getRoomList().size() << "个房间,"
+                    << "换出" << stats.evictions << "次, 重新读取" << stats.reloads << "次"
+                    << "(平均" << (stats.reloads ? stats.reloadTotalMs / stats.reloads : 0)
+                    << "ms, 最大" << stats.reloadMaxMs << "ms)";
+        });
+        statusTimer.start(interval * 1000);
+    }
+
+    // Ctrl+C / kill 时退出事件循环，正常关闭所有连接
+#ifdef Q_OS_UNIX
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, g_signalPipe) != 0) {
+        qCritical() << "无法创建信号通知管道";
+        return 1;
+    }
+    QSocketNotifier signalNotifier(g_signalPipe[1], QSocketNotifier::Read);
+    QObject::connect(&signalNotifier, &QSocketNotifier::activated, [&signalNotifier]() {
+        signalNotifier.setEnabled(false);
+        char byte;
+        ssize_t received = ::read(g_signalPipe[1], &byte, 1);
+        (void)received;
+        QCoreApplication::quit();
+    });
+#else
+    QTimer signalTimer;
+    QObject::connect(&signalTimer, &QTimer::timeout, []() {
+        if (g_quitRequested) {
+            QCoreApplication::quit();
+        }
+    });
+    signalTimer.start(200);
+#endif
+    std::signal(SIGINT, onQuitSignal);
+    std::signal(SIGTERM, onQuitSignal);
+    QObject::connect(&a, &QCoreApplication::aboutToQuit, [&server]() {
+        server.stopServer();
+        qInfo() << "服务器已停止";
+    });
+
+    int result = a.exec();
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+#ifdef Q_OS_UNIX
+    ::close(g_signalPipe[0]);
+    ::close(g_signalPipe[1]);
+#endif
+    AsyncLogger::instance().stop();
+    return result;
+}
@@ -0,0 +1,140 @@
+﻿#include "loadgenerator.h"
+#include "websocketserver.h"
+#include "asynclogger.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QUuid>
+#include <csignal>
+
+// 服务端压测：默认在本进程中启动一个只监听本机地址的服务端（不持久化），
+// 模拟客户端通过回环地址连接；指定--url时压测已经运行的服务端
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("MODB_loadgen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("MODB whiteboard server load generator");
+    parser.addHelpOption();
+    QCommandLineOption urlOption("url", "压测已经运行的服务端，例如ws://127.0.0.1:8080，不指定时在本进程中启动服务端", "url");
+    QCommandLineOption portOption(QStringList() << "p" << "port", "本进程服务端的监听端口，默认18080", "port", "18080");
+    QCommandLineOption serverThreadsOption("server-threads", "本进程服务端的工作线程数量，默认为CPU核心数", "threads");
+    QCommandLineOption clientsOption(QStringList() << "c" << "clients", "模拟客户端数量，默认1000", "count", "1000");
+    QCommandLineOption roomsOption(QStringList() << "r" << "rooms", "房间数量，默认50", "count", "50");
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads", "模拟客户端的线程数量，默认2", "threads", "2");
+    QCommandLineOption rateOption("rate", "每个客户端每秒发送的消息数量，默认2", "messages", "2");
+    QCommandLineOption rampOption("ramp", "建立所有连接的时间（秒），默认5", "seconds", "5");
+    QCommandLineOption durationOption(QStringList() << "d" << "duration", "测量时长（秒），默认30", "seconds", "30");
+    QCommandLineOption mixOption("mix", "操作比例: 铅笔,矩形,聊天,撤销，默认60,25,10,5", "weights", "60,25,10,5");
+    QCommandLineOption binaryOption("binary", "使用二进制线协议");
+    QCommandLineOption logOption("log-level", "日志级别: debug/info/warning/error/off，默认为环境变量MODB_LOG_LEVEL或info", "level");
+    parser.addOption(urlOption);
+    parser.addOption(portOption);
+    parser.addOption(serverThreadsOption);
+    parser.addOption(clientsOption);
+    parser.addOption(roomsOption);
+    parser.addOption(threadsOption);
+    parser.addOption(rateOption);
+    parser.addOption(rampOption);
+    parser.addOption(durationOption);
+    parser.addOption(mixOption);
+    parser.addOption(binaryOption);
+    parser.addOption(logOption);
+    parser.process(a);
+
+    LogLevel logLevel = AsyncLogger::levelFromName(qEnvironmentVariable("MODB_LOG_LEVEL"), LL_Info);
+    if (parser.isSet(logOption)) {
+        logLevel = AsyncLogger::levelFromName(parser.value(logOption), logLevel);
+    }
+    AsyncLogger::setLevel(logLevel);
+    AsyncLogger::instance().start();
+
+    LoadConfig config;
+    bool ok = true;
+    auto positiveInt = [&parser, &ok](const QCommandLineOption &option, int minimum) {
+        bool valid = false;
+        int value = parser.value(option).toInt(&valid);
+        if (!valid || value < minimum) {
+            qCritical() << "无效的参数" << option.names().last() << ":" << parser.value(option);
+            ok = false;
+        }
+        return value;
+    };
+    config.clients = positiveInt(clientsOption, 1);
+    config.rooms = positiveInt(roomsOption, 1);
+    config.threads = positiveInt(threadsOption, 1);
+    config.rampSeconds = positiveInt(rampOption, 0);
+    config.durationSeconds = positiveInt(durationOption, 1);
+    config.rate = parser.value(rateOption).toDouble();
+    if (config.rate <= 0) {
+        qCritical() << "无效的发送速率:" << parser.value(rateOption);
+        ok = false;
+    }
+    const QStringList mix = parser.value(mixOption).split(',');
+    if (mix.size() == 4) {
+        config.mixPencil = qMax(0, mix[0].toInt());
+        config.mixShape = qMax(0, mix[1].toInt());
+        config.mixChat = qMax(0, mix[2].toInt());
+        config.mixUndo = qMax(0, mix[3].toInt());
+    }
+    if (mix.size() != 4 || config.mixPencil + config.mixShape + config.mixChat + config.mixUndo == 0) {
+        qCritical() << "无效的操作比例:" << parser.value(mixOption);
+        ok = false;
+    }
+    config.format = parser.isSet(binaryOption) ? WF_Binary : WF_Json;
+    config.roomPrefix = "bench-" + QUuid::createUuid().toString(QUuid::WithoutBraces).left(6) + "-";
+
+    // 本进程中的服务端，只监听回环地址，不写入房间数据
+    WebSocketServer server;
+    if (ok && parser.isSet(urlOption)) {
+        config.url = QUrl(parser.value(urlOption));
+        if (!config.url.isValid()) {
+            qCritical() << "无效的服务端地址:" << parser.value(urlOption);
+            ok = false;
+        }
+    } else if (ok) {
+        quint16 port = parser.value(portOption).toUShort(&ok);
+        if (!ok || port == 0) {
+            qCritical() << "无效的端口号:" << parser.value(portOption);
+            ok = false;
+        }
+        if (ok && parser.isSet(serverThreadsOption)) {
+            server.setWorkerThreadCount(positiveInt(serverThreadsOption, 1));
+        }
+        server.setDataDirectory(QString());
+        if (ok && !server.startServer("127.0.0.1", port)) {
+            qCritical() << "服务器启动失败，端口:" << port;
+            ok = false;
+        }
+        config.url = QUrl(QString("ws://127.0.0.1:%1").arg(port));
+    }
+    if (!ok) {
+        AsyncLogger::instance().stop();
+        return 1;
+    }
+
+    int result = 0;
+    {
+        LoadGenerator generator(config);
+        QObject::connect(&generator, &LoadGenerator::finished, &a, [](bool success) {
+            QCoreApplication::exit(success ? 0 : 1);
+        });
+
+        // Ctrl+C 时提前结束，不输出结果
+        auto quitHandler = [](int) { QCoreApplication::exit(1); };
+        std::signal(SIGINT, quitHandler);
+        std::signal(SIGTERM, quitHandler);
+
+        generator.start();
+        result = a.exec();
+    }
+
+    if (server.isRunning()) {
+        // 服务端自己统计的解析、处理和广播耗时
+        qInfo().noquote() << server.metricsText();
+        server.stopServer();
+    }
+    AsyncLogger::instance().stop();
+    return result;
+}
@@ -0,0 +1,524 @@
+﻿#include "loadgenerator.h"
+#include "serverclock.h"
+#include "asynclogger.h"
+
+#include <QJsonDocument>
+#include <QPainterPath>
+#include <QDateTime>
+#include <QUuid>
+
+LoadShard::LoadShard(int index, const LoadConfig &config, int firstClient, int clientCount)
+    : m_index(index)
+    , m_config(config)
+    , m_firstClient(firstClient)
+    , m_nextConnect(0)
+    , m_startUs(0)
+    , m_intervalUs(qMax<qint64>(1000, static_cast<qint64>(1000000.0 / qMax(0.001, config.rate))))
+    , m_measuring(false)
+    , m_timer(nullptr)
+    , m_random(static_cast<quint32>(index + 1))
+{
+    for (int i = 0; i < clientCount; ++i) {
+        SimClient *client = new SimClient;
+        client->index = firstClient + i;
+        client->roomId = config.roomPrefix + QString::number(client->index % qMax(1, config.rooms));
+        m_clients.append(client);
+    }
+}
+
+LoadShard::~LoadShard()
+{
+    // socket是本对象的子对象，随本对象一起释放
+    qDeleteAll(m_clients);
+}
+
+qint64 LoadShard::nowUs()
+{
+    return ServerClock::readMonotonicUs();
+}
+
+void LoadShard::start()
+{
+    m_timer = new QTimer(this);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    m_timer->setInterval(TickMs);
+    connect(m_timer, &QTimer::timeout, this, &LoadShard::onTick);
+    m_startUs = nowUs();
+    m_timer->start();
+}
+
+void LoadShard::setMeasuring(bool measuring)
+{
+    m_measuring = measuring;
+}
+
+void LoadShard::stop()
+{
+    if (m_timer) {
+        m_timer->stop();
+    }
+    for (SimClient *client : std::as_const(m_clients)) {
+        if (!client->socket) continue;
+        client->socket->disconnect(this);
+        client->socket->abort();
+        delete client->socket;
+        client->socket = nullptr;
+        client->joined = false;
+    }
+    connected.storeRelaxed(0);
+    joined.storeRelaxed(0);
+}
+
+// 每个刻度：按连接爬坡进度建立新连接，已经加入房间的客户端到时间就发送下一条消息
+void LoadShard::onTick()
+{
+    qint64 now = nowUs();
+
+    int total = m_clients.size();
+    qint64 rampUs = qint64(m_config.rampSeconds) * 1000000;
+    int due = total;
+    if (rampUs > 0) {
+        due = static_cast<int>(qMin<qint64>(total, (now - m_startUs) * total / rampUs + 1));
+    }
+    while (m_nextConnect < due) {
+        connectClient(m_clients[m_nextConnect++]);
+    }
+
+    for (SimClient *client : std::as_const(m_clients)) {
+        if (!client->joined || now < client->nextSendUs) continue;
+        sendNext(client, now);
+        client->nextSendUs += m_intervalUs;
+        // 发送跟不上时不补发，实际速率体现在输出的发送数量中
+        if (client->nextSendUs < now) {
+            client->nextSendUs = now + m_intervalUs;
+        }
+    }
+}
+
+void LoadShard::connectClient(SimClient *client)
+{
+    QWebSocket *socket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+    client->socket = socket;
+    client->format = WF_Json;
+
+    connect(socket, &QWebSocket::connected, this, [this, client]() {
+        onConnected(client);
+    });
+    connect(socket, &QWebSocket::disconnected, this, [this, client]() {
+        if (client->joined) {
+            client->joined = false;
+            joined.fetchAndSubRelaxed(1);
+        }
+        connected.fetchAndSubRelaxed(1);
+    });
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::errorOccurred),
+            this, [this, client](QAbstractSocket::SocketError) {
+        errors.fetchAndAddRelaxed(1);
+        LOG_DEBUG("loadgen") << "客户端" << client->index << "连接错误:" << client->socket->errorString();
+    });
+    connect(socket, &QWebSocket::textMessageReceived, this, [this, client](const QString &text) {
+        QJsonDocument doc = QJsonDocument::fromJson(text.toUtf8());
+        if (!doc.isObject()) return;
+        onMessage(client, NetworkMessage::fromJson(doc.object()));
+    });
+    connect(socket, &QWebSocket::binaryMessageReceived, this, [this, client](const QByteArray &frame) {
+        NetworkMessage message;
+        if (BinaryCodec::decode(frame, message)) {
+            onMessage(client, message);
+        }
+    });
+
+    socket->open(m_config.url);
+}
+
+void LoadShard::onConnected(SimClient *client)
+{
+    connected.fetchAndAddRelaxed(1);
+    if (m_config.format != WF_Binary) {
+        sendJoin(client);
+        return;
+    }
+
+    // 先协商二进制格式，收到回复之后再加入房间
+    NetworkMessage hello;
+    hello.type = MT_ProtocolHello;
+    hello.timestamp = QDateTime::currentMSecsSinceEpoch();
+    hello.data = QJsonObject{
+        {"formats", QJsonArray{BinaryCodec::formatName(WF_Binary), BinaryCodec::formatName(WF_Json)}},
+        {"binaryVersion", BinaryCodec::FrameVersion}
+    };
+    sendMessage(client, hello);
+}
+
+void LoadShard::sendJoin(SimClient *client)
+{
+    NetworkMessage message;
+    message.type = MT_JoinRequest;
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
+    message.data = QJsonObject{
+        {"roomId", client->roomId},
+        {"roomName", client->roomId},
+        {"userName", QString("bench_%1").arg(client->index)},
+        {"newRoom", true},          // 房间不存在时创建
+        {"historyChunks", true}
+    };
+    sendMessage(client, message);
+}
+
+void LoadShard::onMessage(SimClient *client, const NetworkMessage &message)
+{
+    received.fetchAndAddRelaxed(1);
+    qint64 now = nowUs();
+
+    switch (message.type) {
+        case MT_ProtocolHello:
+            client->format = BinaryCodec::formatFromName(message.data["format"].toString());
+            sendJoin(client);
+            break;
+        case MT_JoinResponse:
+            if (!message.data["success"].toBool()) {
+                errors.fetchAndAddRelaxed(1);
+                LOG_WARNING("loadgen") << "加入房间失败:" << client->roomId << message.data["error"].toString();
+                break;
+            }
+            if (!client->joined) {
+                client->joined = true;
+                joined.fetchAndAddRelaxed(1);
+                // 第一次发送的时间随机错开，避免所有客户端同时发送
+                client->nextSendUs = now + static_cast<qint64>(m_random.bounded(static_cast<quint64>(m_intervalUs)));
+            }
+            break;
+        case MT_HistoryChunk: {
+            // 收到就确认，压测客户端不绘制历史
+            NetworkMessage ack;
+            ack.type = MT_HistoryAck;
+            ack.timestamp = QDateTime::currentMSecsSinceEpoch();
+            ack.data = QJsonObject{{"offset", message.data["offset"]}};
+            sendMessage(client, ack);
+            break;
+        }
+        case MT_RoomError:
+            errors.fetchAndAddRelaxed(1);
+            break;
+        case MT_DrawingOperation:
+        case MT_UndoRequest:
+            if (m_measuring && message.data.contains("benchSentUs")) {
+                fanoutUs.record(now - message.data["benchSentUs"].toInteger());
+            }
+            break;
+        case MT_ChatMessage: {
+            // 服务端重新构造聊天消息，发送时间放在消息文本中
+            QString text = message.data["message"].toString();
+            if (m_measuring && text.startsWith("bench:")) {
+                fanoutUs.record(now - text.mid(6).toLongLong());
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void LoadShard::sendMessage(SimClient *client, const NetworkMessage &message)
+{
+    if (client->format == WF_Binary) {
+        client->socket->sendBinaryMessage(BinaryCodec::encode(message));
+    } else {
+        client->socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message.toJson()).toJson(QJsonDocument::Compact)));
+    }
+    sent.fetchAndAddRelaxed(1);
+}
+
+void LoadShard::sendNext(SimClient *client, qint64 now)
+{
+    if (client->strokeStep >= 0) {
+        sendStrokeStep(client, now);
+        return;
+    }
+
+    int total = m_config.mixPencil + m_config.mixShape + m_config.mixChat + m_config.mixUndo;
+    int pick = static_cast<int>(m_random.bounded(qMax(1, total)));
+    if ((pick -= m_config.mixPencil) < 0) {
+        client->strokeStep = 0;
+        sendStrokeStep(client, now);
+    } else if ((pick -= m_config.mixShape) < 0) {
+        sendRectangle(client, now);
+    } else if ((pick -= m_config.mixChat) < 0) {
+        sendChat(client, now);
+    } else {
+        sendUndo(client, now);
+    }
+}
+
+// 和客户端一样的笔画消息序列：开始笔画、按批发送的添加点、带完整路径的结束笔画
+void LoadShard::sendStrokeStep(SimClient *client, qint64 now)
+{
+    if (client->strokeStep == 0) {
+        client->strokeId = QUuid::createUuid().toString(QUuid::WithoutBraces).left(8);
+        client->pen = randomPoint();
+        client->strokePoints = QJsonArray{QJsonObject{{"x", client->pen.x()}, {"y", client->pen.y()}}};
+        sendMessage(client, drawingMessage(DOT_BeginStroke, QJsonObject{
+            {"startX", client->pen.x()},
+            {"startY", client->pen.y()},
+            {"penColor", "#1e90ff"},
+            {"penWidth", 3},
+            {"strokeId", client->strokeId}
+        }, now));
+        client->strokeStep = 1;
+    } else if (client->strokeStep <= StrokeBatches) {
+        QJsonArray points;
+        for (int i = 0; i < PointsPerBatch; ++i) {
+            client->pen += QPointF(m_random.bounded(12.0) - 6.0, m_random.bounded(12.0) - 6.0);
+            QJsonObject point{{"x", client->pen.x()}, {"y", client->pen.y()}};
+            points.append(point);
+            client->strokePoints.append(point);
+        }
+        sendMessage(client, drawingMessage(DOT_AddPoint, QJsonObject{
+            {"points", points},
+            {"strokeId", client->strokeId}
+        }, now));
+        ++client->strokeStep;
+    } else {
+        QPainterPath path;
+        for (int i = 0; i < client->strokePoints.size(); ++i) {
+            QJsonObject point = client->strokePoints.at(i).toObject();
+            QPointF pos(point["x"].toDouble(), point["y"].toDouble());
+            if (i == 0) {
+                path.moveTo(pos);
+            } else {
+                path.lineTo(pos);
+            }
+        }
+        sendMessage(client, drawingMessage(DOT_EndStroke, QJsonObject{
+            {"path", DrawingOperation::encodePath(path)},
+            {"penColor", "#1e90ff"},
+            {"penWidth", 3},
+            {"strokeId", client->strokeId}
+        }, now, rememberOperation(client)));
+        client->strokeStep = -1;
+        client->strokePoints = QJsonArray();
+    }
+}
+
+void LoadShard::sendRectangle(SimClient *client, qint64 now)
+{
+    QPointF topLeft = randomPoint();
+    sendMessage(client, drawingMessage(DOT_DrawRectangle, QJsonObject{
+        {"x", topLeft.x()},
+        {"y", topLeft.y()},
+        {"width", 10.0 + m_random.bounded(190.0)},
+        {"height", 10.0 + m_random.bounded(190.0)},
+        {"penColor", "#ff4500"},
+        {"penWidth", 2},
+        {"isFilled", false}
+    }, now, rememberOperation(client)));
+}
+
+void LoadShard::sendChat(SimClient *client, qint64 now)
+{
+    NetworkMessage message;
+    message.type = MT_ChatMessage;
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
+    message.data = QJsonObject{
+        {"message", QString("bench:%1").arg(now)},
+        {"userName", QString("bench_%1").arg(client->index)}
+    };
+    sendMessage(client, message);
+}
+
+// 和客户端一样按id撤销自己最近的操作；还没有可撤销的操作时改为绘制矩形
+void LoadShard::sendUndo(SimClient *client, qint64 now)
+{
+    if (client->ownOperations.isEmpty()) {
+        sendRectangle(client, now);
+        return;
+    }
+
+    NetworkMessage message;
+    message.type = MT_UndoRequest;
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
+    message.data = QJsonObject{
+        {"operationId", client->ownOperations.takeLast()},
+        {"data", QJsonObject{{"operationType", "last"}}},
+        {"benchSentUs", now}
+    };
+    sendMessage(client, message);
+}
+
+QString LoadShard::rememberOperation(SimClient *client)
+{
+    QString operationId = DrawingOperation::generateId();
+    client->ownOperations.append(operationId);
+    if (client->ownOperations.size() > MaxOwnOperations) {
+        client->ownOperations.removeFirst();
+    }
+    return operationId;
+}
+
+// 发送时间放在消息data的顶层，服务端原样转发，不会写入绘图历史
+NetworkMessage LoadShard::drawingMessage(DrawingOperationType opType, const QJsonObject &opData, qint64 now,
+                                         const QString &operationId) const
+{
+    NetworkMessage message;
+    message.type = MT_DrawingOperation;
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
+    message.data = QJsonObject{
+        {"opType", static_cast<int>(opType)},
+        {"data", opData},
+        {"benchSentUs", now}
+    };
+    if (!operationId.isEmpty()) {
+        message.data["operationId"] = operationId;
+    }
+    return message;
+}
+
+QPointF LoadShard::randomPoint()
+{
+    return QPointF(m_random.bounded(1600.0), m_random.bounded(900.0));
+}
+
+LoadGenerator::LoadGenerator(const LoadConfig &config, QObject *parent)
+    : QObject(parent)
+    , m_config(config)
+    , m_reportTimer(new QTimer(this))
+    , m_startUs(0)
+    , m_measureStartUs(0)
+    , m_measureStartSent(0)
+    , m_measureStartReceived(0)
+    , m_lastSent(0)
+    , m_lastReceived(0)
+    , m_lastReportUs(0)
+{
+    m_reportTimer->setInterval(1000);
+    connect(m_reportTimer, &QTimer::timeout, this, &LoadGenerator::report);
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    stopShards();
+}
+
+// 客户端平均分配到各个线程，每个线程一个事件循环
+void LoadGenerator::start()
+{
+    int threads = qBound(1, m_config.threads, qMax(1, m_config.clients));
+    int first = 0;
+    for (int i = 0; i < threads; ++i) {
+        int count = m_config.clients / threads + (i < m_config.clients % threads ? 1 : 0);
+        QThread *thread = new QThread;
+        thread->setObjectName(QString("LoadShard-%1").arg(i));
+        LoadShard *shard = new LoadShard(i, m_config, first, count);
+        shard->moveToThread(thread);
+        connect(thread, &QThread::started, shard, &LoadShard::start);
+        connect(thread, &QThread::finished, shard, &QObject::deleteLater);
+        m_threads.append(thread);
+        m_shards.append(shard);
+        first += count;
+    }
+
+    qInfo().noquote() << QString("压测开始: %1 个客户端, %2 个房间, %3 个线程, 每个客户端 %4 条/秒, %5 格式, 目标 %6")
+                         .arg(m_config.clients).arg(m_config.rooms).arg(threads).arg(m_config.rate)
+                         .arg(BinaryCodec::formatName(m_config.format), m_config.url.toString());
+
+    m_startUs = LoadShard::nowUs();
+    m_lastReportUs = m_startUs;
+    for (QThread *thread : std::as_const(m_threads)) {
+        thread->start();
+    }
+    m_reportTimer->start();
+}
+
+LoadGenerator::Totals LoadGenerator::totals() const
+{
+    Totals totals;
+    for (LoadShard *shard : m_shards) {
+        totals.sent += shard->sent.loadRelaxed();
+        totals.received += shard->received.loadRelaxed();
+        totals.errors += shard->errors.loadRelaxed();
+        totals.connected += shard->connected.loadRelaxed();
+        totals.joined += shard->joined.loadRelaxed();
+        totals.fanout.merge(shard->fanoutUs.snapshot());
+    }
+    return totals;
+}
+
+// 每秒输出一次吞吐；全部加入房间之后开始测量，测量时长到达后输出结果
+void LoadGenerator::report()
+{
+    Totals t = totals();
+    qint64 now = LoadShard::nowUs();
+    double seconds = qMax<qint64>(1, now - m_lastReportUs) / 1e6;
+
+    qInfo().noquote() << QString("[%1] 连接 %2/%3, 已加入 %4, 发送 %5/s, 接收 %6/s, 扇出延迟 p50 %7us p99 %8us, 错误 %9")
+                         .arg(m_measureStartUs ? "测量" : "连接")
+                         .arg(t.connected).arg(m_config.clients).arg(t.joined)
+                         .arg(qRound64((t.sent - m_lastSent) / seconds))
+                         .arg(qRound64((t.received - m_lastReceived) / seconds))
+                         .arg(t.fanout.valueAt(0.5)).arg(t.fanout.valueAt(0.99))
+                         .arg(t.errors);
+    m_lastSent = t.sent;
+    m_lastReceived = t.received;
+    m_lastReportUs = now;
+
+    if (!m_measureStartUs) {
+        // 爬坡结束后最多再等30秒，仍有客户端没有加入时按已经加入的客户端开始测量
+        qint64 joinDeadlineUs = m_startUs + qint64(m_config.rampSeconds + 30) * 1000000;
+        if (t.joined >= m_config.clients || now >= joinDeadlineUs) {
+            if (t.joined < m_config.clients) {
+                LOG_WARNING("loadgen") << "只有" << t.joined << "个客户端加入房间，开始测量";
+            }
+            beginMeasure(t, now);
+        }
+    } else if (now - m_measureStartUs >= qint64(m_config.durationSeconds) * 1000000) {
+        finish(t, now);
+    }
+}
+
+void LoadGenerator::beginMeasure(const Totals &totals, qint64 now)
+{
+    m_measureStartUs = now;
+    m_measureStartSent = totals.sent;
+    m_measureStartReceived = totals.received;
+    for (LoadShard *shard : std::as_const(m_shards)) {
+        QMetaObject::invokeMethod(shard, [shard]() { shard->setMeasuring(true); }, Qt::QueuedConnection);
+    }
+}
+
+void LoadGenerator::finish(const Totals &totals, qint64 now)
+{
+    m_reportTimer->stop();
+    stopShards();
+
+    double seconds = qMax<qint64>(1, now - m_measureStartUs) / 1e6;
+    const LatencyHistogram::Snapshot &fanout = totals.fanout;
+    qInfo().noquote() << QString("压测结果: 测量 %1 秒, 发送 %2 条 (%3 条/秒), 接收 %4 条 (%5 条/秒), 错误 %6")
+                         .arg(seconds, 0, 'f', 1)
+                         .arg(totals.sent - m_measureStartSent)
+                         .arg(qRound64((totals.sent - m_measureStartSent) / seconds))
+                         .arg(totals.received - m_measureStartReceived)
+                         .arg(qRound64((totals.received - m_measureStartReceived) / seconds))
+                         .arg(totals.errors);
+    qInfo().noquote() << QString("扇出延迟(us): 样本 %1, 平均 %2, p50 %3, p90 %4, p99 %5, p99.9 %6, 最大 %7")
+                         .arg(fanout.count)
+                         .arg(fanout.count ? fanout.sum / fanout.count : 0)
+                         .arg(fanout.valueAt(0.5)).arg(fanout.valueAt(0.9))
+                         .arg(fanout.valueAt(0.99)).arg(fanout.valueAt(0.999))
+                         .arg(fanout.max);
+
+    emit finished(fanout.count > 0);
+}
+
+void LoadGenerator::stopShards()
+{
+    for (LoadShard *shard : std::as_const(m_shards)) {
+        QMetaObject::invokeMethod(shard, &LoadShard::stop, Qt::BlockingQueuedConnection);
+    }
+    for (QThread *thread : std::as_const(m_threads)) {
+        thread->quit();
+        thread->wait();
+    }
+    qDeleteAll(m_threads);
+    m_threads.clear();
+    m_shards.clear();
+}
@@ -0,0 +1,160 @@
+﻿#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QVector>
+#include <QThread>
+#include <QTimer>
+#include <QUrl>
+#include <QPointF>
+#include <QAtomicInteger>
+#include <QRandomGenerator>
+#include <QtWebSockets/QWebSocket>
+
+#include "networkprotocol.h"
+#include "binaryprotocol.h"
+#include "servermetrics.h"
+
+// 压测配置
+struct LoadConfig {
+    QUrl url;                   // 服务端地址
+    int clients = 1000;         // 模拟客户端数量
+    int rooms = 50;             // 房间数量，客户端按下标轮流分配到各个房间
+    int threads = 1;            // 模拟客户端的线程数量
+    int rampSeconds = 5;        // 所有客户端在这段时间内依次建立连接
+    int durationSeconds = 30;   // 全部加入房间之后的测量时长
+    double rate = 2.0;          // 每个客户端每秒发送的消息数量
+    WireFormat format = WF_Json;
+    QString roomPrefix;         // 房间号前缀，每次压测不同，避免读到上次留下的历史
+
+    // 操作比例（权重）：铅笔笔画 / 矩形 / 聊天 / 撤销
+    int mixPencil = 60;
+    int mixShape = 25;
+    int mixChat = 10;
+    int mixUndo = 5;
+};
+
+// 一个线程中的一组模拟客户端：按配置的速率发送混合的绘图/聊天/撤销消息，
+// 收到其他客户端的消息时根据消息中携带的发送时间记录扇出延迟。
+// 计数和直方图只由所属线程写入，主线程汇总时直接读取
+class LoadShard : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadShard(int index, const LoadConfig &config, int firstClient, int clientCount);
+    ~LoadShard();
+
+    // 同一进程内所有线程共用的单调时钟（微秒），发送时间和接收时间直接相减
+    static qint64 nowUs();
+
+    LatencyHistogram fanoutUs;          // 发送到房间内其他客户端收到的延迟（微秒）
+    QAtomicInteger<quint64> sent;       // 发送的消息数量
+    QAtomicInteger<quint64> received;   // 收到的消息数量
+    QAtomicInteger<int> connected;      // 已经连接的客户端数量
+    QAtomicInteger<int> joined;         // 已经加入房间的客户端数量
+    QAtomicInteger<quint64> errors;     // 连接错误和服务端返回的错误
+
+public slots:
+    void start();
+    // 开始/停止记录延迟，连接阶段的消息不计入
+    void setMeasuring(bool measuring);
+    void stop();
+
+private:
+    // 铅笔笔画按多条消息发送：开始笔画、若干批添加点、结束笔画
+    static constexpr int StrokeBatches = 4;
+    static constexpr int PointsPerBatch = 8;
+    static constexpr int TickMs = 5;
+    // 每个客户端记住最近绘制的操作id，撤销时按id撤销自己的操作
+    static constexpr int MaxOwnOperations = 64;
+
+    struct SimClient {
+        QWebSocket *socket = nullptr;
+        int index = 0;
+        QString roomId;
+        WireFormat format = WF_Json;
+        bool joined = false;
+        qint64 nextSendUs = 0;      // 下一次发送的时间
+        int strokeStep = -1;        // 正在发送的笔画进度，-1表示没有未结束的笔画
+        QString strokeId;
+        QPointF pen;                // 当前笔的位置
+        QJsonArray strokePoints;    // 当前笔画的所有点，结束笔画时编码成路径
+        QStringList ownOperations;  // 自己绘制、还没有撤销的操作id（最近的在最后）
+    };
+
+    int m_index;
+    LoadConfig m_config;
+    int m_firstClient;
+    QVector<SimClient*> m_clients;
+    int m_nextConnect;
+    qint64 m_startUs;
+    qint64 m_intervalUs;
+    bool m_measuring;
+    QTimer *m_timer;
+    QRandomGenerator m_random;
+
+    void onTick();
+    void connectClient(SimClient *client);
+    void onConnected(SimClient *client);
+    void onMessage(SimClient *client, const NetworkMessage &message);
+    void sendMessage(SimClient *client, const NetworkMessage &message);
+    void sendJoin(SimClient *client);
+
+    // 按操作比例选择下一条消息
+    void sendNext(SimClient *client, qint64 now);
+    void sendStrokeStep(SimClient *client, qint64 now);
+    void sendRectangle(SimClient *client, qint64 now);
+    void sendChat(SimClient *client, qint64 now);
+    void sendUndo(SimClient *client, qint64 now);
+    NetworkMessage drawingMessage(DrawingOperationType opType, const QJsonObject &opData, qint64 now,
+                                  const QString &operationId = QString()) const;
+    // 为客户端新绘制的图形分配id并记录，用于之后的撤销
+    QString rememberOperation(SimClient *client);
+    QPointF randomPoint();
+};
+
+// 压测入口：创建各个线程的模拟客户端，定时输出吞吐，结束时输出扇出延迟分位数
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LoadGenerator(const LoadConfig &config, QObject *parent = nullptr);
+    ~LoadGenerator();
+
+    void start();
+
+signals:
+    void finished(bool ok);
+
+private:
+    LoadConfig m_config;
+    QVector<QThread*> m_threads;
+    QVector<LoadShard*> m_shards;
+    QTimer *m_reportTimer;
+    qint64 m_startUs;
+    qint64 m_measureStartUs;        // 0表示还在连接阶段
+    quint64 m_measureStartSent;
+    quint64 m_measureStartReceived;
+    quint64 m_lastSent;
+    quint64 m_lastReceived;
+    qint64 m_lastReportUs;
+
+    struct Totals {
+        quint64 sent = 0;
+        quint64 received = 0;
+        quint64 errors = 0;
+        int connected = 0;
+        int joined = 0;
+        LatencyHistogram::Snapshot fanout;
+    };
+    Totals totals() const;
+
+    void report();
+    void beginMeasure(const Totals &totals, qint64 now);
+    void finish(const Totals &totals, qint64 now);
+    void stopShards();
+};
+
+#endif // LOADGENERATOR_H
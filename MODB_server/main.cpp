@@ -1,11 +1,22 @@
 ﻿#include "server.h"
 
+#include "asynclogger.h"
+
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
-    Server w;
-    w.show();
-    return a.exec();
+    // 日志级别由环境变量MODB_LOG_LEVEL指定（debug/info/warning/error/off），默认info
+    AsyncLogger::setLevel(AsyncLogger::levelFromName(qEnvironmentVariable("MODB_LOG_LEVEL"), LL_Info));
+    AsyncLogger::instance().start();
+
+    int result;
+    {
+        Server w;
+        w.show();
+        result = a.exec();
+    }
+    AsyncLogger::instance().stop();
+    return result;
 }
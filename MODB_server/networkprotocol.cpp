@@ -1,5 +1,7 @@
 ﻿#include "networkprotocol.h"
 #include <QDateTime>
+#include <QUuid>
+#include <atomic>
 
 QJsonObject NetworkMessage::toJson() const
 {
@@ -17,7 +19,7 @@ NetworkMessage NetworkMessage::fromJson(const QJsonObject &json)
     msg.type = static_cast<MessageType>(json["type"].toInt());
     msg.data = json["data"].toObject();
     msg.senderId = json["senderId"].toString();
-    msg.timestamp = json["timestamp"].toInt();
+    msg.timestamp = json["timestamp"].toInteger();
     return msg;
 }
 
@@ -32,21 +34,16 @@ QJsonObject DrawingOperation::toJson() const
         // 处理特殊类型
         if (it.value().canConvert<QPainterPath>()) {
             QPainterPath path = it.value().value<QPainterPath>();
-            // 将路径转换为可序列化的格式
-            QJsonArray pathArray;
-            for (int i = 0; i < path.elementCount(); ++i) {
-                QJsonObject point;
-                point["x"] = path.elementAt(i).x;
-                point["y"] = path.elementAt(i).y;
-                point["type"] = path.elementAt(i).type;
-                pathArray.append(point);
-            }
-            dataJson[it.key()] = pathArray;
+            // 将路径转换为紧凑的编码格式
+            dataJson[it.key()] = encodePath(path);
         } else {
             dataJson[it.key()] = QJsonValue::fromVariant(it.value());
         }
     }
     json["data"] = dataJson;
+    if (!operationId.isEmpty()) {
+        json["operationId"] = operationId;
+    }
 
     return json;
 }
@@ -58,8 +55,164 @@ DrawingOperation DrawingOperation::fromJson(const QJsonObject &json)
 
     QJsonObject dataJson = json["data"].toObject();
     for (auto it = dataJson.begin(); it != dataJson.end(); ++it) {
+        // 服务端不需要绘制路径，编码后的路径原样保存和转发，需要时用decodePath解析
         op.data[it.key()] = it.value().toVariant();
     }
 
+    op.operationId = json["operationId"].toString();
+
     return op;
 }
+
+QString DrawingOperation::generateId()
+{
+    // 128位（122位随机）的进程前缀，房间长期保存时也不会和其他进程的前缀碰撞
+    static const QString prefix = QString::fromLatin1(QUuid::createUuid().toRfc4122().toBase64(
+        QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals)) + ".";
+    static std::atomic<quint64> counter{0};
+    return prefix + QString::number(++counter, 36);
+}
+
+namespace {
+
+void writeVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+// zigzag编码，让小的负数也只占一个字节
+void writeSignedVarint(QByteArray &out, qint64 value)
+{
+    writeVarint(out, (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63));
+}
+
+bool readVarint(const uchar *&pos, const uchar *end, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= end) return false;
+        uchar byte = *pos++;
+        value |= static_cast<quint64>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool readSignedVarint(const uchar *&pos, const uchar *end, qint64 &value)
+{
+    quint64 raw;
+    if (!readVarint(pos, end, raw)) return false;
+    value = static_cast<qint64>(raw >> 1) ^ -static_cast<qint64>(raw & 1);
+    return true;
+}
+
+}
+
+// 每个元素编码为：类型(varint) + x差分(zigzag varint) + y差分(zigzag varint)
+QJsonValue DrawingOperation::encodePath(const QPainterPath &path)
+{
+    QByteArray blob;
+    blob.reserve(path.elementCount() * 3);
+    qint64 lastX = 0;
+    qint64 lastY = 0;
+    for (int i = 0; i < path.elementCount(); ++i) {
+        const QPainterPath::Element &element = path.elementAt(i);
+        qint64 x = qRound64(element.x * PathCoordScale);
+        qint64 y = qRound64(element.y * PathCoordScale);
+        writeVarint(blob, static_cast<quint64>(element.type));
+        writeSignedVarint(blob, x - lastX);
+        writeSignedVarint(blob, y - lastY);
+        lastX = x;
+        lastY = y;
+    }
+
+    return QJsonObject{
+        {"enc", "qdelta"},
+        {"v", PathEncodingVersion},
+        {"n", path.elementCount()},
+        {"data", QString::fromLatin1(blob.toBase64())}
+    };
+}
+
+bool DrawingOperation::decodePath(const QJsonValue &value, QPainterPath &path)
+{
+    path = QPainterPath();
+
+    // 旧版本：路径展开为 {x, y, type} 对象数组
+    if (value.isArray()) {
+        QJsonArray pathArray = value.toArray();
+        for (const QJsonValue &pointValue : pathArray) {
+            QJsonObject pointObj = pointValue.toObject();
+            qreal x = pointObj["x"].toDouble();
+            qreal y = pointObj["y"].toDouble();
+            int type = pointObj["type"].toInt();
+
+            if (type == QPainterPath::MoveToElement) {
+                path.moveTo(x, y);
+            } else if (type == QPainterPath::LineToElement) {
+                path.lineTo(x, y);
+            } else if (type == QPainterPath::CurveToElement) {
+                // 处理曲线点（需要三个点）
+                // 这里简化处理，实际需要更复杂的逻辑
+                path.lineTo(x, y);
+            }
+        }
+        return true;
+    }
+
+    QJsonObject encoded = value.toObject();
+    if (encoded["enc"].toString() != "qdelta" || encoded["v"].toInt() > PathEncodingVersion) {
+        return false;
+    }
+
+    QByteArray blob = QByteArray::fromBase64(encoded["data"].toString().toLatin1());
+    const uchar *pos = reinterpret_cast<const uchar *>(blob.constData());
+    const uchar *end = pos + blob.size();
+    int count = encoded["n"].toInt();
+
+    qint64 x = 0;
+    qint64 y = 0;
+    QPointF curve[3];
+    int curveCount = 0;
+    for (int i = 0; i < count; ++i) {
+        quint64 type;
+        qint64 dx, dy;
+        if (!readVarint(pos, end, type) || !readSignedVarint(pos, end, dx) || !readSignedVarint(pos, end, dy)) {
+            path = QPainterPath();
+            return false;
+        }
+        x += dx;
+        y += dy;
+        QPointF point(static_cast<qreal>(x) / PathCoordScale, static_cast<qreal>(y) / PathCoordScale);
+
+        switch (type) {
+            case QPainterPath::MoveToElement:
+                path.moveTo(point);
+                break;
+            case QPainterPath::LineToElement:
+                path.lineTo(point);
+                break;
+            case QPainterPath::CurveToElement:
+                // 曲线由一个CurveTo和两个CurveToData元素组成
+                curve[0] = point;
+                curveCount = 1;
+                break;
+            case QPainterPath::CurveToDataElement:
+                if (curveCount > 0 && curveCount < 3) {
+                    curve[curveCount++] = point;
+                    if (curveCount == 3) {
+                        path.cubicTo(curve[0], curve[1], curve[2]);
+                        curveCount = 0;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
@@ -23,7 +23,10 @@ enum MessageType {
     MT_Heartbeat,           // 心跳检测
     MT_LeaveRequest,        // 离开请求
     MT_RoomList,            // 房间列表请求
-    MT_RoomError            // 房间错误
+    MT_RoomError,           // 房间错误
+    MT_ProtocolHello,       // 线协议协商（JSON/二进制）
+    MT_HistoryChunk,        // 加入房间后分块同步的绘图历史
+    MT_HistoryAck           // 历史分块确认（流量控制）
 };
 
 // 确保枚举值正确
@@ -56,11 +59,13 @@ struct NetworkMessage
     // 添加构造函数
     NetworkMessage() : type(MT_Unknown), timestamp(0) {}
     NetworkMessage(MessageType t, const QJsonObject &d = QJsonObject())
-        : type(t), data(d), timestamp(QDateTime::currentSecsSinceEpoch()) {}
+        : type(t), data(d), timestamp(QDateTime::currentMSecsSinceEpoch()) {}
 
     QJsonObject toJson() const;
     static NetworkMessage fromJson(const QJsonObject &json);
 };
+// 工作线程之间通过排队连接传递消息
+Q_DECLARE_METATYPE(NetworkMessage)
 
 // 绘图操作数据结构
 struct DrawingOperation
@@ -68,9 +73,22 @@ struct DrawingOperation
     DrawingOperationType opType;
     QVariantMap data;
     QString operationId;
+    QString senderId;       // 发送者id，接收时由NetworkMessage填充，不参与序列化
 
     QJsonObject toJson() const;
     static DrawingOperation fromJson(const QJsonObject &json);
+
+    // 生成图形/操作id：进程的UUID前缀（base64url，22个字符）加自增计数（base36），全局唯一，
+    // 创建图形的操作id同时也是图形id，擦除、撤销、重做都通过id直接定位
+    static QString generateId();
+
+    // 路径编码：坐标量化到1/PathCoordScale像素，相邻点差分后用varint打包成base64字符串，
+    // 编码结果为 {"enc": "qdelta", "v": 版本, "n": 元素数量, "data": base64}
+    static constexpr int PathEncodingVersion = 1;
+    static constexpr int PathCoordScale = 100;
+    static QJsonValue encodePath(const QPainterPath &path);
+    // 同时支持编码后的路径和旧版本的 [{x, y, type}, ...] 数组
+    static bool decodePath(const QJsonValue &value, QPainterPath &path);
 };
 
 
@@ -0,0 +1,25 @@
+﻿#ifndef ROOMHISTORY_H
+#define ROOMHISTORY_H
+
+#include <QList>
+#include <QJsonObject>
+#include <QString>
+
+// 房间撤销栈的查找，工作线程处理重做和重放操作日志时共用，保证两者恢复的是同一个操作
+
+// 要重做的操作在撤销栈中的下标：operationId为空时为栈顶，找不到时为-1
+inline int undoStackSlot(const QList<QJsonObject> &undoStack, const QString &operationId)
+{
+    if (operationId.isEmpty()) {
+        return undoStack.size() - 1;
+    }
+    // 通常就是栈顶，从后往前找
+    for (int i = undoStack.size() - 1; i >= 0; --i) {
+        if (undoStack[i]["operationId"].toString() == operationId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#endif // ROOMHISTORY_H
@@ -0,0 +1,201 @@
+﻿#include "roomsnapshot.h"
+#include <QPainterPathStroker>
+#include <QLineF>
+#include <QHash>
+
+QJsonArray RoomSnapshot::fold(const QJsonArray &snapshot, const QJsonArray &tail,
+                              const QSet<QString> &held, const QSet<QString> &released)
+{
+    // 这次要应用的擦除：尾部中没有保留的擦除，以及快照中这次释放的擦除
+    auto applies = [&held, &released](const QJsonObject &op, bool inTail) {
+        QString id = op["operationId"].toString();
+        return inTail ? !held.contains(id) : released.contains(id);
+    };
+
+    QList<Item> items;
+    items.reserve(snapshot.size() + tail.size());
+    // 图形id -> items中的下标，按id擦除时直接定位
+    QHash<QString, int> itemIndex;
+
+    auto apply = [&items, &itemIndex, &applies](const QJsonValue &value, bool inTail) {
+        // 按id移除的操作留下的空位
+        if (value.isNull()) return;
+        Item item;
+        item.op = value.toObject();
+        if (item.op["opType"].toInt() != DOT_Erase || !applies(item.op, inTail)) {
+            // 图形操作、已经应用过或者仍然保留的擦除操作都原样保留，
+            // 解析不了的操作同样保留，只是不会被擦中
+            if (item.op["opType"].toInt() != DOT_Erase) {
+                QString id = item.op["operationId"].toString();
+                if (!id.isEmpty()) {
+                    itemIndex.insert(id, items.size());
+                }
+            }
+            items.append(item);
+            return;
+        }
+
+        // 擦除：去掉被擦中的图形，擦除操作本身不再保留
+        QJsonObject data = item.op["data"].toObject();
+        if (data.contains("itemIds")) {
+            // 带有图形id的擦除和客户端擦除的图形完全一致，不需要几何判断
+            const QJsonArray ids = data["itemIds"].toArray();
+            for (const QJsonValue &id : ids) {
+                int index = itemIndex.value(id.toString(), -1);
+                if (index >= 0) {
+                    items[index].erased = true;
+                }
+            }
+            return;
+        }
+        qreal size = data["eraserSize"].toDouble();
+        QRectF eraserArea(data["positionX"].toDouble() - size / 2,
+                          data["positionY"].toDouble() - size / 2,
+                          size, size);
+        bool keepErase = false;
+        for (int i = items.size() - 1; i >= 0; --i) {
+            Item &target = items[i];
+            if (target.erased) continue;
+            if (!target.measured) measure(target);
+            if (!target.bounds.intersects(eraserArea)) continue;
+            if (target.isText) {
+                // 文本的实际大小取决于客户端字体，无法在服务端判断，保留擦除操作由客户端处理
+                keepErase = true;
+            } else if (hitByEraser(target, eraserArea)) {
+                target.erased = true;
+            }
+        }
+        if (keepErase) {
+            items.append(item);
+        }
+    };
+
+    for (const QJsonValue &value : snapshot) {
+        apply(value, false);
+    }
+    for (const QJsonValue &value : tail) {
+        apply(value, true);
+    }
+
+    QJsonArray result;
+    for (const Item &item : std::as_const(items)) {
+        if (!item.erased) {
+            result.append(item.op);
+        }
+    }
+    return result;
+}
+
+void RoomSnapshot::measure(Item &item)
+{
+    // 只计算边界，笔画的描边形状留到边界碰到橡皮擦时再构造
+    QJsonObject data = item.op["data"].toObject();
+    qreal margin = qMax(1.0, data["penWidth"].toDouble()) / 2 + 1;
+    item.measured = true;
+
+    switch (item.op["opType"].toInt()) {
+        case DOT_EndStroke:
+            // 路径解析不了时边界为空，笔画原样保留
+            if (DrawingOperation::decodePath(data["path"], item.path)) {
+                item.bounds = item.path.controlPointRect().adjusted(-margin, -margin, margin, margin);
+            }
+            break;
+        case DOT_DrawLine:
+            item.bounds = QRectF(QPointF(data["x1"].toDouble(), data["y1"].toDouble()),
+                                 QPointF(data["x2"].toDouble(), data["y2"].toDouble()))
+                              .normalized().adjusted(-margin, -margin, margin, margin);
+            break;
+        case DOT_DrawRectangle:
+        case DOT_DrawEllipse:
+            item.bounds = QRectF(data["x"].toDouble(), data["y"].toDouble(),
+                                 data["width"].toDouble(), data["height"].toDouble())
+                              .normalized().adjusted(-margin, -margin, margin, margin);
+            break;
+        case DOT_AddText: {
+            // 按字号粗略估计文本范围，只用于判断擦除是否可能碰到文本
+            qreal fontSize = qMax(1.0, data["fontSize"].toDouble());
+            int length = qMax(1, static_cast<int>(data["content"].toString().size()));
+            item.bounds = QRectF(data["x"].toDouble(), data["y"].toDouble(),
+                                 length * fontSize * 2 + 8, fontSize * 2 + 8);
+            item.isText = true;
+            break;
+        }
+        default:
+            // 其他操作原样保留，不参与擦除判断
+            break;
+    }
+}
+
+void RoomSnapshot::buildShape(Item &item)
+{
+    QJsonObject data = item.op["data"].toObject();
+    qreal penWidth = qMax(1.0, data["penWidth"].toDouble());
+    item.shaped = true;
+
+    switch (item.op["opType"].toInt()) {
+        case DOT_EndStroke:
+            item.shape = strokeShape(item.path, penWidth);
+            break;
+        case DOT_DrawLine: {
+            QPainterPath path;
+            path.moveTo(data["x1"].toDouble(), data["y1"].toDouble());
+            path.lineTo(data["x2"].toDouble(), data["y2"].toDouble());
+            item.shape = strokeShape(path, penWidth);
+            break;
+        }
+        case DOT_DrawRectangle:
+        case DOT_DrawEllipse: {
+            QRectF rect(data["x"].toDouble(), data["y"].toDouble(),
+                        data["width"].toDouble(), data["height"].toDouble());
+            QPainterPath path;
+            if (item.op["opType"].toInt() == DOT_DrawRectangle) {
+                path.addRect(rect);
+            } else {
+                path.addEllipse(rect);
+            }
+            // 矩形和椭圆的shape包含内部区域，未填充时擦中内部也会被擦除
+            item.shape = strokeShape(path, penWidth);
+            item.shape.addPath(path);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+QPainterPath RoomSnapshot::strokeShape(const QPainterPath &path, qreal penWidth)
+{
+    QPainterPathStroker stroker;
+    stroker.setWidth(penWidth);
+    stroker.setCapStyle(Qt::RoundCap);
+    stroker.setJoinStyle(Qt::RoundJoin);
+    QPainterPath shape = stroker.createStroke(path);
+    shape.addPath(path);
+    return shape;
+}
+
+bool RoomSnapshot::hitByEraser(Item &item, const QRectF &eraserArea)
+{
+    if (!item.shaped) buildShape(item);
+    if (item.shape.isEmpty() || !item.shape.intersects(eraserArea)) {
+        return false;
+    }
+    if (item.op["opType"].toInt() != DOT_EndStroke) {
+        return true;
+    }
+
+    // 路径项再检查路径本身和各个线段
+    const QPainterPath &path = item.path;
+    if (path.intersects(eraserArea)) {
+        return true;
+    }
+    for (int i = 1; i < path.elementCount(); ++i) {
+        QPointF p1(path.elementAt(i - 1).x, path.elementAt(i - 1).y);
+        QPointF p2(path.elementAt(i).x, path.elementAt(i).y);
+        if (eraserArea.contains(p1) || eraserArea.contains(p2) ||
+            eraserArea.intersects(QRectF(p1, p2).normalized())) {
+            return true;
+        }
+    }
+    return false;
+}
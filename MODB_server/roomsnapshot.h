@@ -0,0 +1,43 @@
+﻿#ifndef ROOMSNAPSHOT_H
+#define ROOMSNAPSHOT_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QPainterPath>
+#include <QRectF>
+#include <QSet>
+#include "networkprotocol.h"
+
+// 房间快照：把绘图历史折叠成当前画面上仍然存在的图形，
+// 快照本身仍然是绘图操作列表，客户端按普通历史回放即可
+class RoomSnapshot
+{
+public:
+    // 在已有快照的基础上依次应用tail中的操作，返回新的快照。
+    // held中的擦除操作还可能被作者按id撤销，擦除操作和被擦除的图形都原样保留；
+    // 快照中的擦除操作之前已经应用过，只有released中（上一次保留、现在不再保留）的才在这次应用
+    static QJsonArray fold(const QJsonArray &snapshot, const QJsonArray &tail,
+                           const QSet<QString> &held = QSet<QString>(),
+                           const QSet<QString> &released = QSet<QString>());
+
+private:
+    // 图形的边界和形状只在按位置擦除时才计算，并且只为边界碰到橡皮擦的图形构造形状
+    struct Item {
+        QJsonObject op;
+        QRectF bounds;          // 粗略边界，用于快速排除；无法判断的操作为空，不会被擦中
+        QPainterPath shape;     // 和客户端图形项shape()一致的形状（文本为空）
+        QPainterPath path;      // 铅笔笔画的路径
+        bool isText = false;
+        bool measured = false;  // 已经计算过边界
+        bool shaped = false;    // 已经构造过形状
+        bool erased = false;    // 已经被擦除，折叠结束时丢弃
+    };
+
+    static void measure(Item &item);
+    static void buildShape(Item &item);
+    // 和客户端performNetworkErase的判断保持一致
+    static bool hitByEraser(Item &item, const QRectF &eraserArea);
+    static QPainterPath strokeShape(const QPainterPath &path, qreal penWidth);
+};
+
+#endif // ROOMSNAPSHOT_H
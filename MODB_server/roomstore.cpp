@@ -0,0 +1,392 @@
+﻿#include "roomstore.h"
+#include "asynclogger.h"
+#include "roomhistory.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QSet>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+RoomStore::RoomStore()
+    : m_writer(nullptr)
+    , m_running(false)
+    , m_writing(false)
+{
+}
+
+RoomStore::~RoomStore()
+{
+    close();
+}
+
+bool RoomStore::open(const QString &directory)
+{
+    QDir dir(directory);
+    if (!dir.mkpath(".")) {
+        LOG_WARNING("store") << "无法创建房间数据目录:" << directory;
+        return false;
+    }
+    m_directory = dir.absolutePath();
+    return true;
+}
+
+void RoomStore::start()
+{
+    if (!isOpen() || m_writer) return;
+
+    m_running = true;
+    m_writer = QThread::create([this]() { writerLoop(); });
+    m_writer->setObjectName("RoomStoreWriter");
+    m_writer->start();
+}
+
+void RoomStore::close()
+{
+    if (!m_writer) return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running = false;
+        m_wakeup.wakeAll();
+    }
+    m_writer->wait();
+    delete m_writer;
+    m_writer = nullptr;
+
+    qDeleteAll(m_logFiles);
+    m_logFiles.clear();
+}
+
+void RoomStore::appendOperation(const QString &roomId, const QJsonObject &operation)
+{
+    enqueue(Record{RK_Operation, roomId, operation, QString(), RoomState()});
+}
+
+void RoomStore::clearRoom(const QString &roomId)
+{
+    enqueue(Record{RK_Clear, roomId, QJsonObject(), QString(), RoomState()});
+}
+
+void RoomStore::undoLast(const QString &roomId)
+{
+    enqueue(Record{RK_Undo, roomId, QJsonObject(), QString(), RoomState()});
+}
+
+void RoomStore::redoLast(const QString &roomId, const QString &operationId)
+{
+    enqueue(Record{RK_Redo, roomId, QJsonObject(), operationId, RoomState()});
+}
+
+void RoomStore::removeOperation(const QString &roomId, const QString &operationId)
+{
+    enqueue(Record{RK_Remove, roomId, QJsonObject(), operationId, RoomState()});
+}
+
+void RoomStore::setRoomName(const QString &roomId, const QString &roomName)
+{
+    enqueue(Record{RK_Name, roomId, QJsonObject(), roomName, RoomState()});
+}
+
+void RoomStore::writeSnapshot(const RoomState &state)
+{
+    enqueue(Record{RK_Snapshot, state.roomId, QJsonObject(), QString(), state});
+}
+
+void RoomStore::enqueue(Record &&record)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_running) return;
+
+    // 队列从空变为非空时唤醒写线程，开始一个新的批次
+    bool wasEmpty = m_pending.isEmpty();
+    m_pending.append(std::move(record));
+    if (wasEmpty) {
+        m_wakeup.wakeAll();
+    }
+}
+
+void RoomStore::writerLoop()
+{
+    forever {
+        QList<Record> batch;
+        bool stopping;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_running && m_pending.isEmpty()) {
+                m_wakeup.wait(&m_mutex);
+            }
+            // 等待批次窗口，让更多记录合并到同一次fsync中（close()会提前唤醒）
+            if (m_running) {
+                m_wakeup.wait(&m_mutex, FlushIntervalMs);
+            }
+            batch.swap(m_pending);
+            stopping = !m_running;
+            m_writing = true;
+        }
+
+        writeBatch(batch);
+
+        {
+            QMutexLocker locker(&m_mutex);
+            m_writing = false;
+            m_idle.wakeAll();
+        }
+
+        if (stopping) break;
+    }
+}
+
+// 读取房间之前调用，保证之前放入队列的记录已经写入文件
+void RoomStore::waitForWrites()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_writing || (m_running && !m_pending.isEmpty())) {
+        // 提前结束批次窗口
+        m_wakeup.wakeAll();
+        m_idle.wait(&m_mutex);
+    }
+}
+
+void RoomStore::writeBatch(const QList<Record> &batch)
+{
+    QSet<QFile*> dirty;
+    for (const Record &record : batch) {
+        if (record.kind == RK_Snapshot) {
+            QFile *file = m_logFiles.value(record.roomId);
+            if (file) file->flush();
+            if (writeSnapshotFile(record)) {
+                // 快照写入成功之后，之前的操作日志不再需要。同时关闭日志文件，
+                // 换出的房间不再占用文件描述符，之后有新记录时再重新打开
+                if (file) {
+                    dirty.remove(file);
+                    m_logFiles.remove(record.roomId);
+                    delete file;
+                }
+                QFile::resize(fileBase(record.roomId) + ".wal", 0);
+            }
+            continue;
+        }
+
+        QFile *file = logFile(record.roomId);
+        if (!file) continue;
+
+        QJsonObject line;
+        switch (record.kind) {
+            case RK_Snapshot:
+                // 已经在上面处理
+                continue;
+            case RK_Operation:
+                line = QJsonObject{{"k", "op"}, {"op", record.operation}};
+                break;
+            case RK_Clear:
+                line = QJsonObject{{"k", "clear"}};
+                break;
+            case RK_Undo:
+                line = QJsonObject{{"k", "undo"}};
+                break;
+            case RK_Redo:
+                line = QJsonObject{{"k", "redo"}};
+                if (!record.text.isEmpty()) {
+                    line["id"] = record.text;
+                }
+                break;
+            case RK_Remove:
+                line = QJsonObject{{"k", "remove"}, {"id", record.text}};
+                break;
+            case RK_Name:
+                line = QJsonObject{{"k", "name"}, {"name", record.text}};
+                break;
+        }
+
+        // 每条记录一行紧凑JSON
+        file->write(QJsonDocument(line).toJson(QJsonDocument::Compact));
+        file->write("\n", 1);
+        dirty.insert(file);
+    }
+
+    // 每个文件每批次只同步一次
+    for (QFile *file : std::as_const(dirty)) {
+        file->flush();
+        syncFile(file);
+    }
+}
+
+QFile *RoomStore::logFile(const QString &roomId)
+{
+    QFile *file = m_logFiles.value(roomId);
+    if (file) return file;
+
+    file = new QFile(fileBase(roomId) + ".wal");
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Append)) {
+        LOG_WARNING("store") << "无法打开操作日志:" << file->fileName() << file->errorString();
+        delete file;
+        return nullptr;
+    }
+    m_logFiles.insert(roomId, file);
+    return file;
+}
+
+bool RoomStore::writeSnapshotFile(const Record &record)
+{
+    // QSaveFile先写临时文件，commit时同步到磁盘再替换，不会留下写了一半的快照
+    QSaveFile file(fileBase(record.roomId) + ".snap");
+    if (!file.open(QIODevice::WriteOnly)) {
+        LOG_WARNING("store") << "无法写入快照:" << file.fileName() << file.errorString();
+        return false;
+    }
+    file.write(SnapshotFile::encode(record.state));
+    return file.commit();
+}
+
+bool RoomStore::syncFile(QFile *file)
+{
+#ifdef Q_OS_WIN
+    return _commit(file->handle()) == 0;
+#else
+    return ::fsync(file->handle()) == 0;
+#endif
+}
+
+// 房间号可能包含任意字符，文件名使用UTF-8的十六进制
+QString RoomStore::fileBase(const QString &roomId) const
+{
+    return m_directory + "/" + QString::fromLatin1(roomId.toUtf8().toHex());
+}
+
+QList<StoredRoom> RoomStore::scanRooms() const
+{
+    QList<StoredRoom> rooms;
+    if (!isOpen()) return rooms;
+
+    QDir dir(m_directory);
+    QSet<QString> bases;
+    const QStringList files = dir.entryList(QStringList() << "*.wal" << "*.snap", QDir::Files);
+    for (const QString &name : files) {
+        bases.insert(QFileInfo(name).completeBaseName());
+    }
+
+    for (const QString &base : std::as_const(bases)) {
+        StoredRoom room;
+        room.roomId = QString::fromUtf8(QByteArray::fromHex(base.toLatin1()));
+
+        // 房间名称来自快照文件头；没有快照时来自操作日志的第一条记录（创建房间时写入）
+        QString snapId;
+        if (!SnapshotFile::readHeader(dir.filePath(base + ".snap"), snapId, room.roomName)) {
+            RoomState state;
+            if (readJsonSnapshot(dir.filePath(base + ".snap"), state)) {
+                room.roomName = state.roomName;
+            }
+        }
+        if (room.roomName.isEmpty()) {
+            QFile walFile(dir.filePath(base + ".wal"));
+            if (walFile.open(QIODevice::ReadOnly)) {
+                QJsonObject record = QJsonDocument::fromJson(walFile.readLine()).object();
+                if (record["k"].toString() == "name") {
+                    room.roomName = record["name"].toString();
+                }
+            }
+        }
+        if (room.roomName.isEmpty()) {
+            room.roomName = "Default Room";
+        }
+        rooms.append(room);
+    }
+    return rooms;
+}
+
+bool RoomStore::loadRoom(const QString &roomId, RoomState &state)
+{
+    if (!isOpen()) return false;
+    waitForWrites();
+
+    const QString base = fileBase(roomId);
+    state = RoomState();
+    if (!SnapshotFile::read(base + ".snap", state) && QFile::exists(base + ".snap")) {
+        if (!readJsonSnapshot(base + ".snap", state)) {
+            LOG_WARNING("store") << "快照文件损坏:" << base + ".snap";
+        }
+    }
+    state.roomId = roomId;
+
+    QFile walFile(base + ".wal");
+    if (walFile.open(QIODevice::ReadOnly)) {
+        while (!walFile.atEnd()) {
+            QByteArray line = walFile.readLine();
+            QJsonDocument doc = QJsonDocument::fromJson(line);
+            // 崩溃时最后一行可能只写了一半，之后的内容丢弃
+            if (!doc.isObject()) break;
+            replayRecord(doc.object(), state);
+        }
+    }
+
+    if (state.roomName.isEmpty()) {
+        state.roomName = "Default Room";
+    }
+    return true;
+}
+
+bool RoomStore::readJsonSnapshot(const QString &fileName, RoomState &state)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    if (SnapshotFile::isSnapshotFile(file.peek(16))) return false;
+
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root["version"].toInt() != JsonSnapshotVersion) return false;
+    state.roomName = root["roomName"].toString();
+    state.snapshot = root["snapshot"].toArray();
+    return true;
+}
+
+void RoomStore::replayRecord(const QJsonObject &record, RoomState &state)
+{
+    QString kind = record["k"].toString();
+    if (kind == "op") {
+        state.history.append(record["op"]);
+    } else if (kind == "clear") {
+        state.snapshot = QJsonArray();
+        state.history = QJsonArray();
+        state.undoStack.clear();
+        state.redoStack.clear();
+    } else if (kind == "undo") {
+        // 和工作线程中的撤销一致：先撤销尾部，尾部为空时撤销快照
+        if (!state.history.isEmpty()) {
+            state.undoStack.append(state.history.last().toObject());
+            state.history.removeLast();
+        } else if (!state.snapshot.isEmpty()) {
+            state.undoStack.append(state.snapshot.last().toObject());
+            state.snapshot.removeLast();
+        }
+    } else if (kind == "redo") {
+        // 和工作线程一致：带id时重做撤销栈中指定的操作，否则重做栈顶
+        int slot = undoStackSlot(state.undoStack, record["id"].toString());
+        if (slot >= 0) {
+            state.history.append(state.undoStack.takeAt(slot));
+        }
+    } else if (kind == "remove") {
+        // 和工作线程一致：先在尾部查找，已经折叠进快照的操作在快照中移除
+        QString operationId = record["id"].toString();
+        auto removeById = [&state, &operationId](QJsonArray &operations) {
+            for (int i = operations.size() - 1; i >= 0; --i) {
+                QJsonObject operation = operations[i].toObject();
+                if (operation["operationId"].toString() == operationId) {
+                    state.undoStack.append(operation);
+                    operations.removeAt(i);
+                    return true;
+                }
+            }
+            return false;
+        };
+        if (!removeById(state.history)) {
+            removeById(state.snapshot);
+        }
+    } else if (kind == "name") {
+        state.roomName = record["name"].toString();
+    }
+}
@@ -0,0 +1,104 @@
+﻿#ifndef ROOMSTORE_H
+#define ROOMSTORE_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include "snapshotfile.h"
+
+// 启动时扫描到的房间，只包含房间目录需要的信息，内容在房间第一次被加入时才读取
+struct StoredRoom {
+    QString roomId;
+    QString roomName;
+};
+
+// 房间持久化：每个房间一个只追加的操作日志（<房间>.wal）和一个二进制快照文件（<房间>.snap）。
+// 工作线程只把记录放进队列，由单独的写线程按批次写入，每批次每个文件只fsync一次，
+// 持久化不增加消息处理的延迟。写入快照之后截断操作日志
+class RoomStore
+{
+public:
+    RoomStore();
+    ~RoomStore();
+
+    // 打开数据目录（不存在则创建），在start()之前调用
+    bool open(const QString &directory);
+    bool isOpen() const { return !m_directory.isEmpty(); }
+    // 扫描数据目录中的房间，只读取快照文件头
+    QList<StoredRoom> scanRooms() const;
+    // 读取房间的快照并重放操作日志，先等待队列中的记录写入磁盘
+    bool loadRoom(const QString &roomId, RoomState &state);
+
+    // 启动写线程
+    void start();
+    // 写完队列中剩余的记录并停止写线程
+    void close();
+
+    // 以下方法线程安全，只把记录放入队列
+    void appendOperation(const QString &roomId, const QJsonObject &operation);
+    void clearRoom(const QString &roomId);
+    void undoLast(const QString &roomId);
+    // operationId为空时重做撤销栈顶的操作，否则重做撤销栈中指定的操作
+    void redoLast(const QString &roomId, const QString &operationId = QString());
+    void removeOperation(const QString &roomId, const QString &operationId);
+    void setRoomName(const QString &roomId, const QString &roomName);
+    // state.history为空，快照写入之后截断操作日志
+    void writeSnapshot(const RoomState &state);
+
+private:
+    enum RecordKind {
+        RK_Operation,
+        RK_Clear,
+        RK_Undo,
+        RK_Redo,
+        RK_Remove,
+        RK_Name,
+        RK_Snapshot
+    };
+
+    struct Record {
+        RecordKind kind;
+        QString roomId;
+        QJsonObject operation;
+        QString text;           // 房间名称或者操作ID
+        RoomState state;        // 快照，隐式共享，序列化在写线程中进行
+    };
+
+    // 批次窗口：第一条记录到达后再等待一段时间，合并同一批次的记录
+    static constexpr int FlushIntervalMs = 50;
+    // 旧版本的JSON快照，读取时兼容
+    static constexpr int JsonSnapshotVersion = 1;
+
+    QString m_directory;
+    QThread *m_writer;
+
+    QMutex m_mutex;
+    QWaitCondition m_wakeup;
+    QList<Record> m_pending;
+    bool m_running;
+    bool m_writing;             // 写线程正在写入一个批次
+    QWaitCondition m_idle;      // 批次写完时通知等待的读取方
+
+    // 写线程使用
+    QHash<QString, QFile*> m_logFiles;
+
+    void enqueue(Record &&record);
+    void waitForWrites();
+    void writerLoop();
+    void writeBatch(const QList<Record> &batch);
+    QFile *logFile(const QString &roomId);
+    bool writeSnapshotFile(const Record &record);
+    static bool syncFile(QFile *file);
+
+    QString fileBase(const QString &roomId) const;
+    static bool readJsonSnapshot(const QString &fileName, RoomState &state);
+    static void replayRecord(const QJsonObject &record, RoomState &state);
+};
+
+#endif // ROOMSTORE_H
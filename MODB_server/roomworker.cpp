@@ -0,0 +1,1316 @@
+﻿#include "roomworker.h"
+#include <QThread>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+void RoomDirectory::updateRoom(const QString &roomId, const QString &roomName, int clientCount)
+{
+    QMutexLocker locker(&m_mutex);
+    Entry &entry = m_rooms[roomId];
+    entry.roomName = roomName;
+    entry.clientCount = clientCount;
+}
+
+void RoomDirectory::removeRoom(const QString &roomId)
+{
+    QMutexLocker locker(&m_mutex);
+    m_rooms.remove(roomId);
+}
+
+void RoomDirectory::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_rooms.clear();
+}
+
+QHash<QString, RoomDirectory::Entry> RoomDirectory::snapshot() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_rooms;
+}
+
+void RoomDirectory::recordEviction()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_stats.evictions;
+}
+
+void RoomDirectory::recordReload(qint64 elapsedMs)
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_stats.reloads;
+    m_stats.reloadTotalMs += elapsedMs;
+    m_stats.reloadMaxMs = qMax(m_stats.reloadMaxMs, elapsedMs);
+}
+
+RoomDirectory::Stats RoomDirectory::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+RoomWorker::RoomWorker(int index, RoomDirectory *directory, RoomStore *store)
+    : QObject(nullptr)
+    , m_index(index)
+    , m_directory(directory)
+    , m_store(store)
+    , m_roomIdleTimeout(0)
+    , m_evictTimer(nullptr)
+    , m_wheel(WheelSlots)
+    , m_wheelTick(ServerClock::tick() / LivenessTickMs)
+    , m_livenessTimer(nullptr)
+    , m_stopping(false)
+{
+}
+
+RoomWorker::~RoomWorker()
+{
+    shutdown();
+}
+
+void RoomWorker::setPeers(const QVector<RoomWorker*> &peers)
+{
+    m_peers = peers;
+}
+
+void RoomWorker::setRoomIdleTimeout(qint64 timeoutMs)
+{
+    m_roomIdleTimeout = qMax<qint64>(0, timeoutMs);
+}
+
+void RoomWorker::start()
+{
+    m_wheelTick = ServerClock::tick() / LivenessTickMs;
+    m_livenessTimer = new QTimer(this);
+    connect(m_livenessTimer, &QTimer::timeout, this, &RoomWorker::reapInactiveSessions);
+    m_livenessTimer->start(LivenessTickMs);
+
+    // 没有持久化时换出的房间无法恢复
+    if (m_store && m_roomIdleTimeout > 0) {
+        m_evictTimer = new QTimer(this);
+        connect(m_evictTimer, &QTimer::timeout, this, &RoomWorker::evictIdleRooms);
+        m_evictTimer->start(qMin<qint64>(m_roomIdleTimeout, 60000));
+    }
+}
+
+void RoomWorker::restoreRoom(const StoredRoom &stored)
+{
+    // 只登记房间，内容在第一次有客户端加入时才从磁盘读取
+    RoomInfo *room = new RoomInfo;
+    room->roomId = stored.roomId;
+    room->roomName = stored.roomName;
+    room->loaded = false;
+    m_rooms.insert(room->roomId, room);
+    publishRoom(room);
+}
+
+void RoomWorker::ensureLoaded(RoomInfo *room)
+{
+    if (room->loaded) return;
+    room->loaded = true;
+    if (!m_store) return;
+
+    QElapsedTimer timer;
+    timer.start();
+    RoomState state;
+    if (!m_store->loadRoom(room->roomId, state)) {
+        LOG_WARNING("room") << "无法读取房间:" << room->roomId;
+        return;
+    }
+    room->roomName = state.roomName;
+    room->snapshot = state.snapshot;
+    room->drawingHistory = state.history;
+    rebuildHistoryIndex(room);
+    room->undoStack = state.undoStack;
+    room->redoStack = state.redoStack;
+    // 快照中的擦除可能是换出之前保留下来的，下一次折叠时重新应用
+    for (const QJsonValue &operation : std::as_const(room->snapshot)) {
+        QJsonObject op = operation.toObject();
+        if (op["opType"].toInt() == DOT_Erase) {
+            room->heldErases.insert(op["operationId"].toString());
+        }
+    }
+    m_directory->recordReload(timer.elapsed());
+    LOG_INFO("room") << "读取房间" << room->roomId << "操作数:" << room->snapshot.size() + room->drawingHistory.size()
+             << "耗时(ms):" << timer.elapsed();
+}
+
+void RoomWorker::evictIdleRooms()
+{
+    qint64 now = ServerClock::tick();
+    for (RoomInfo *room : std::as_const(m_rooms)) {
+        if (room->loaded && room->members.isEmpty() && room->openStrokes.isEmpty() &&
+            now - room->emptySince >= m_roomIdleTimeout) {
+            evictRoom(room);
+        }
+    }
+}
+
+void RoomWorker::evictRoom(RoomInfo *room)
+{
+    // 尾部折叠进快照并写入磁盘，操作日志随之截断
+    checkpointRoom(room);
+
+    room->snapshot = QJsonArray();
+    room->drawingHistory = QJsonArray();
+    rebuildHistoryIndex(room);
+    room->heldErases.clear();
+    room->undoStack.clear();
+    room->redoStack.clear();
+    room->undoStack.squeeze();
+    room->redoStack.squeeze();
+    room->loaded = false;
+    m_directory->recordEviction();
+    LOG_INFO("room") << "换出空闲房间:" << room->roomId;
+}
+
+int RoomWorker::shardOf(const QString &roomId, int shardCount)
+{
+    // 固定种子，保证同一个房间号总是落在同一个工作线程
+    return static_cast<int>(qHash(roomId, 0) % static_cast<size_t>(shardCount));
+}
+
+void RoomWorker::transferSession(ClientSession *session, QObject *previousOwner,
+                                 RoomWorker *target, const NetworkMessage &pending)
+{
+    QWebSocket *socket = session->socket;
+    if (previousOwner) {
+        socket->disconnect(previousOwner);
+    }
+    // 先绑定新线程的处理函数并投递接管事件，再移动socket，
+    // 这样移动之后到达的消息一定排在接管事件之后处理
+    target->bindSession(session);
+    QMetaObject::invokeMethod(target, [target, session, pending]() {
+        target->adoptSession(session, pending);
+    }, Qt::QueuedConnection);
+    socket->setParent(nullptr);
+    socket->moveToThread(target->thread());
+}
+
+void RoomWorker::bindSession(ClientSession *session)
+{
+    // 每个连接的信号直接绑定到自己的会话上，处理消息时不再需要查找
+    connect(session->socket, &QWebSocket::textMessageReceived, this, [this, session](const QString &message) {
+        onTextMessageReceived(session, message);
+    });
+    connect(session->socket, &QWebSocket::binaryMessageReceived, this, [this, session](const QByteArray &message) {
+        onBinaryMessageReceived(session, message);
+    });
+    connect(session->socket, &QWebSocket::disconnected, this, [this, session]() {
+        onClientDisconnected(session);
+    });
+}
+
+void RoomWorker::adoptSession(ClientSession *session, const NetworkMessage &pending)
+{
+    ServerClock::tick();
+    m_sessions.insert(session->userId, session);
+    scheduleSession(session);
+
+    // 转交过程中连接已经断开
+    if (session->socket->state() != QAbstractSocket::ConnectedState) {
+        onClientDisconnected(session);
+        return;
+    }
+    if (pending.type != MT_Unknown) {
+        handleClientMessage(session, pending);
+    }
+}
+
+void RoomWorker::stopTransfers()
+{
+    m_stopping = true;
+}
+
+void RoomWorker::shutdown()
+{
+    // 断开所有客户端连接
+    const QList<ClientSession*> sessions = m_sessions.values();
+    for (ClientSession *session : sessions) {
+        destroySession(session);
+    }
+
+    for (RoomInfo *room : std::as_const(m_rooms)) {
+        m_directory->removeRoom(room->roomId);
+    }
+    qDeleteAll(m_rooms);
+    m_rooms.clear();
+}
+
+void RoomWorker::onClientDisconnected(ClientSession *session)
+{
+    ServerClock::tick();
+    QString clientId = session->userId;
+    RoomInfo *room = session->room;
+
+    // 从房间中移除客户端
+    finishOpenStrokes(session);
+    detachFromRoom(session);
+    if (room) {
+        // 通知其他客户端该用户离开
+        NetworkMessage leaveMsg;
+        leaveMsg.type = MT_LeaveRequest;
+        leaveMsg.senderId = clientId;
+        leaveMsg.timestamp = ServerClock::wallMs();
+        leaveMsg.data = QJsonObject{{"userId", clientId}};
+
+        // 需要将这个客户端离开的消息广播其他的客户端
+        broadcastToRoom(room, leaveMsg);
+    }
+    // 从容器中移除对应的客户端信息和socket信息，并清除该连接
+    destroySession(session);
+
+    emit clientDisconnected(clientId);
+}
+
+void RoomWorker::onTextMessageReceived(ClientSession *session, const QString &message)
+{
+    // 每个消息只读取一次时钟，处理过程中的时间戳和存活检测都使用这个时间；
+    // 任何消息都说明连接仍然存活
+    session->lastActive = ServerClock::tick();
+
+    // qDebug() << "收到来自客户端" << session->userId << "的消息";
+    // qDebug() << "消息内容:" << message;
+
+    // 解析来自客户端的消息
+    QByteArray utf8 = message.toUtf8();
+    QJsonDocument doc = QJsonDocument::fromJson(utf8);
+    if (doc.isNull() || !doc.isObject()) return;
+
+    // 解析当前的数据类型并进行消息的处理
+    NetworkMessage networkMsg = NetworkMessage::fromJson(doc.object());
+    m_metrics.parseUs.record(ServerClock::elapsedUs());
+    handleClientMessage(session, networkMsg);
+    recordLatency(networkMsg, utf8.size());
+}
+
+void RoomWorker::onBinaryMessageReceived(ClientSession *session, const QByteArray &message)
+{
+    session->lastActive = ServerClock::tick();
+
+    // 解析二进制帧，格式错误的帧直接丢弃
+    NetworkMessage networkMsg;
+    if (!BinaryCodec::decode(message, networkMsg)) {
+        LOG_WARNING("net") << "无法解析的二进制帧，长度:" << message.size();
+        return;
+    }
+    m_metrics.parseUs.record(ServerClock::elapsedUs());
+    handleClientMessage(session, networkMsg);
+    recordLatency(networkMsg, message.size());
+}
+
+// 处理完成之后不再使用session，连接可能已经转交给其他工作线程
+void RoomWorker::recordLatency(const NetworkMessage &message, qint64 bytes)
+{
+    // 处理耗时：从收到消息到处理完成，包括解析、历史更新和广播
+    qint64 processingUs = ServerClock::elapsedUs();
+    m_metrics.recordIn(message.type, bytes);
+    m_metrics.handleUs.record(processingUs);
+    // 传输延迟：客户端发送到服务端收到，包含两端的时钟偏差，只用于观察变化趋势
+    qint64 transitMs = message.timestamp >= MinClientTimestampMs ? ServerClock::wallMs() - message.timestamp : -1;
+
+    if (processingUs >= SlowMessageUs) {
+        LOG_WARNING("net") << "消息处理较慢, 类型:" << message.type << "耗时(us):" << processingUs
+                   << "传输延迟(ms):" << transitMs;
+    }
+}
+
+void RoomWorker::handleClientMessage(ClientSession *session, const NetworkMessage &message)
+{
+    switch (message.type) {
+        case MT_JoinRequest:
+            // 如果客户端指定了房间号或者没有指定房间号，都会发送请求到服务端这里来调用这个函数，请求加入房间号
+        case MT_CreateRoom:
+            // 连接已经转交给其他工作线程时，消息由目标线程处理并上报
+            if (!routeRoomRequest(session, message)) return;
+            break;
+
+        case MT_DrawingOperation:
+            processDrawingOperation(session, message.data);
+            break;
+
+        case MT_ClearScene:
+            processClearScene(session, message.data);
+            break;
+
+        case MT_UndoRequest:
+            processUndoRequest(session, message.data);
+            break;
+
+        case MT_RedoRequest:
+            processRedoRequest(session, message.data);
+            break;
+
+        case MT_ChatMessage:
+            processChatMessage(session, message.data);
+            break;
+
+        case MT_UserRoleChange:
+            processUserRoleChange(session, message.data);
+            break;
+
+        case MT_Heartbeat:
+            processHeartbeat(session, message.data);
+            break;
+
+        case MT_LeaveRequest:
+            processLeaveRequest(session, message.data);
+            break;
+
+        case MT_RoomList:
+            processRoomListRequest(session);
+            break;
+
+        case MT_ProtocolHello:
+            processProtocolHello(session, message.data);
+            break;
+
+        case MT_HistoryAck:
+            processHistoryAck(session, message.data);
+            break;
+
+        default:
+            LOG_WARNING("net") << "未知的消息类型:" << message.type;
+            sendError(session, "未知的消息类型");
+            break;
+    }
+
+    emit messageReceived(message);
+}
+
+bool RoomWorker::routeRoomRequest(ClientSession *session, const NetworkMessage &message)
+{
+    NetworkMessage routed = message;
+    QString roomId = routed.data["roomId"].toString();
+    // 没有指定房间号时先生成房间号，再决定房间属于哪个工作线程
+    if (roomId.isEmpty()) {
+        roomId = generateRoomId();
+        routed.data["roomId"] = roomId;
+        routed.data["newRoom"] = true;
+    }
+
+    RoomWorker *owner = m_peers.value(shardOf(roomId, m_peers.size()), this);
+    if (owner != this && m_stopping) {
+        // 目标线程可能已经关闭，不再转交，连接留在本线程由shutdown关闭
+        return false;
+    }
+    if (owner != this) {
+        // 离开当前房间，连接移动到房间所属的工作线程
+        finishOpenStrokes(session);
+        detachFromRoom(session);
+        unscheduleSession(session);
+        m_sessions.remove(session->userId);
+        transferSession(session, this, owner, routed);
+        return false;
+    }
+
+    if (routed.type == MT_JoinRequest) {
+        processJoinRequest(session, routed.data);
+    } else {
+        processCreateRoomRequest(session, routed.data);
+    }
+    return true;
+}
+
+void RoomWorker::processJoinRequest(ClientSession *session, const QJsonObject &data)
+{
+    // 获得请求加入的房间号以及对应的客户端用户名
+    QString roomId = data["roomId"].toString();
+    QString userName = data["userName"].toString(session->userName);
+
+    // std::cout<<"recvived from client message"<<" roomId = "<<roomId.toStdString()<<" userName = "<<userName.toStdString()<<std::endl;
+
+    RoomInfo *room = m_rooms.value(roomId);
+    // 如果客户端那边没有指定房间号，就用生成的房间号创建新房间
+    if (!room && data["newRoom"].toBool()) {
+        room = createRoomInfo(roomId, data["roomName"].toString("Default Room"));
+    }
+
+    if (!room) {
+        // 房间不存在，发送错误消息给客户端
+        NetworkMessage errorMsg;
+        errorMsg.type = MT_JoinResponse;
+        errorMsg.timestamp = ServerClock::wallMs();
+        errorMsg.data = QJsonObject{
+            {"success", false},
+            {"error", "Room not found"}
+        };
+        sendToClient(session, errorMsg);
+        return;
+    }
+
+    // 否则就将当前的客户端加入指定的房间中
+    session->userName = userName;
+    attachToRoom(session, room);
+    // 重复加入同一个房间时attachToRoom直接返回，上一次未完成的历史同步在这里丢弃，
+    // 新的历史从头开始发送
+    resetHistorySync(session);
+
+    // 发送加入成功的响应给客户端
+    NetworkMessage response;
+    response.type = MT_JoinResponse;
+    response.timestamp = ServerClock::wallMs();
+    response.data = QJsonObject{
+        {"success", true},
+        {"roomId", roomId},
+        {"userId", session->userId},
+        {"userName", userName}
+    };
+    // 支持分块同步的客户端之后按块接收历史，否则一次性放在响应中
+    bool chunkedHistory = data["historyChunks"].toBool();
+    QJsonArray history = roomHistory(room);
+    if (chunkedHistory) {
+        response.data["historySize"] = history.size();
+    } else {
+        response.data["drawingHistory"] = history; // 对于刚加入放假的客户端需要同步之前客户端的历史绘图信息
+    }
+
+    // 将当前socket客户端加入到房间的消息发送给socket客户端
+    sendToClient(session, response);
+
+    if (chunkedHistory && !history.isEmpty()) {
+        // 以加入时的历史为准，之后的新操作通过广播到达，客户端在历史同步完成后再处理
+        session->pendingHistory = history;
+        pumpHistory(session);
+    }
+
+    // 广播其他客户端用户有新用户加入
+    NetworkMessage notifyMsg;
+    notifyMsg.senderId = session->userId;
+    notifyMsg.type = MT_ClientList; //注意 这里的消息类型
+    notifyMsg.timestamp = ServerClock::wallMs();
+
+
+    QJsonArray clientsArray;
+    // 遍历当前房间中的所有成员
+    for (const ClientSession *member : std::as_const(room->members)) {
+        clientsArray.append(QJsonObject{
+            {"userId", member->userId},
+            {"userName", member->userName},
+            {"role", static_cast<int>(member->role)}
+        });
+    }
+    // 当前房间的所有客户端信息，广播给同房间的所有客户端（包括刚加入的客户端）
+    notifyMsg.data = QJsonObject{{"clients", clientsArray}};
+    broadcastToRoom(room, notifyMsg);
+}
+
+void RoomWorker::pumpHistory(ClientSession *session)
+{
+    int total = session->pendingHistory.size();
+    while (session->historyUnacked < HistoryWindow && session->historySent < total) {
+        int offset = session->historySent;
+        int end = qMin(offset + HistoryChunkSize, total);
+        QJsonArray ops;
+        for (int i = offset; i < end; ++i) {
+            ops.append(session->pendingHistory.at(i));
+        }
+
+        NetworkMessage chunk;
+        chunk.type = MT_HistoryChunk;
+        chunk.timestamp = ServerClock::wallMs();
+        chunk.data = QJsonObject{
+            {"offset", offset},
+            {"total", total},
+            {"ops", ops},
+            {"last", end == total}
+        };
+        sendToClient(session, chunk);
+
+        session->historySent = end;
+        ++session->historyUnacked;
+    }
+
+    // 全部发送完毕，释放历史快照
+    if (session->historySent >= total) {
+        session->pendingHistory = QJsonArray();
+    }
+}
+
+void RoomWorker::resetHistorySync(ClientSession *session)
+{
+    session->pendingHistory = QJsonArray();
+    session->historySent = 0;
+    session->historyUnacked = 0;
+}
+
+void RoomWorker::processHistoryAck(ClientSession *session, const QJsonObject &data)
+{
+    Q_UNUSED(data)
+    if (session->historyUnacked > 0) {
+        --session->historyUnacked;
+    }
+    if (!session->pendingHistory.isEmpty()) {
+        pumpHistory(session);
+    }
+}
+
+void RoomWorker::processDrawingOperation(ClientSession *session, const QJsonObject &data)
+{
+    // 获得当前客户端对应的房间
+    RoomInfo *room = session->room;
+    if (!room) return;
+
+    // 笔画的开始和添加点只暂存到未结束的笔画中，结束笔画本身带有完整路径，
+    // 历史中每个笔画只保留一条结束笔画记录
+    int opType = data["opType"].toInt();
+    QJsonObject broadcastData = data;
+    if (opType == DOT_BeginStroke) {
+        OpenStroke &stroke = room->openStrokes[strokeKey(session->userId, data["data"].toObject())];
+        stroke.begin = data["data"].toObject();
+        stroke.points = QJsonArray();
+    } else if (opType == DOT_AddPoint) {
+        QJsonObject opData = data["data"].toObject();
+        auto it = room->openStrokes.find(strokeKey(session->userId, opData));
+        if (it != room->openStrokes.end()) {
+            if (opData.contains("points")) {
+                const QJsonArray points = opData["points"].toArray();
+                for (const QJsonValue &point : points) {
+                    it->points.append(point);
+                }
+            } else {
+                it->points.append(QJsonObject{{"x", opData["x"]}, {"y", opData["y"]}});
+            }
+        }
+    } else {
+        if (opType == DOT_EndStroke) {
+            room->openStrokes.remove(strokeKey(session->userId, data["data"].toObject()));
+        }
+        // 添加到房间的绘图历史
+        DrawingOperation op = DrawingOperation::fromJson(data);
+        // 旧客户端不带id，由服务端分配，广播时一并带上，所有客户端用同一个id指代这个图形
+        if (op.operationId.isEmpty()) {
+            op.operationId = DrawingOperation::generateId();
+            broadcastData["operationId"] = op.operationId;
+        }
+        QJsonObject opJson = op.toJson();
+        if (opType == DOT_Erase) {
+            room->eraseAuthors.insert(op.operationId, session->userId);
+        }
+
+        // 加入对应的历史绘图列表中，便于后面同步加入进来的新客户端
+        appendHistory(room, opJson);
+    }
+
+    // 广播给同一房间的其他用户
+    NetworkMessage msg;
+    msg.type = MT_DrawingOperation;
+    msg.senderId = session->userId;
+    msg.timestamp = ServerClock::wallMs();
+    msg.data = broadcastData;
+
+    broadcastToRoom(room, msg, session);
+}
+
+QString RoomWorker::strokeKey(const QString &senderId, const QJsonObject &opData)
+{
+    // 旧客户端没有笔画id，同一时间每个发送者只有一个笔画
+    return senderId + "/" + opData["strokeId"].toString();
+}
+
+void RoomWorker::finishOpenStrokes(ClientSession *session)
+{
+    RoomInfo *room = session->room;
+    if (!room || room->openStrokes.isEmpty()) return;
+
+    QString prefix = session->userId + "/";
+    for (auto it = room->openStrokes.begin(); it != room->openStrokes.end(); ) {
+        if (!it.key().startsWith(prefix)) {
+            ++it;
+            continue;
+        }
+
+        // 用开始点和累积的点合成完整路径
+        const OpenStroke &stroke = it.value();
+        QPainterPath path;
+        path.moveTo(stroke.begin["startX"].toDouble(), stroke.begin["startY"].toDouble());
+        for (const QJsonValue &pointValue : stroke.points) {
+            QJsonObject point = pointValue.toObject();
+            path.lineTo(point["x"].toDouble(), point["y"].toDouble());
+        }
+
+        QJsonObject endStroke{
+            {"opType", static_cast<int>(DOT_EndStroke)},
+            {"operationId", DrawingOperation::generateId()},
+            {"data", QJsonObject{
+                {"path", DrawingOperation::encodePath(path)},
+                {"penColor", stroke.begin["penColor"]},
+                {"penWidth", stroke.begin["penWidth"]},
+                {"strokeId", stroke.begin["strokeId"]}
+            }}
+        };
+        appendHistory(room, endStroke);
+
+        // 其他客户端用结束笔画完成正在绘制的笔画
+        NetworkMessage msg;
+        msg.type = MT_DrawingOperation;
+        msg.senderId = session->userId;
+        msg.timestamp = ServerClock::wallMs();
+        msg.data = endStroke;
+        broadcastToRoom(room, msg, session);
+
+        it = room->openStrokes.erase(it);
+    }
+}
+
+void RoomWorker::broadcastMessage(const NetworkMessage &message, const QString &excludeClientId)
+{
+    // 获取发送者的房间，如果无法确定发送者的房间，尝试从排除的客户端获取；
+    // 发送者不在本线程时由其他工作线程处理
+    ClientSession *sender = m_sessions.value(message.senderId);
+    ClientSession *exclude = m_sessions.value(excludeClientId);
+    RoomInfo *room = sender ? sender->room : nullptr;
+    if (!room && exclude) {
+        room = exclude->room;
+    }
+
+    if (room) {
+        broadcastToRoom(room, message, exclude);
+    }
+}
+
+void RoomWorker::broadcastToRoom(RoomInfo *room, const NetworkMessage &message, ClientSession *exclude)
+{
+    // 这里的广播对每一个客户端发送同一份编码结果（除了排除的客户端）
+    qint64 start = ServerClock::readMonotonicUs();
+    EncodedFrame frame(message);
+    for (ClientSession *member : std::as_const(room->members)) {
+        if (member == exclude) continue;
+        m_metrics.recordOut(message.type, frame.sendTo(member->socket, member->wireFormat));
+        m_metrics.sendQueueBytes.record(member->socket->bytesToWrite());
+    }
+    m_metrics.fanoutUs.record(ServerClock::readMonotonicUs() - start);
+}
+
+qint64 RoomWorker::EncodedFrame::sendTo(QWebSocket *socket, WireFormat format)
+{
+    if (format == WF_Binary) {
+        if (m_binary.isEmpty()) {
+            m_binary = BinaryCodec::encode(m_message);
+        }
+        return socket->sendBinaryMessage(m_binary);
+    }
+    if (m_text.isEmpty()) {
+        QJsonDocument doc(m_message.toJson());
+        m_text = QString::fromUtf8(doc.toJson(QJsonDocument::Compact));
+    }
+    return socket->sendTextMessage(m_text);
+}
+
+RoomInfo *RoomWorker::createRoomInfo(const QString &roomId, const QString &roomName)
+{
+    RoomInfo *room = m_rooms.value(roomId);
+    if (!room) {
+        room = new RoomInfo;
+        room->roomId = roomId;
+        m_rooms.insert(roomId, room);
+    }
+    if (room->roomName != roomName) {
+        room->roomName = roomName;
+        if (m_store) m_store->setRoomName(roomId, roomName);
+    }
+    publishRoom(room);
+    return room;
+}
+
+void RoomWorker::attachToRoom(ClientSession *session, RoomInfo *room)
+{
+    if (session->room == room) return;
+    ensureLoaded(room);
+    // 已经在其他房间中的客户端先离开原房间
+    finishOpenStrokes(session);
+    detachFromRoom(session);
+
+    session->room = room;
+    session->memberIndex = room->members.size();
+    room->members.append(session);
+    publishRoom(room);
+}
+
+void RoomWorker::detachFromRoom(ClientSession *session)
+{
+    RoomInfo *room = session->room;
+    if (!room) return;
+
+    // 用最后一个成员填补空位，保持成员数组紧凑
+    ClientSession *last = room->members.last();
+    room->members[session->memberIndex] = last;
+    last->memberIndex = session->memberIndex;
+    room->members.removeLast();
+    // 离开之后作者的撤销历史不再存在，它的擦除可以在下一次折叠时应用
+    for (auto it = room->eraseAuthors.begin(); it != room->eraseAuthors.end();) {
+        it = it.value() == session->userId ? room->eraseAuthors.erase(it) : std::next(it);
+    }
+
+    session->room = nullptr;
+    session->memberIndex = -1;
+    if (room->members.isEmpty()) {
+        room->emptySince = ServerClock::nowMs();
+    }
+    // 离开房间后不再继续发送历史
+    resetHistorySync(session);
+    publishRoom(room);
+}
+
+// 同步房间名称和在线人数到共享的房间目录
+void RoomWorker::publishRoom(RoomInfo *room)
+{
+    m_directory->updateRoom(room->roomId, room->roomName, room->members.size());
+}
+
+void RoomWorker::destroySession(ClientSession *session)
+{
+    // 先断开信号，避免close()过程中再次进入断开处理
+    session->socket->disconnect(this);
+    session->socket->close();
+    session->socket->deleteLater();
+
+    detachFromRoom(session);
+    unscheduleSession(session);
+    m_sessions.remove(session->userId);
+    delete session;
+}
+
+void RoomWorker::sendToClient(ClientSession *session, const NetworkMessage &message)
+{
+    qint64 bytes;
+    if (session->wireFormat == WF_Binary) {
+        bytes = session->socket->sendBinaryMessage(BinaryCodec::encode(message));
+    } else {
+        QJsonDocument doc(message.toJson());
+        QString data = QString::fromUtf8(doc.toJson(QJsonDocument::Compact));
+        bytes = session->socket->sendTextMessage(data);
+    }
+    m_metrics.recordOut(message.type, bytes);
+    m_metrics.sendQueueBytes.record(session->socket->bytesToWrite());
+}
+
+QString RoomWorker::generateRoomId() const
+{
+    return QUuid::createUuid().toString(QUuid::WithoutBraces).left(8);
+}
+
+
+void RoomWorker::processCreateRoomRequest(ClientSession *session, const QJsonObject &data)
+{
+    // 客户端创建，将获取的值转换为QString类型，如果值不存在或转换失败，则使用默认值"New Room"
+    QString roomName = data["roomName"].toString("New Room");
+    QString userName = data["userName"].toString(session->userName);
+
+    // 房间号在routeRoomRequest中已经确定（客户端指定或者服务端生成）
+    QString roomId = data["roomId"].toString();
+    LOG_DEBUG("room") << "创建房间:" << roomId << roomName;
+
+    // 创建新房间
+    RoomInfo *room = createRoomInfo(roomId, roomName);
+
+    // 将当前的客户端加入到创建的房间中，记录当前房间有哪些客户端
+    session->userName = userName;
+    attachToRoom(session, room);
+
+    // 发送创建房间成功的响应
+    NetworkMessage response;
+    response.type = MT_CreateRoomResponse;
+    response.timestamp = ServerClock::wallMs();
+    response.data = QJsonObject{
+        {"success", true},
+        {"roomId", roomId},
+        {"roomName", roomName},
+        {"userId", session->userId}
+    };
+
+    sendToClient(session, response);
+
+    // 通知客户端成功加入房间的响应
+    NetworkMessage joinResponse;
+    joinResponse.type = MT_JoinResponse;
+    joinResponse.timestamp = ServerClock::wallMs();
+    joinResponse.data = QJsonObject{
+        {"success", true},
+        {"roomId", roomId},
+        {"userId", session->userId},
+        {"userName", userName}
+    };
+
+    sendToClient(session, joinResponse);
+}
+
+void RoomWorker::processClearScene(ClientSession *session, const QJsonObject &data)
+{
+    RoomInfo *room = session->room;
+    if (!room) {
+        sendError(session, "未加入任何房间");
+        return;
+    }
+
+    // 清除房间的绘图历史、快照和撤销栈，清除之前的操作不能再被重做
+    room->snapshot = QJsonArray();
+    room->drawingHistory = QJsonArray();
+    rebuildHistoryIndex(room);
+    room->eraseAuthors.clear();
+    room->heldErases.clear();
+    room->undoStack.clear();
+    room->redoStack.clear();
+    if (m_store) m_store->clearRoom(room->roomId);
+
+    // 广播清除场景消息
+    NetworkMessage message;
+    message.type = MT_ClearScene;
+    message.senderId = session->userId;
+    message.timestamp = ServerClock::wallMs();
+
+    broadcastToRoom(room, message, session);
+}
+
+void RoomWorker::processUndoRequest(ClientSession *session, const QJsonObject &data)
+{
+    RoomInfo *room = session->room;
+    if (!room) {
+        sendError(session, "未加入任何房间");
+        return;
+    }
+
+    // 获取操作ID（如果有）
+    QString operationId = data["operationId"].toString();
+    QJsonObject broadcastData = data;
+
+    if (!operationId.isEmpty()) {
+        // 移除特定操作，服务端没有这个操作时不广播，避免客户端和之后加入的客户端看到的画面不一致
+        if (!removeOperationFromHistory(room, operationId)) {
+            rejectUndo(session, operationId);
+            return;
+        }
+    } else if (!room->drawingHistory.isEmpty()) {
+        // 移除最后一项并记录到撤销栈
+        QJsonObject lastOp = room->drawingHistory.last().toObject();
+        room->undoStack.append(lastOp);
+        room->historyIndex.remove(lastOp["operationId"].toString());
+        markUndone(broadcastData, lastOp);
+        room->drawingHistory.removeLast();
+        trimHoles(room->drawingHistory, room->historyHoles);
+        if (m_store) m_store->undoLast(room->roomId);
+    } else if (!room->snapshot.isEmpty()) {
+        // 尾部为空时撤销快照中的最后一个图形
+        QJsonObject lastOp = room->snapshot.last().toObject();
+        room->undoStack.append(lastOp);
+        room->snapshotIndex.remove(lastOp["operationId"].toString());
+        markUndone(broadcastData, lastOp);
+        room->snapshot.removeLast();
+        trimHoles(room->snapshot, room->snapshotHoles);
+        if (m_store) m_store->undoLast(room->roomId);
+    } else {
+        // 没有可以撤销的操作
+        return;
+    }
+
+    // 广播撤销请求（包含操作信息）
+    NetworkMessage message;
+    message.type = MT_UndoRequest;
+    message.senderId = session->userId;
+    message.timestamp = ServerClock::wallMs();
+    message.data = broadcastData; // 包含操作信息
+
+    broadcastToRoom(room, message, session);
+}
+
+// 不带id的撤销由服务端决定撤销哪个操作，广播时带上这个操作的id，其他客户端按id撤销同一个操作
+void RoomWorker::markUndone(QJsonObject &broadcastData, const QJsonObject &operation)
+{
+    QString operationId = operation["operationId"].toString();
+    if (!operationId.isEmpty()) {
+        broadcastData["operationId"] = operationId;
+    }
+}
+
+// 服务端已经没有这个操作，告诉请求的客户端撤销没有生效，由客户端恢复本地的撤销
+void RoomWorker::rejectUndo(ClientSession *session, const QString &operationId)
+{
+    NetworkMessage message;
+    message.type = MT_UndoRequest;
+    message.senderId = session->userId;
+    message.timestamp = ServerClock::wallMs();
+    message.data = QJsonObject{{"operationId", operationId}, {"rejected", true}};
+
+    sendToClient(session, message);
+}
+
+void RoomWorker::processRedoRequest(ClientSession *session, const QJsonObject &data)
+{
+    RoomInfo *room = session->room;
+    if (!room) {
+        sendError(session, "未加入任何房间");
+        return;
+    }
+
+    // 从撤销栈恢复操作：带id时恢复客户端指定的操作（其他用户之后的撤销不影响），否则恢复栈顶
+    QString operationId = data["operationId"].toString();
+    int slot = undoStackSlot(room->undoStack, operationId);
+    if (slot >= 0) {
+        QJsonObject redoneOp = room->undoStack.takeAt(slot);
+        // redo记录要在追加历史（可能触发快照）之前写入日志，重放时才不会重复应用
+        if (m_store) m_store->redoLast(room->roomId, operationId);
+        appendHistory(room, redoneOp, false);
+
+        // 广播重做的具体操作
+        NetworkMessage message;
+        message.type = MT_DrawingOperation;
+        message.senderId = session->userId;
+        message.timestamp = ServerClock::wallMs();
+        message.data = redoneOp;
+
+        broadcastToRoom(room, message);
+    }
+}
+
+bool RoomWorker::removeOperationFromHistory(RoomInfo *room, const QString &operationId)
+{
+    // 通过索引直接定位，位置留空而不是移动后面的元素，后面操作的下标保持不变；
+    // 先找尾部，已经折叠进快照的操作在快照中移除
+    QJsonArray *operations = &room->drawingHistory;
+    int *holes = &room->historyHoles;
+    auto it = room->historyIndex.find(operationId);
+    if (it != room->historyIndex.end()) {
+        room->historyIndex.erase(it);
+    } else {
+        it = room->snapshotIndex.find(operationId);
+        if (it == room->snapshotIndex.end()) {
+            LOG_WARNING("room") << "未找到操作ID:" << operationId;
+            return false;
+        }
+        room->snapshotIndex.erase(it);
+        operations = &room->snapshot;
+        holes = &room->snapshotHoles;
+    }
+    int slot = it.value();
+
+    // 将移除的操作添加到撤销栈
+    room->undoStack.append((*operations)[slot].toObject());
+    (*operations)[slot] = QJsonValue();
+    ++*holes;
+    trimHoles(*operations, *holes);
+    if (m_store) m_store->removeOperation(room->roomId, operationId);
+    LOG_DEBUG("room") << "从绘图历史中移除操作:" << operationId;
+    return true;
+}
+
+void RoomWorker::trimHoles(QJsonArray &operations, int &holes)
+{
+    while (holes > 0 && !operations.isEmpty() && operations.last().isNull()) {
+        operations.removeLast();
+        --holes;
+    }
+}
+
+void RoomWorker::rebuildHistoryIndex(RoomInfo *room)
+{
+    auto rebuild = [](const QJsonArray &operations, QHash<QString, int> &index, int &holes) {
+        index.clear();
+        holes = 0;
+        for (int i = 0; i < operations.size(); ++i) {
+            QString operationId = operations[i].toObject()["operationId"].toString();
+            if (!operationId.isEmpty()) {
+                index.insert(operationId, i);
+            }
+        }
+    };
+    rebuild(room->snapshot, room->snapshotIndex, room->snapshotHoles);
+    rebuild(room->drawingHistory, room->historyIndex, room->historyHoles);
+}
+
+void RoomWorker::appendHistory(RoomInfo *room, const QJsonObject &operation, bool logOperation)
+{
+    QString operationId = operation["operationId"].toString();
+    if (!operationId.isEmpty()) {
+        room->historyIndex.insert(operationId, room->drawingHistory.size());
+    }
+    room->drawingHistory.append(operation);
+    if (m_store && logOperation) m_store->appendOperation(room->roomId, operation);
+    if (room->drawingHistory.size() >= SnapshotInterval) {
+        checkpointRoom(room);
+    }
+}
+
+// 把尾部的操作折叠进快照：擦除掉的图形和擦除操作本身都不再保留，
+// 作者还在房间的擦除可能被按id撤销，擦除操作和被擦除的图形保留到作者离开之后
+void RoomWorker::checkpointRoom(RoomInfo *room)
+{
+    int before = room->snapshot.size() + room->drawingHistory.size();
+    QSet<QString> held;
+    held.reserve(room->eraseAuthors.size());
+    for (auto it = room->eraseAuthors.cbegin(); it != room->eraseAuthors.cend(); ++it) {
+        held.insert(it.key());
+    }
+    QSet<QString> released = room->heldErases;
+    released.subtract(held);
+    room->snapshot = RoomSnapshot::fold(room->snapshot, room->drawingHistory, held, released);
+    room->heldErases = held;
+    room->drawingHistory = QJsonArray();
+    rebuildHistoryIndex(room);
+    // 快照写入磁盘之后截断操作日志
+    if (m_store) {
+        RoomState state;
+        state.roomId = room->roomId;
+        state.roomName = room->roomName;
+        state.snapshot = room->snapshot;
+        state.undoStack = room->undoStack;
+        state.redoStack = room->redoStack;
+        m_store->writeSnapshot(state);
+    }
+    LOG_DEBUG("room") << "房间" << room->roomId << "生成快照:" << before << "->" << room->snapshot.size();
+}
+
+QJsonArray RoomWorker::roomHistory(const RoomInfo *room)
+{
+    if (room->snapshot.isEmpty() && room->historyHoles == 0) {
+        return room->drawingHistory;
+    }
+    QJsonArray history;
+    if (room->snapshotHoles == 0) {
+        history = room->snapshot;
+    } else {
+        for (const QJsonValue &operation : room->snapshot) {
+            if (!operation.isNull()) {
+                history.append(operation);
+            }
+        }
+    }
+    for (const QJsonValue &operation : room->drawingHistory) {
+        if (!operation.isNull()) {
+            history.append(operation);
+        }
+    }
+    return history;
+}
+
+void RoomWorker::processUserRoleChange(ClientSession *session, const QJsonObject &data)
+{
+    QString targetUserId = data["userId"].toString();
+    int newRole = data["role"].toInt();
+
+    // 检查权限（只有演示者可以修改角色）
+    if (session->role != UR_Presenter) {
+        sendError(session, "权限不足");
+        return;
+    }
+
+    // 查找目标用户，角色变更只在同一个房间内有效，目标用户一定在本线程
+    ClientSession *target = m_sessions.value(targetUserId);
+    if (!target || target->room != session->room) {
+        sendError(session, "用户不存在");
+        return;
+    }
+
+    // 更新角色
+    target->role = static_cast<UserRole>(newRole);
+
+    // 广播角色变更
+    NetworkMessage message;
+    message.type = MT_UserRoleChange;
+    message.senderId = session->userId;
+    message.timestamp = ServerClock::wallMs();
+    message.data = QJsonObject{
+        {"userId", targetUserId},
+        {"role", newRole},
+        {"userName", target->userName}
+    };
+
+    if (session->room) {
+        broadcastToRoom(session->room, message);
+    }
+}
+
+void RoomWorker::processHeartbeat(ClientSession *session, const QJsonObject &data)
+{
+    // 最后活动时间在收到消息时已经更新
+    // 心跳响应带回客户端的发送时间，客户端据此计算往返延迟
+    NetworkMessage response;
+    response.type = MT_Heartbeat;
+    response.timestamp = ServerClock::wallMs();
+    response.data = QJsonObject{
+        {"status", "alive"},
+        {"serverTime", response.timestamp},
+        {"clientTime", data["clientTime"]}
+    };
+
+    sendToClient(session, response);
+}
+
+// 线协议协商：客户端列出支持的格式，服务端选定后回复，之后双方都使用选定的格式
+void RoomWorker::processProtocolHello(ClientSession *session, const QJsonObject &data)
+{
+    WireFormat format = WF_Json;
+    const QJsonArray formats = data["formats"].toArray();
+    if (formats.contains(BinaryCodec::formatName(WF_Binary)) &&
+        data["binaryVersion"].toInt() == BinaryCodec::FrameVersion) {
+        format = WF_Binary;
+    }
+
+    // 协商回复本身始终用JSON发送，客户端收到后才切换格式
+    NetworkMessage response;
+    response.type = MT_ProtocolHello;
+    response.timestamp = ServerClock::wallMs();
+    response.data = QJsonObject{
+        {"format", BinaryCodec::formatName(format)},
+        {"binaryVersion", BinaryCodec::FrameVersion}
+    };
+    session->wireFormat = WF_Json;
+    sendToClient(session, response);
+
+    session->wireFormat = format;
+}
+
+void RoomWorker::processLeaveRequest(ClientSession *session, const QJsonObject &data)
+{
+    RoomInfo *room = session->room;
+    if (!room) {
+        return;
+    }
+
+    // 从房间中移除客户端
+    finishOpenStrokes(session);
+    detachFromRoom(session);
+
+    // 广播离开消息
+    NetworkMessage message;
+    message.type = MT_LeaveRequest;
+    message.senderId = session->userId;
+    message.timestamp = ServerClock::wallMs();
+    message.data = QJsonObject{
+        {"userId", session->userId},
+        {"userName", session->userName}
+    };
+
+    broadcastToRoom(room, message);
+
+    // 发送离开响应
+    NetworkMessage response;
+    response.type = MT_LeaveRequest;
+    response.timestamp = ServerClock::wallMs();
+    response.data = QJsonObject{
+        {"success", true},
+        {"userId", session->userId}
+    };
+
+    sendToClient(session, response);
+}
+
+void RoomWorker::processRoomListRequest(ClientSession *session)
+{
+    // 构建房间列表（包括其他工作线程的房间）
+    const QHash<QString, RoomDirectory::Entry> rooms = m_directory->snapshot();
+    QJsonArray roomsArray;
+    for (auto it = rooms.begin(); it != rooms.end(); ++it) {
+        roomsArray.append(QJsonObject{
+            {"roomId", it.key()},
+            {"roomName", it.value().roomName},
+            {"clientCount", it.value().clientCount}
+        });
+    }
+
+    // 发送房间列表
+    NetworkMessage response;
+    response.type = MT_RoomList;
+    response.timestamp = ServerClock::wallMs();
+    response.data = QJsonObject{
+        {"rooms", roomsArray}
+    };
+
+    sendToClient(session, response);
+}
+
+void RoomWorker::processChatMessage(ClientSession *session, const QJsonObject &data)
+{
+    RoomInfo *room = session->room;
+    if (!room) {
+        sendError(session, "未加入任何房间");
+        return;
+    }
+
+    QString messageText = data["message"].toString();
+    if (messageText.isEmpty()) {
+        return;
+    }
+    // 和当前服务端建立连接的客户端socket用户名
+    QString userName = data["userName"].toString(session->userName);
+
+    // 广播聊天消息
+    NetworkMessage message;
+    message.type = MT_ChatMessage;
+    message.senderId = session->userId;
+    message.timestamp = ServerClock::wallMs();
+    // 发送时间为message.timestamp（Unix毫秒），客户端显示时再格式化
+    message.data = QJsonObject{
+        {"message", messageText},
+        {"userName", userName}
+    };
+
+    broadcastToRoom(room, message, session);
+
+    // 记录聊天日志（可选）
+    LOG_DEBUG("chat") << "聊天消息:" << userName << ":" << messageText;
+}
+
+void RoomWorker::sendError(ClientSession *session, const QString &errorMessage)
+{
+    NetworkMessage errorMsg;
+    errorMsg.type = MT_RoomError;
+    errorMsg.timestamp = ServerClock::wallMs();
+    errorMsg.data = QJsonObject{
+        {"error", errorMessage}
+    };
+
+    sendToClient(session, errorMsg);
+}
+
+void RoomWorker::scheduleSession(ClientSession *session)
+{
+    // 放入截止时间所在的槽，至少是下一个刻度，避免放入正在处理的槽
+    qint64 tick = (session->lastActive + InactiveTimeoutMs) / LivenessTickMs + 1;
+    tick = qMax(tick, m_wheelTick + 1);
+
+    QVector<ClientSession*> &slot = m_wheel[tick % WheelSlots];
+    session->wheelSlot = tick % WheelSlots;
+    session->wheelIndex = slot.size();
+    slot.append(session);
+}
+
+void RoomWorker::unscheduleSession(ClientSession *session)
+{
+    if (session->wheelSlot < 0) return;
+
+    // 用槽中最后一个会话填补空位
+    QVector<ClientSession*> &slot = m_wheel[session->wheelSlot];
+    ClientSession *last = slot.last();
+    slot[session->wheelIndex] = last;
+    last->wheelIndex = session->wheelIndex;
+    slot.removeLast();
+
+    session->wheelSlot = -1;
+    session->wheelIndex = -1;
+}
+
+void RoomWorker::reapInactiveSessions()
+{
+    qint64 now = ServerClock::tick();
+    qint64 nowTick = now / LivenessTickMs;
+    // 定时器可能延迟，补上错过的刻度
+    for (; m_wheelTick <= nowTick; ++m_wheelTick) {
+        QVector<ClientSession*> due;
+        due.swap(m_wheel[m_wheelTick % WheelSlots]);
+        for (ClientSession *session : std::as_const(due)) {
+            session->wheelSlot = -1;
+            session->wheelIndex = -1;
+        }
+
+        for (ClientSession *session : std::as_const(due)) {
+            if (now - session->lastActive < InactiveTimeoutMs) {
+                // 期间收到过消息，按新的截止时间重新放入
+                scheduleSession(session);
+                continue;
+            }
+            // 半开连接不会触发disconnected，按断开处理：通知房间成员并释放会话
+            LOG_INFO("net") << "客户端超时:" << session->userId;
+            onClientDisconnected(session);
+        }
+    }
+}
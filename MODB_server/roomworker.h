@@ -0,0 +1,263 @@
+﻿#ifndef ROOMWORKER_H
+#define ROOMWORKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QMutex>
+#include <QDateTime>
+#include <QTimer>
+#include <QtWebSockets/QtWebSockets>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QUuid>
+
+#include "networkprotocol.h"
+#include "binaryprotocol.h"
+#include "roomhistory.h"
+#include "roomsnapshot.h"
+#include "roomstore.h"
+#include "serverclock.h"
+#include "servermetrics.h"
+#include "asynclogger.h"
+
+struct RoomInfo;
+
+// 每一个连接对应一个会话，消息到达时直接拿到会话，不需要再按socket或者id查找
+struct ClientSession {
+    QWebSocket *socket;
+    QString userId;
+    QString userName;
+    UserRole role;
+    RoomInfo *room;         // 所在房间，未加入房间时为nullptr
+    int memberIndex;        // 在room->members中的下标，离开房间时O(1)移除
+    qint64 lastActive;      // 最后一次收到消息的时间（单调时钟毫秒）
+    int wheelSlot;          // 所在的存活检测时间轮槽，-1表示不在时间轮中
+    int wheelIndex;         // 在槽中的下标，O(1)移除
+    WireFormat wireFormat;  // 协商后的线协议格式
+
+    // 加入房间后的历史分块同步
+    QJsonArray pendingHistory;  // 加入时的历史快照（隐式共享），发送完之后释放
+    int historySent;            // 已经发送的操作数量
+    int historyUnacked;         // 已经发送但客户端还没有确认的分块数量
+};
+
+// 未结束的铅笔笔画：开始笔画的数据和之后累积的点，笔画结束之前不写入绘图历史
+struct OpenStroke {
+    QJsonObject begin;
+    QJsonArray points;
+};
+
+// 每一个房间对应的信息，包括有哪些客户端，一个房间可以有多个客户端
+struct RoomInfo {
+    QString roomId;
+    QString roomName;
+    QVector<ClientSession*> members;    // 房间成员（紧凑数组），广播时直接遍历
+    QJsonArray snapshot;                // 最近一次折叠的画面快照，按id撤销的位置留空
+    QHash<QString, int> snapshotIndex;  // 操作id -> snapshot中的下标
+    int snapshotHoles = 0;              // snapshot中留空的位置数量
+    QJsonArray drawingHistory;          // 快照之后的绘图操作（操作日志尾部），按id移除的位置留空
+    QHash<QString, int> historyIndex;   // 操作id -> drawingHistory中的下标
+    int historyHoles = 0;               // drawingHistory中留空的位置数量
+    QList<QJsonObject> undoStack;       // 撤销栈
+    QList<QJsonObject> redoStack;       // 重做栈
+    QHash<QString, QString> eraseAuthors; // 擦除操作id -> 作者id，作者还在房间时可能按id撤销，折叠时保留
+    QSet<QString> heldErases;           // 快照中保留而没有应用的擦除操作id
+    QHash<QString, OpenStroke> openStrokes; // 发送者/笔画id -> 未结束的笔画
+    bool loaded = true;                 // 从磁盘恢复的房间在第一次加入时才读取内容
+    qint64 emptySince = 0;              // 最后一个成员离开的时间（单调时钟毫秒），用于空闲房间换出
+};
+
+// 所有工作线程共享的房间目录，只在房间创建和成员变化时更新，用于房间列表查询
+class RoomDirectory
+{
+public:
+    struct Entry {
+        QString roomName;
+        int clientCount;
+    };
+
+    // 空闲房间换出和重新读取的统计
+    struct Stats {
+        qint64 evictions = 0;       // 换出次数
+        qint64 reloads = 0;         // 重新读取次数
+        qint64 reloadTotalMs = 0;   // 重新读取总耗时
+        qint64 reloadMaxMs = 0;     // 重新读取最大耗时
+    };
+
+    void updateRoom(const QString &roomId, const QString &roomName, int clientCount);
+    void removeRoom(const QString &roomId);
+    void clear();
+    QHash<QString, Entry> snapshot() const;
+
+    void recordEviction();
+    void recordReload(qint64 elapsedMs);
+    Stats stats() const;
+
+private:
+    mutable QMutex m_mutex;
+    QHash<QString, Entry> m_rooms;
+    Stats m_stats;
+};
+
+// 房间工作线程：房间按房间号哈希分配到各个工作线程，每个工作线程运行自己的事件循环，
+// 负责所属房间内连接的消息解析、绘图历史和广播。连接加入房间时被移动到房间所属的线程
+class RoomWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    // store为nullptr时不持久化
+    RoomWorker(int index, RoomDirectory *directory, RoomStore *store = nullptr);
+    ~RoomWorker();
+
+    // 在工作线程启动之前设置，运行期间只读
+    void setPeers(const QVector<RoomWorker*> &peers);
+    // 恢复磁盘上保存的房间，在工作线程启动之前调用
+    void restoreRoom(const StoredRoom &stored);
+    // 没有成员的房间空闲超过timeoutMs后写入快照并释放内存，0表示不换出；在工作线程启动之前设置
+    void setRoomIdleTimeout(qint64 timeoutMs);
+    // 房间号所属的工作线程下标
+    static int shardOf(const QString &roomId, int shardCount);
+
+    // 把会话交给目标工作线程，必须在socket当前所在的线程中调用；
+    // pending为转交之前尚未处理的消息，由目标线程接着处理
+    static void transferSession(ClientSession *session, QObject *previousOwner,
+                                RoomWorker *target, const NetworkMessage &pending);
+
+    // 本线程的指标，只由本线程写入，其他线程可以随时读取
+    const ServerMetrics *metrics() const{ return &m_metrics; }
+
+public slots:
+    // 在工作线程中启动定时任务
+    void start();
+    // 停止向其他工作线程转交连接，关闭服务端时在所有工作线程的shutdown之前调用
+    void stopTransfers();
+    // 关闭本线程的所有连接并释放房间
+    void shutdown();
+    void broadcastMessage(const NetworkMessage &message, const QString &excludeClientId);
+
+signals:
+    void clientDisconnected(const QString &clientId);
+    void messageReceived(const NetworkMessage &message);
+
+private:
+    int m_index;
+    RoomDirectory *m_directory;
+    RoomStore *m_store;         // 房间持久化，所有工作线程共享
+    qint64 m_roomIdleTimeout;
+    QTimer *m_evictTimer;
+
+    // 连接存活检测时间轮：每个槽对应LivenessTickMs，会话按超时截止时间放入对应的槽。
+    // 收到消息时只更新lastActive，槽到期时才检查其中的会话，仍然活跃的会话按新的截止时间重新放入，
+    // 每次检查只处理到期槽中的会话
+    static constexpr qint64 InactiveTimeoutMs = 90000;  // 客户端每30秒一次心跳，连续三次没有消息视为断开
+    static constexpr qint64 LivenessTickMs = 1000;
+    static constexpr int WheelSlots = 128;              // 覆盖超时时间
+    QVector<QVector<ClientSession*>> m_wheel;
+    qint64 m_wheelTick;         // 下一个要处理的刻度
+    QTimer *m_livenessTimer;
+
+    ServerMetrics m_metrics;
+    QVector<RoomWorker*> m_peers;
+
+    // 会话和房间由工作线程持有，容器中保存指针保证地址稳定
+    QHash<QString, ClientSession*> m_sessions;   // userId -> 会话
+    QHash<QString, RoomInfo*> m_rooms;
+    bool m_stopping;            // 正在关闭，不再转交连接
+
+    void bindSession(ClientSession *session);
+    void adoptSession(ClientSession *session, const NetworkMessage &pending);
+
+    void onTextMessageReceived(ClientSession *session, const QString &message);
+    void onBinaryMessageReceived(ClientSession *session, const QByteArray &message);
+    void onClientDisconnected(ClientSession *session);
+
+    void handleClientMessage(ClientSession *session, const NetworkMessage &message);
+    // 每条消息的处理耗时和传输延迟，记录到指标中，处理较慢的消息输出警告
+    static constexpr qint64 SlowMessageUs = 20000;
+    static constexpr qint64 MinClientTimestampMs = 1000000000000LL;    // 早于此值的是旧客户端的秒级时间戳
+    void recordLatency(const NetworkMessage &message, qint64 bytes);
+    // 加入/创建房间：房间属于其他工作线程时转交连接并返回false
+    bool routeRoomRequest(ClientSession *session, const NetworkMessage &message);
+    void processJoinRequest(ClientSession *session, const QJsonObject &data);
+    void processDrawingOperation(ClientSession *session, const QJsonObject &data);
+    void processRoomListRequest(ClientSession *session);
+    void processLeaveRequest(ClientSession *session, const QJsonObject &data);
+    void processHeartbeat(ClientSession *session, const QJsonObject &data);
+    void processUserRoleChange(ClientSession *session, const QJsonObject &data);
+    void processChatMessage(ClientSession *session, const QJsonObject &data);
+    void processUndoRequest(ClientSession *session, const QJsonObject &data);
+    void processClearScene(ClientSession *session, const QJsonObject &data);
+    void processCreateRoomRequest(ClientSession *session, const QJsonObject &data);
+    void processRedoRequest(ClientSession *session, const QJsonObject &data);
+    void processProtocolHello(ClientSession *session, const QJsonObject &data);
+    void processHistoryAck(ClientSession *session, const QJsonObject &data);
+    // 按id在尾部（找不到时在快照）索引中定位并移除操作，位置留空，末尾的空位立即截掉；
+    // 找不到时返回false
+    bool removeOperationFromHistory(RoomInfo *room, const QString &operationId);
+    static void markUndone(QJsonObject &broadcastData, const QJsonObject &operation);
+    void rejectUndo(ClientSession *session, const QString &operationId);
+    static void trimHoles(QJsonArray &operations, int &holes);
+    // 快照和尾部整体替换（读取、折叠、清空）之后重建id索引
+    static void rebuildHistoryIndex(RoomInfo *room);
+    // 追加绘图历史，尾部达到SnapshotInterval时折叠到快照中
+    static constexpr int SnapshotInterval = 1000;
+    // logOperation为false时由调用方写操作日志（重做写的是redo记录）
+    void appendHistory(RoomInfo *room, const QJsonObject &operation, bool logOperation = true);
+    void checkpointRoom(RoomInfo *room);
+    // 新加入的客户端需要的完整历史：快照 + 尾部
+    static QJsonArray roomHistory(const RoomInfo *room);
+    // 笔画历史压缩：开始笔画和添加点只暂存，结束笔画时只保留一条完整的结束笔画记录
+    static QString strokeKey(const QString &senderId, const QJsonObject &opData);
+    // 连接离开房间时，把未结束的笔画合成为结束笔画写入历史并广播
+    void finishOpenStrokes(ClientSession *session);
+
+    // 历史分块同步：每块最多HistoryChunkSize个操作，最多HistoryWindow块未确认，
+    // 客户端处理完一块再确认，发送速度跟随客户端的处理速度
+    static constexpr int HistoryChunkSize = 500;
+    static constexpr int HistoryWindow = 4;
+    void pumpHistory(ClientSession *session);
+    void resetHistorySync(ClientSession *session);
+
+    void sendError(ClientSession *session, const QString &errorMessage);
+    // 接收到来自客户端的数据之后，需要将数据同步到其他的客户端
+    void sendToClient(ClientSession *session, const NetworkMessage &message);
+    // 广播给指定房间的成员，exclude为空时包括所有成员
+    void broadcastToRoom(RoomInfo *room, const NetworkMessage &message, ClientSession *exclude = nullptr);
+    // 维护会话和房间成员索引
+    RoomInfo *createRoomInfo(const QString &roomId, const QString &roomName);
+    void attachToRoom(ClientSession *session, RoomInfo *room);
+    void detachFromRoom(ClientSession *session);
+    void publishRoom(RoomInfo *room);
+    // 读取尚未加载的房间（快照和操作日志）
+    void ensureLoaded(RoomInfo *room);
+    // 换出空闲房间：写入快照后只保留房间目录需要的信息，下次加入时由ensureLoaded重新读取
+    void evictIdleRooms();
+    void evictRoom(RoomInfo *room);
+    // 关闭连接并释放会话
+    void destroySession(ClientSession *session);
+
+    // 广播帧缓存：同一条消息每种线协议格式只编码一次，编码结果（隐式共享）复用到所有接收方
+    class EncodedFrame {
+    public:
+        explicit EncodedFrame(const NetworkMessage &message) : m_message(message) {}
+        // 返回发送的字节数
+        qint64 sendTo(QWebSocket *socket, WireFormat format);
+    private:
+        const NetworkMessage &m_message;
+        QString m_text;
+        QByteArray m_binary;
+    };
+
+    QString generateRoomId() const;
+
+    // 存活检测：会话加入/离开本线程时放入/移出时间轮，定时处理到期的槽
+    void scheduleSession(ClientSession *session);
+    void unscheduleSession(ClientSession *session);
+    void reapInactiveSessions();
+};
+
+#endif // ROOMWORKER_H
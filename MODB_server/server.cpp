@@ -1,5 +1,6 @@
 ﻿#include "server.h"
 #include "ui_server.h"
+#include "asynclogger.h"
 
 Server::Server(QWidget *parent)
     : QMainWindow(parent)
@@ -28,7 +29,7 @@ Server::Server(QWidget *parent)
         this->setStyleSheet(strCss);
         file.close();
     } else {
-        qDebug() << "无法加载CSS文件";
+        LOG_WARNING("ui") << "无法加载CSS文件";
     }
 
     // 设置初始IP地址
@@ -320,7 +321,7 @@ void Server::appendLog(const QString &message)
     if (ui->chat_frame) {
         ui->chat_frame->appendPlainText(message);
     } else {
-        qDebug() << message; // 如果没有UI控件，输出到控制台
+        LOG_INFO("server") << message; // 如果没有UI控件，输出到日志（控制台）
     }
 }
 
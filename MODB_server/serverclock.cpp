@@ -0,0 +1,60 @@
+﻿#include "serverclock.h"
+#include <QDateTime>
+#include <QDeadlineTimer>
+
+namespace {
+// 当前线程最近一次tick()的单调时间（微秒），0表示还没有读取
+thread_local qint64 t_nowUs = 0;
+
+// 单调时钟和Unix时间的差值，进程启动时确定一次
+qint64 wallOffsetMs()
+{
+    static const qint64 offset = QDateTime::currentMSecsSinceEpoch() -
+                                 QDeadlineTimer::current().deadline();
+    return offset;
+}
+}
+
+qint64 ServerClock::readMonotonicUs()
+{
+    return QDeadlineTimer::current().deadlineNSecs() / 1000;
+}
+
+qint64 ServerClock::tick()
+{
+    t_nowUs = readMonotonicUs();
+    return t_nowUs / 1000;
+}
+
+qint64 ServerClock::nowMs()
+{
+    return nowUs() / 1000;
+}
+
+qint64 ServerClock::nowUs()
+{
+    if (t_nowUs == 0) {
+        t_nowUs = readMonotonicUs();
+    }
+    return t_nowUs;
+}
+
+qint64 ServerClock::wallMs()
+{
+    return toWallMs(nowMs());
+}
+
+qint64 ServerClock::toWallMs(qint64 monotonicMs)
+{
+    return monotonicMs + wallOffsetMs();
+}
+
+qint64 ServerClock::elapsedUs()
+{
+    return readMonotonicUs() - nowUs();
+}
+
+QString ServerClock::toDisplayString(qint64 wallMs)
+{
+    return QDateTime::fromMSecsSinceEpoch(wallMs).toString(Qt::ISODateWithMs);
+}
@@ -0,0 +1,30 @@
+﻿#ifndef SERVERCLOCK_H
+#define SERVERCLOCK_H
+
+#include <QtGlobal>
+#include <QString>
+
+// 服务端时钟：单调时钟，按线程缓存。每个事件（收到消息、定时器）开始处理时调用tick()读取一次，
+// 处理过程中构造的所有消息、历史记录和存活检测都使用缓存的时间，不再重复读取系统时间。
+// 消息的timestamp字段为单调时钟换算的Unix毫秒时间，保证同一个服务端发出的时间戳不会倒退；
+// 可读的时间字符串只在需要给人看的时候用toDisplayString()生成
+class ServerClock
+{
+public:
+    // 读取单调时钟并刷新当前线程的缓存，返回毫秒
+    static qint64 tick();
+    // 当前线程缓存的单调时钟（毫秒/微秒），还没有缓存时先读取一次
+    static qint64 nowMs();
+    static qint64 nowUs();
+    // 缓存时间换算的Unix毫秒时间，用于消息的timestamp字段
+    static qint64 wallMs();
+    static qint64 toWallMs(qint64 monotonicMs);
+    // 距离上一次tick()经过的微秒数，直接读取时钟，用于测量处理耗时
+    static qint64 elapsedUs();
+    // 直接读取单调时钟（微秒），不更新缓存
+    static qint64 readMonotonicUs();
+
+    static QString toDisplayString(qint64 wallMs);
+};
+
+#endif // SERVERCLOCK_H
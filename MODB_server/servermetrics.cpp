@@ -0,0 +1,157 @@
+﻿#include "servermetrics.h"
+#include <QtMath>
+#include <QtAlgorithms>
+
+int LatencyHistogram::bucketOf(quint64 value)
+{
+    if (value < SubBuckets) return static_cast<int>(value);
+
+    int exponent = 63 - qCountLeadingZeroBits(value);
+    if (exponent > MaxExponent) return BucketCount - 1;
+    int sub = static_cast<int>((value >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+    return (exponent - SubBucketBits + 1) * SubBuckets + sub;
+}
+
+quint64 LatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < SubBuckets) return static_cast<quint64>(bucket);
+
+    int exponent = bucket / SubBuckets + SubBucketBits - 1;
+    int sub = bucket % SubBuckets;
+    quint64 lower = static_cast<quint64>(SubBuckets + sub) << (exponent - SubBucketBits);
+    return lower + (quint64(1) << (exponent - SubBucketBits)) - 1;
+}
+
+void LatencyHistogram::record(qint64 value)
+{
+    quint64 v = static_cast<quint64>(qMax<qint64>(0, value));
+    m_buckets[bucketOf(v)].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_sum.fetchAndAddRelaxed(v);
+    // 只有一个写入线程，不需要比较交换
+    if (v > m_max.loadRelaxed()) {
+        m_max.storeRelaxed(v);
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot result;
+    result.count = m_count.loadRelaxed();
+    result.sum = m_sum.loadRelaxed();
+    result.max = m_max.loadRelaxed();
+    result.buckets.resize(BucketCount);
+    for (int i = 0; i < BucketCount; ++i) {
+        result.buckets[i] = m_buckets[i].loadRelaxed();
+    }
+    return result;
+}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot &other)
+{
+    count += other.count;
+    sum += other.sum;
+    max = qMax(max, other.max);
+    if (buckets.size() < other.buckets.size()) {
+        buckets.resize(other.buckets.size());
+    }
+    for (int i = 0; i < other.buckets.size(); ++i) {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+quint64 LatencyHistogram::Snapshot::valueAt(double quantile) const
+{
+    if (count == 0) return 0;
+
+    quint64 rank = qMax<quint64>(1, static_cast<quint64>(qCeil(quantile * count)));
+    quint64 seen = 0;
+    for (int i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return qMin(bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+int ServerMetrics::typeIndex(MessageType type)
+{
+    int index = static_cast<int>(type);
+    return (index >= 0 && index < MessageTypeCount) ? index : MT_Unknown;
+}
+
+QString ServerMetrics::typeName(int index)
+{
+    static const char *const names[MessageTypeCount] = {
+        "Unknown", "JoinRequest", "JoinResponse", "CreateRoom", "CreateRoomResponse",
+        "ClientList", "DrawingOperation", "ClearScene", "UndoRequest", "RedoRequest",
+        "ChatMessage", "UserRoleChange", "Heartbeat", "LeaveRequest", "RoomList",
+        "RoomError", "ProtocolHello", "HistoryChunk", "HistoryAck"
+    };
+    return QString::fromLatin1(names[index]);
+}
+
+void ServerMetrics::recordIn(MessageType type, qint64 bytes)
+{
+    TypeCounters &counters = m_in[typeIndex(type)];
+    counters.messages.fetchAndAddRelaxed(1);
+    counters.bytes.fetchAndAddRelaxed(static_cast<quint64>(qMax<qint64>(0, bytes)));
+}
+
+void ServerMetrics::recordOut(MessageType type, qint64 bytes)
+{
+    TypeCounters &counters = m_out[typeIndex(type)];
+    counters.messages.fetchAndAddRelaxed(1);
+    counters.bytes.fetchAndAddRelaxed(static_cast<quint64>(qMax<qint64>(0, bytes)));
+}
+
+void ServerMetrics::appendHistogram(QString &out, const QString &name, const LatencyHistogram::Snapshot &snapshot)
+{
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    for (double quantile : quantiles) {
+        out += QString("%1{quantile=\"%2\"} %3\n").arg(name).arg(quantile).arg(snapshot.valueAt(quantile));
+    }
+    out += QString("%1_count %2\n").arg(name).arg(snapshot.count);
+    out += QString("%1_sum %2\n").arg(name).arg(snapshot.sum);
+    out += QString("%1_max %2\n").arg(name).arg(snapshot.max);
+}
+
+QString ServerMetrics::format(const QList<const ServerMetrics*> &metrics, const QList<QPair<QString, qint64>> &gauges)
+{
+    QString out;
+    for (const auto &gauge : gauges) {
+        out += QString("modb_%1 %2\n").arg(gauge.first).arg(gauge.second);
+    }
+
+    // 按消息类型汇总，没有出现过的类型不输出
+    for (int i = 0; i < MessageTypeCount; ++i) {
+        quint64 inMessages = 0, inBytes = 0, outMessages = 0, outBytes = 0;
+        for (const ServerMetrics *worker : metrics) {
+            inMessages += worker->m_in[i].messages.loadRelaxed();
+            inBytes += worker->m_in[i].bytes.loadRelaxed();
+            outMessages += worker->m_out[i].messages.loadRelaxed();
+            outBytes += worker->m_out[i].bytes.loadRelaxed();
+        }
+        if (inMessages == 0 && outMessages == 0) continue;
+
+        QString label = QString("{type=\"%1\"}").arg(typeName(i));
+        out += QString("modb_messages_in_total%1 %2\n").arg(label).arg(inMessages);
+        out += QString("modb_bytes_in_total%1 %2\n").arg(label).arg(inBytes);
+        out += QString("modb_messages_out_total%1 %2\n").arg(label).arg(outMessages);
+        out += QString("modb_bytes_out_total%1 %2\n").arg(label).arg(outBytes);
+    }
+
+    LatencyHistogram::Snapshot parse, handle, fanout, sendQueue;
+    for (const ServerMetrics *worker : metrics) {
+        parse.merge(worker->parseUs.snapshot());
+        handle.merge(worker->handleUs.snapshot());
+        fanout.merge(worker->fanoutUs.snapshot());
+        sendQueue.merge(worker->sendQueueBytes.snapshot());
+    }
+    appendHistogram(out, "modb_parse_us", parse);
+    appendHistogram(out, "modb_handle_us", handle);
+    appendHistogram(out, "modb_fanout_us", fanout);
+    appendHistogram(out, "modb_send_queue_bytes", sendQueue);
+    return out;
+}
@@ -0,0 +1,75 @@
+﻿#ifndef SERVERMETRICS_H
+#define SERVERMETRICS_H
+
+#include <QAtomicInteger>
+#include <QString>
+#include <QVector>
+#include <QList>
+#include "networkprotocol.h"
+
+// 对数分桶直方图（HDR风格）：小于SubBuckets的值每个值一个桶，之后每个2的幂区间分成SubBuckets个线性子桶，
+// 相对误差不超过1/SubBuckets。只允许一个线程写入（所属的工作线程），其他线程可以随时读取
+class LatencyHistogram
+{
+public:
+    struct Snapshot {
+        quint64 count = 0;
+        quint64 sum = 0;
+        quint64 max = 0;
+        QVector<quint64> buckets;
+
+        void merge(const Snapshot &other);
+        // 分位数对应桶的上界（不超过最大值）
+        quint64 valueAt(double quantile) const;
+    };
+
+    void record(qint64 value);
+    Snapshot snapshot() const;
+
+private:
+    static constexpr int SubBucketBits = 3;
+    static constexpr int SubBuckets = 1 << SubBucketBits;
+    static constexpr int MaxExponent = 40;      // 超过2^40的值计入最后一个桶
+    static constexpr int BucketCount = (MaxExponent - SubBucketBits + 2) * SubBuckets;
+
+    static int bucketOf(quint64 value);
+    static quint64 bucketUpperBound(int bucket);
+
+    QAtomicInteger<quint64> m_buckets[BucketCount];
+    QAtomicInteger<quint64> m_count;
+    QAtomicInteger<quint64> m_sum;
+    QAtomicInteger<quint64> m_max;
+};
+
+// 服务端指标：每个工作线程一份，只由该线程写入，输出时汇总所有工作线程
+class ServerMetrics
+{
+public:
+    static constexpr int MessageTypeCount = MT_HistoryAck + 1;
+
+    // 收到/发送的消息数量和字节数，按消息类型统计
+    void recordIn(MessageType type, qint64 bytes);
+    void recordOut(MessageType type, qint64 bytes);
+
+    LatencyHistogram parseUs;       // 消息解析耗时（微秒）
+    LatencyHistogram handleUs;      // 从收到消息到处理完成的耗时，包括解析和广播（微秒）
+    LatencyHistogram fanoutUs;      // 一次房间广播的耗时（微秒）
+    LatencyHistogram sendQueueBytes; // 发送之后连接中等待写出的字节数，持续偏大说明客户端接收慢
+
+    // 以文本格式（Prometheus风格）输出汇总后的指标
+    static QString format(const QList<const ServerMetrics*> &metrics, const QList<QPair<QString, qint64>> &gauges);
+
+private:
+    struct TypeCounters {
+        QAtomicInteger<quint64> messages;
+        QAtomicInteger<quint64> bytes;
+    };
+    TypeCounters m_in[MessageTypeCount];
+    TypeCounters m_out[MessageTypeCount];
+
+    static int typeIndex(MessageType type);
+    static QString typeName(int index);
+    static void appendHistogram(QString &out, const QString &name, const LatencyHistogram::Snapshot &snapshot);
+};
+
+#endif // SERVERMETRICS_H
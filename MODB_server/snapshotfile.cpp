@@ -0,0 +1,364 @@
+﻿#include "snapshotfile.h"
+#include <QFile>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+
+namespace {
+const char Magic[8] = {'M', 'O', 'D', 'B', 'S', 'N', 'A', 'P'};
+const int MaxNestingDepth = 32;
+// 双精度可精确表示的最大整数
+const double MaxExactInteger = 9007199254740992.0;
+
+void appendUInt32(QByteArray &out, quint32 value)
+{
+    char buffer[sizeof(value)];
+    qToLittleEndian<quint32>(value, buffer);
+    out.append(buffer, sizeof(buffer));
+}
+
+void appendUInt64(QByteArray &out, quint64 value)
+{
+    char buffer[sizeof(value)];
+    qToLittleEndian<quint64>(value, buffer);
+    out.append(buffer, sizeof(buffer));
+}
+}
+
+quint64 SnapshotFile::Writer::intern(const QString &str)
+{
+    auto it = index.constFind(str);
+    if (it != index.constEnd()) return it.value();
+
+    const quint64 id = append(str);
+    index.insert(str, id);
+    return id;
+}
+
+quint64 SnapshotFile::Writer::append(const QString &str)
+{
+    const QByteArray utf8 = str.toUtf8();
+    writeVarint(strings, static_cast<quint64>(utf8.size()));
+    strings.append(utf8);
+    return count++;
+}
+
+QByteArray SnapshotFile::encode(const RoomState &state)
+{
+    Writer writer;
+    // 0号和1号固定为房间号和房间名称，两者相同（或者都为空）时也各占一项
+    writer.index.insert(state.roomId, writer.append(state.roomId));
+    writer.index.insert(state.roomName, writer.append(state.roomName));
+
+    // 先编码所有记录，记下每条记录在记录区中的相对偏移
+    QByteArray records;
+    QVector<quint64> offsets[SectionCount];
+    for (const QJsonValue &operation : state.snapshot) {
+        offsets[S_Snapshot].append(records.size());
+        writeValue(writer, records, operation);
+    }
+    offsets[S_Snapshot].append(records.size());
+    for (const QJsonObject &operation : state.undoStack) {
+        offsets[S_Undo].append(records.size());
+        writeValue(writer, records, operation);
+    }
+    offsets[S_Undo].append(records.size());
+    for (const QJsonObject &operation : state.redoStack) {
+        offsets[S_Redo].append(records.size());
+        writeValue(writer, records, operation);
+    }
+    offsets[S_Redo].append(records.size());
+
+    const quint64 stringTableOffset = HeaderSize;
+    quint64 indexOffset = stringTableOffset + writer.strings.size();
+    quint64 indexSize = 0;
+    for (int section = 0; section < SectionCount; ++section) {
+        indexSize += offsets[section].size() * sizeof(quint64);
+    }
+    const quint64 recordsOffset = indexOffset + indexSize;
+
+    QByteArray out;
+    out.reserve(static_cast<qsizetype>(recordsOffset + records.size()));
+    out.append(Magic, sizeof(Magic));
+    appendUInt32(out, FormatVersion);
+    appendUInt32(out, static_cast<quint32>(writer.count));
+    appendUInt64(out, stringTableOffset);
+    for (int section = 0; section < SectionCount; ++section) {
+        appendUInt32(out, static_cast<quint32>(offsets[section].size() - 1));
+        appendUInt32(out, 0);
+        appendUInt64(out, indexOffset);
+        indexOffset += offsets[section].size() * sizeof(quint64);
+    }
+    out.append(writer.strings);
+    for (int section = 0; section < SectionCount; ++section) {
+        for (quint64 offset : std::as_const(offsets[section])) {
+            appendUInt64(out, recordsOffset + offset);
+        }
+    }
+    out.append(records);
+    return out;
+}
+
+bool SnapshotFile::isSnapshotFile(const QByteArray &head)
+{
+    return head.size() >= static_cast<qsizetype>(sizeof(Magic)) &&
+           std::memcmp(head.constData(), Magic, sizeof(Magic)) == 0;
+}
+
+bool SnapshotFile::readHeader(const QString &fileName, QString &roomId, QString &roomName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < HeaderSize) return false;
+
+    uchar *data = file.map(0, file.size());
+    if (!data) return false;
+
+    bool ok = false;
+    if (std::memcmp(data, Magic, sizeof(Magic)) == 0 &&
+        qFromLittleEndian<quint32>(data + 8) == FormatVersion &&
+        qFromLittleEndian<quint32>(data + 12) >= 2) {
+        const quint64 stringTableOffset = qFromLittleEndian<quint64>(data + 16);
+        if (stringTableOffset <= static_cast<quint64>(file.size())) {
+            Reader in{data + stringTableOffset, data + file.size()};
+            ok = readString(in, roomId) && readString(in, roomName);
+        }
+    }
+    file.unmap(data);
+    return ok;
+}
+
+bool SnapshotFile::read(const QString &fileName, RoomState &state)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < HeaderSize) return false;
+
+    const qint64 size = file.size();
+    uchar *data = file.map(0, size);
+    if (!data) return false;
+
+    bool ok = std::memcmp(data, Magic, sizeof(Magic)) == 0 &&
+              qFromLittleEndian<quint32>(data + 8) == FormatVersion;
+
+    // 字符串表
+    QVector<QString> strings;
+    if (ok) {
+        const quint32 stringCount = qFromLittleEndian<quint32>(data + 12);
+        const quint64 stringTableOffset = qFromLittleEndian<quint64>(data + 16);
+        ok = stringCount >= 2 && stringTableOffset <= static_cast<quint64>(size) &&
+             stringCount <= static_cast<quint64>(size) - stringTableOffset;
+        if (ok) {
+            Reader in{data + stringTableOffset, data + size};
+            strings.resize(stringCount);
+            for (quint32 i = 0; ok && i < stringCount; ++i) {
+                ok = readString(in, strings[i]);
+            }
+        }
+    }
+
+    QList<QJsonObject> sections[SectionCount];
+    for (int section = 0; ok && section < SectionCount; ++section) {
+        ok = readSection(data, size, data + 24 + section * 16, strings, sections[section]);
+    }
+    file.unmap(data);
+    if (!ok) return false;
+
+    state.roomId = strings[0];
+    state.roomName = strings[1];
+    state.snapshot = QJsonArray();
+    for (const QJsonObject &operation : std::as_const(sections[S_Snapshot])) {
+        state.snapshot.append(operation);
+    }
+    state.undoStack = sections[S_Undo];
+    state.redoStack = sections[S_Redo];
+    return true;
+}
+
+bool SnapshotFile::readSection(const uchar *data, qint64 size, const uchar *entry,
+                               const QVector<QString> &strings, QList<QJsonObject> &records)
+{
+    const quint64 count = qFromLittleEndian<quint32>(entry);
+    const quint64 indexOffset = qFromLittleEndian<quint64>(entry + 8);
+    if (indexOffset > static_cast<quint64>(size) ||
+        (count + 1) > (static_cast<quint64>(size) - indexOffset) / sizeof(quint64)) {
+        return false;
+    }
+
+    const uchar *index = data + indexOffset;
+    records.reserve(static_cast<qsizetype>(count));
+    for (quint64 i = 0; i < count; ++i) {
+        const quint64 begin = qFromLittleEndian<quint64>(index + i * sizeof(quint64));
+        const quint64 end = qFromLittleEndian<quint64>(index + (i + 1) * sizeof(quint64));
+        if (begin > end || end > static_cast<quint64>(size)) return false;
+
+        Reader in{data + begin, data + end};
+        QJsonValue value;
+        if (!readValue(in, strings, 0, value) || !value.isObject()) return false;
+        records.append(value.toObject());
+    }
+    return true;
+}
+
+void SnapshotFile::writeVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+void SnapshotFile::writeValue(Writer &writer, QByteArray &out, const QJsonValue &value)
+{
+    switch (value.type()) {
+    case QJsonValue::Bool:
+        out.append(static_cast<char>(value.toBool() ? VT_True : VT_False));
+        break;
+    case QJsonValue::Double: {
+        const double number = value.toDouble();
+        if (std::floor(number) == number && std::fabs(number) <= MaxExactInteger) {
+            const qint64 integer = static_cast<qint64>(number);
+            out.append(static_cast<char>(VT_Int));
+            writeVarint(out, (static_cast<quint64>(integer) << 1) ^ static_cast<quint64>(integer >> 63));
+        } else {
+            quint64 bits;
+            std::memcpy(&bits, &number, sizeof(bits));
+            out.append(static_cast<char>(VT_Double));
+            appendUInt64(out, bits);
+        }
+        break;
+    }
+    case QJsonValue::String: {
+        const QString str = value.toString();
+        if (str.size() <= MaxInternedLength) {
+            out.append(static_cast<char>(VT_StringRef));
+            writeVarint(out, writer.intern(str));
+        } else {
+            const QByteArray utf8 = str.toUtf8();
+            out.append(static_cast<char>(VT_String));
+            writeVarint(out, static_cast<quint64>(utf8.size()));
+            out.append(utf8);
+        }
+        break;
+    }
+    case QJsonValue::Array: {
+        const QJsonArray array = value.toArray();
+        out.append(static_cast<char>(VT_Array));
+        writeVarint(out, static_cast<quint64>(array.size()));
+        for (const QJsonValue &item : array) {
+            writeValue(writer, out, item);
+        }
+        break;
+    }
+    case QJsonValue::Object: {
+        const QJsonObject object = value.toObject();
+        out.append(static_cast<char>(VT_Object));
+        writeVarint(out, static_cast<quint64>(object.size()));
+        for (auto it = object.begin(); it != object.end(); ++it) {
+            writeVarint(out, writer.intern(it.key()));
+            writeValue(writer, out, it.value());
+        }
+        break;
+    }
+    default:
+        out.append(static_cast<char>(VT_Null));
+        break;
+    }
+}
+
+bool SnapshotFile::readVarint(Reader &in, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (in.pos >= in.end) return false;
+        const uchar byte = *in.pos++;
+        value |= static_cast<quint64>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool SnapshotFile::readString(Reader &in, QString &str)
+{
+    quint64 length = 0;
+    if (!readVarint(in, length)) return false;
+    if (length > static_cast<quint64>(in.end - in.pos)) return false;
+    str = QString::fromUtf8(reinterpret_cast<const char*>(in.pos), static_cast<qsizetype>(length));
+    in.pos += length;
+    return true;
+}
+
+bool SnapshotFile::readValue(Reader &in, const QVector<QString> &strings, int depth, QJsonValue &value)
+{
+    if (depth > MaxNestingDepth || in.pos >= in.end) return false;
+
+    switch (*in.pos++) {
+    case VT_Null:
+        value = QJsonValue();
+        return true;
+    case VT_False:
+        value = false;
+        return true;
+    case VT_True:
+        value = true;
+        return true;
+    case VT_Int: {
+        quint64 raw = 0;
+        if (!readVarint(in, raw)) return false;
+        value = static_cast<qint64>(raw >> 1) ^ -static_cast<qint64>(raw & 1);
+        return true;
+    }
+    case VT_Double: {
+        if (in.end - in.pos < 8) return false;
+        const quint64 bits = qFromLittleEndian<quint64>(in.pos);
+        double number;
+        std::memcpy(&number, &bits, sizeof(number));
+        in.pos += 8;
+        value = number;
+        return true;
+    }
+    case VT_StringRef: {
+        quint64 index = 0;
+        if (!readVarint(in, index) || index >= static_cast<quint64>(strings.size())) return false;
+        value = strings[index];
+        return true;
+    }
+    case VT_String: {
+        QString str;
+        if (!readString(in, str)) return false;
+        value = str;
+        return true;
+    }
+    case VT_Array: {
+        quint64 count = 0;
+        if (!readVarint(in, count)) return false;
+        if (count > static_cast<quint64>(in.end - in.pos)) return false;
+        QJsonArray array;
+        for (quint64 i = 0; i < count; ++i) {
+            QJsonValue item;
+            if (!readValue(in, strings, depth + 1, item)) return false;
+            array.append(item);
+        }
+        value = array;
+        return true;
+    }
+    case VT_Object: {
+        quint64 count = 0;
+        if (!readVarint(in, count)) return false;
+        if (count > static_cast<quint64>(in.end - in.pos)) return false;
+        QJsonObject object;
+        for (quint64 i = 0; i < count; ++i) {
+            quint64 key = 0;
+            QJsonValue item;
+            if (!readVarint(in, key) || key >= static_cast<quint64>(strings.size()) ||
+                !readValue(in, strings, depth + 1, item)) {
+                return false;
+            }
+            object.insert(strings[key], item);
+        }
+        value = object;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
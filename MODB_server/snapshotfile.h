@@ -0,0 +1,93 @@
+﻿#ifndef SNAPSHOTFILE_H
+#define SNAPSHOTFILE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+
+// 房间的完整状态，用于持久化和恢复
+struct RoomState {
+    QString roomId;
+    QString roomName;
+    QJsonArray snapshot;                // 快照中的绘图操作
+    QJsonArray history;                 // 快照之后的绘图操作
+    QList<QJsonObject> undoStack;
+    QList<QJsonObject> redoStack;
+};
+
+// 二进制房间快照文件，读取时映射文件（QFile::map）直接解码，不经过JSON文本解析
+// 文件格式（小端）:
+//   [文件头] magic "MODBSNAP", version, 字符串数量, 字符串表偏移,
+//            3个分区（快照操作、撤销栈、重做栈）各自的 {记录数量, 索引偏移}
+//   [字符串表] varint长度 + UTF-8，0号为房间号，1号为房间名称
+//   [分区索引] 每个分区 记录数量+1 个quint64文件偏移，第i条记录为 [offset[i], offset[i+1])
+//   [记录] 与 BinaryCodec 相同的值编码，对象的键和短字符串为字符串表下标
+// 启动时只用readHeader读取文件头和前两个字符串；房间第一次被加入时read()一次解码三个分区的全部记录，
+// 解码完成后解除映射，之后不再引用文件
+class SnapshotFile
+{
+public:
+    static constexpr quint32 FormatVersion = 2;
+
+    static QByteArray encode(const RoomState &state);
+    // 只读取房间号和房间名称
+    static bool readHeader(const QString &fileName, QString &roomId, QString &roomName);
+    // 读取并解码完整的快照和撤销/重做栈（不包括操作日志）
+    static bool read(const QString &fileName, RoomState &state);
+    // 判断文件内容是否为二进制快照（旧版本的快照为JSON）
+    static bool isSnapshotFile(const QByteArray &head);
+
+private:
+    enum Section {
+        S_Snapshot = 0,
+        S_Undo,
+        S_Redo,
+        SectionCount
+    };
+
+    enum ValueTag : quint8 {
+        VT_Null = 0,
+        VT_False,
+        VT_True,
+        VT_Int,             // zigzag varint
+        VT_Double,          // 8字节小端
+        VT_StringRef,       // 字符串表下标
+        VT_String,          // 内联字符串（较长的字符串，例如编码后的路径）
+        VT_Array,
+        VT_Object           // 键为字符串表下标
+    };
+
+    static constexpr int HeaderSize = 24 + SectionCount * 16;
+    // 不超过该长度的字符串放入字符串表
+    static constexpr int MaxInternedLength = 64;
+
+    struct Writer {
+        QByteArray strings;
+        QHash<QString, quint64> index;
+        quint64 count = 0;
+        quint64 intern(const QString &str);
+        // 不去重，直接追加
+        quint64 append(const QString &str);
+    };
+
+    struct Reader {
+        const uchar *pos;
+        const uchar *end;
+    };
+
+    static void writeVarint(QByteArray &out, quint64 value);
+    static void writeValue(Writer &writer, QByteArray &out, const QJsonValue &value);
+
+    static bool readVarint(Reader &in, quint64 &value);
+    static bool readString(Reader &in, QString &str);
+    static bool readValue(Reader &in, const QVector<QString> &strings, int depth, QJsonValue &value);
+    static bool readSection(const uchar *data, qint64 size, const uchar *entry,
+                            const QVector<QString> &strings, QList<QJsonObject> &records);
+};
+
+#endif // SNAPSHOTFILE_H
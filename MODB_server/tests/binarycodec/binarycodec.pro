@@ -0,0 +1,18 @@
+# BinaryCodec 二进制帧编解码测试
+QT       = core gui testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_binarycodec
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_binarycodec.cpp \
+    ../../binaryprotocol.cpp \
+    ../../networkprotocol.cpp
+
+HEADERS += \
+    ../../binaryprotocol.h \
+    ../../networkprotocol.h
@@ -0,0 +1,270 @@
+﻿#include <QtTest>
+#include <QPainterPath>
+#include "binaryprotocol.h"
+
+// 帧中的值标签，和 BinaryCodec::ValueTag 保持一致，用于手工构造异常帧
+namespace {
+const char TagNull = 0;
+const char TagArray = 6;
+const char TagPathBlob = 8;
+const char TagUnknown = 9;
+
+// 帧头：magic、版本、消息类型1、空的senderId、时间戳0
+QByteArray frameHeader()
+{
+    QByteArray frame;
+    frame.append(static_cast<char>(BinaryCodec::FrameMagic));
+    frame.append(static_cast<char>(BinaryCodec::FrameVersion));
+    frame.append('\x01');
+    frame.append('\x00');
+    frame.append('\x00');
+    return frame;
+}
+
+NetworkMessage sampleMessage()
+{
+    QPainterPath path;
+    path.moveTo(1.5, -2.25);
+    path.lineTo(100.01, 200.02);
+    path.cubicTo(10, 20, 30, 40, 50, 60);
+
+    NetworkMessage message;
+    message.type = MT_DrawingOperation;
+    message.senderId = QStringLiteral("用户-42");
+    message.timestamp = -1234567890123LL;
+    message.data = QJsonObject{
+        {"operationId", "abc.1z"},
+        {"opType", DOT_EndStroke},
+        {"null", QJsonValue()},
+        {"flags", QJsonArray{true, false}},
+        {"negative", -300},
+        {"large", 4503599627370497.0},
+        {"fraction", 0.1},
+        {"text", QStringLiteral("白板 ✓")},
+        {"nested", QJsonObject{{"list", QJsonArray{1, QJsonArray{2, "三"}, QJsonObject{}}}}},
+        {"path", DrawingOperation::encodePath(path)}
+    };
+    return message;
+}
+}
+
+class tst_BinaryCodec : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void roundTripEmptyMessage();
+    void pathBlobIsCarriedRaw();
+    void nonCanonicalPathStaysObject();
+    void rejectsBadMagicAndVersion();
+    void rejectsEveryTruncation();
+    void rejectsTrailingBytes();
+    void rejectsOversizedLengths();
+    void rejectsUnknownTag();
+    void rejectsDeepNesting();
+    void rejectsCorruptPathBlob();
+};
+
+void tst_BinaryCodec::roundTrip()
+{
+    const NetworkMessage message = sampleMessage();
+    NetworkMessage decoded;
+    QVERIFY(BinaryCodec::decode(BinaryCodec::encode(message), decoded));
+    QCOMPARE(decoded.type, message.type);
+    QCOMPARE(decoded.senderId, message.senderId);
+    QCOMPARE(decoded.timestamp, message.timestamp);
+    QCOMPARE(decoded.data, message.data);
+}
+
+void tst_BinaryCodec::roundTripEmptyMessage()
+{
+    NetworkMessage message;
+    NetworkMessage decoded;
+    decoded.senderId = "stale";
+    QVERIFY(BinaryCodec::decode(BinaryCodec::encode(message), decoded));
+    QCOMPARE(decoded.type, MT_Unknown);
+    QVERIFY(decoded.senderId.isEmpty());
+    QCOMPARE(decoded.timestamp, qint64(0));
+    QVERIFY(decoded.data.isEmpty());
+}
+
+void tst_BinaryCodec::pathBlobIsCarriedRaw()
+{
+    QPainterPath path;
+    path.moveTo(0, 0);
+    for (int i = 1; i < 200; ++i) {
+        path.lineTo(i * 0.5, i * 0.25);
+    }
+    const QJsonObject encoded = DrawingOperation::encodePath(path).toObject();
+    const QString base64 = encoded["data"].toString();
+
+    NetworkMessage message(MT_DrawingOperation, QJsonObject{{"path", encoded}});
+    const QByteArray frame = BinaryCodec::encode(message);
+    // 二进制帧携带原始差分字节，不包含base64文本
+    QVERIFY(!frame.contains(base64.toLatin1()));
+    QVERIFY(frame.size() < base64.size());
+
+    NetworkMessage decoded;
+    QVERIFY(BinaryCodec::decode(frame, decoded));
+    QCOMPARE(decoded.data["path"].toObject(), encoded);
+}
+
+void tst_BinaryCodec::nonCanonicalPathStaysObject()
+{
+    // 看起来像路径但不是encodePath的输出时按普通对象编码，解码后保持原样
+    const QList<QJsonObject> objects = {
+        QJsonObject{{"enc", "qdelta"}, {"v", 1}, {"n", 1}, {"data", "AAAA\n"}},
+        QJsonObject{{"enc", "qdelta"}, {"v", 1}, {"n", 1}, {"data", "AAA"}},
+        QJsonObject{{"enc", "qdelta"}, {"v", 1.5}, {"n", 1}, {"data", "AAAA"}},
+        QJsonObject{{"enc", "qdelta"}, {"v", -1}, {"n", 1}, {"data", "AAAA"}},
+        QJsonObject{{"enc", "qdelta"}, {"v", 1}, {"n", "1"}, {"data", "AAAA"}},
+        QJsonObject{{"enc", "qdelta"}, {"v", 1}, {"n", 1}, {"data", "AAAA"}, {"extra", true}},
+        QJsonObject{{"enc", "other"}, {"v", 1}, {"n", 1}, {"data", "AAAA"}}
+    };
+    for (const QJsonObject &object : objects) {
+        NetworkMessage decoded;
+        QVERIFY(BinaryCodec::decode(BinaryCodec::encode(NetworkMessage(MT_DrawingOperation, QJsonObject{{"path", object}})), decoded));
+        QCOMPARE(decoded.data["path"].toObject(), object);
+    }
+}
+
+void tst_BinaryCodec::rejectsBadMagicAndVersion()
+{
+    const QByteArray frame = BinaryCodec::encode(sampleMessage());
+    NetworkMessage decoded;
+
+    QByteArray badMagic = frame;
+    badMagic[0] = static_cast<char>(BinaryCodec::FrameMagic ^ 0xFF);
+    QVERIFY(!BinaryCodec::decode(badMagic, decoded));
+
+    QByteArray oldVersion = frame;
+    oldVersion[1] = static_cast<char>(BinaryCodec::FrameVersion - 1);
+    QVERIFY(!BinaryCodec::decode(oldVersion, decoded));
+
+    QByteArray newVersion = frame;
+    newVersion[1] = static_cast<char>(BinaryCodec::FrameVersion + 1);
+    QVERIFY(!BinaryCodec::decode(newVersion, decoded));
+
+    // JSON文本不是二进制帧
+    QVERIFY(!BinaryCodec::decode(QByteArray("{\"type\":6}"), decoded));
+}
+
+void tst_BinaryCodec::rejectsEveryTruncation()
+{
+    const QByteArray frame = BinaryCodec::encode(sampleMessage());
+    for (int length = 0; length < frame.size(); ++length) {
+        NetworkMessage decoded;
+        QVERIFY2(!BinaryCodec::decode(frame.left(length), decoded),
+                 qPrintable(QString("截断到%1字节").arg(length)));
+    }
+}
+
+void tst_BinaryCodec::rejectsTrailingBytes()
+{
+    QByteArray frame = BinaryCodec::encode(sampleMessage());
+    frame.append('\x00');
+    NetworkMessage decoded;
+    QVERIFY(!BinaryCodec::decode(frame, decoded));
+}
+
+void tst_BinaryCodec::rejectsOversizedLengths()
+{
+    NetworkMessage decoded;
+
+    // senderId长度远大于剩余字节
+    QByteArray sender;
+    sender.append(static_cast<char>(BinaryCodec::FrameMagic));
+    sender.append(static_cast<char>(BinaryCodec::FrameVersion));
+    sender.append('\x01');
+    sender.append(QByteArray::fromHex("ffffffff0f"));
+    sender.append("abc");
+    QVERIFY(!BinaryCodec::decode(sender, decoded));
+
+    // 对象成员数量远大于剩余字节
+    QByteArray members = frameHeader();
+    members.append(QByteArray::fromHex("ffffffffffffffffff01"));
+    QVERIFY(!BinaryCodec::decode(members, decoded));
+
+    // 数组元素数量远大于剩余字节
+    QByteArray elements = frameHeader();
+    elements.append('\x01');
+    elements.append("\x01" "a", 2);
+    elements.append(TagArray);
+    elements.append(QByteArray::fromHex("ffffff7f"));
+    elements.append(TagNull);
+    QVERIFY(!BinaryCodec::decode(elements, decoded));
+
+    // varint超过10字节
+    QByteArray varint = frameHeader();
+    varint.append(QByteArray(11, '\x80'));
+    QVERIFY(!BinaryCodec::decode(varint, decoded));
+}
+
+void tst_BinaryCodec::rejectsUnknownTag()
+{
+    QByteArray frame = frameHeader();
+    frame.append('\x01');
+    frame.append("\x01" "a", 2);
+    frame.append(TagUnknown);
+    NetworkMessage decoded;
+    QVERIFY(!BinaryCodec::decode(frame, decoded));
+}
+
+void tst_BinaryCodec::rejectsDeepNesting()
+{
+    auto nestedFrame = [](int depth) {
+        QByteArray frame = frameHeader();
+        frame.append('\x01');
+        frame.append("\x01" "a", 2);
+        for (int i = 0; i < depth; ++i) {
+            frame.append(TagArray);
+            frame.append('\x01');
+        }
+        frame.append(TagNull);
+        return frame;
+    };
+
+    NetworkMessage decoded;
+    QVERIFY(BinaryCodec::decode(nestedFrame(8), decoded));
+    QVERIFY(!BinaryCodec::decode(nestedFrame(64), decoded));
+    QVERIFY(!BinaryCodec::decode(nestedFrame(100000), decoded));
+}
+
+void tst_BinaryCodec::rejectsCorruptPathBlob()
+{
+    NetworkMessage decoded;
+
+    // 差分字节长度超过帧的剩余字节
+    QByteArray longBlob = frameHeader();
+    longBlob.append('\x01');
+    longBlob.append("\x04" "path", 5);
+    longBlob.append(TagPathBlob);
+    longBlob.append("\x01\x01\x7f", 3);
+    longBlob.append("\x00\x00\x00", 3);
+    QVERIFY(!BinaryCodec::decode(longBlob, decoded));
+
+    // 元素数量超过JSON能精确表示的整数
+    QByteArray hugeCount = frameHeader();
+    hugeCount.append('\x01');
+    hugeCount.append("\x04" "path", 5);
+    hugeCount.append(TagPathBlob);
+    hugeCount.append('\x01');
+    hugeCount.append(QByteArray::fromHex("ffffffffffffffffff01"));
+    hugeCount.append('\x00');
+    QVERIFY(!BinaryCodec::decode(hugeCount, decoded));
+
+    // 合法的空路径
+    QByteArray empty = frameHeader();
+    empty.append('\x01');
+    empty.append("\x04" "path", 5);
+    empty.append(TagPathBlob);
+    empty.append("\x01\x00\x00", 3);
+    QVERIFY(BinaryCodec::decode(empty, decoded));
+    const QJsonObject expected{{"enc", "qdelta"}, {"v", 1}, {"n", 0}, {"data", ""}};
+    QCOMPARE(decoded.data["path"].toObject(), expected);
+}
+
+QTEST_GUILESS_MAIN(tst_BinaryCodec)
+
+#include "tst_binarycodec.moc"
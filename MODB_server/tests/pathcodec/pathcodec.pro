@@ -0,0 +1,16 @@
+# DrawingOperation::encodePath/decodePath 路径编解码测试
+QT       = core gui testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_pathcodec
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_pathcodec.cpp \
+    ../../networkprotocol.cpp
+
+HEADERS += \
+    ../../networkprotocol.h
@@ -0,0 +1,185 @@
+﻿#include <QtTest>
+#include <QPainterPath>
+#include "networkprotocol.h"
+
+namespace {
+// 坐标量化到1/PathCoordScale像素，解码误差不超过半个量化单位
+const qreal Tolerance = 0.5 / DrawingOperation::PathCoordScale + 1e-9;
+
+void comparePaths(const QPainterPath &actual, const QPainterPath &expected)
+{
+    QCOMPARE(actual.elementCount(), expected.elementCount());
+    for (int i = 0; i < expected.elementCount(); ++i) {
+        const QPainterPath::Element a = actual.elementAt(i);
+        const QPainterPath::Element e = expected.elementAt(i);
+        QCOMPARE(a.type, e.type);
+        QVERIFY2(qAbs(a.x - e.x) <= Tolerance && qAbs(a.y - e.y) <= Tolerance,
+                 qPrintable(QString("第%1个元素 (%2, %3) != (%4, %5)").arg(i).arg(a.x).arg(a.y).arg(e.x).arg(e.y)));
+    }
+}
+
+QJsonObject encodedObject(const QPainterPath &path)
+{
+    return DrawingOperation::encodePath(path).toObject();
+}
+}
+
+class tst_PathCodec : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void encodingFormat();
+    void legacyPointArray();
+    void rejectsUnknownEncoding();
+    void rejectsNewerVersion();
+    void rejectsTruncatedData();
+    void rejectsCorruptVarint();
+};
+
+void tst_PathCodec::roundTrip_data()
+{
+    QTest::addColumn<QPainterPath>("path");
+
+    QTest::newRow("empty") << QPainterPath();
+
+    QPainterPath single;
+    single.moveTo(12.34, -56.78);
+    QTest::newRow("single point") << single;
+
+    QPainterPath stroke;
+    stroke.moveTo(0, 0);
+    for (int i = 1; i < 500; ++i) {
+        stroke.lineTo(i * 0.37, qSin(i * 0.1) * 80.0);
+    }
+    QTest::newRow("long stroke") << stroke;
+
+    QPainterPath curves;
+    curves.moveTo(10, 10);
+    curves.cubicTo(20.5, -30.25, 40.125, 50, 60, 70);
+    curves.lineTo(-1000000.01, 1000000.01);
+    curves.cubicTo(0, 0, 1, 1, 2, 2);
+    QTest::newRow("curves and far points") << curves;
+
+    QPainterPath subpaths;
+    subpaths.moveTo(1, 1);
+    subpaths.lineTo(2, 2);
+    subpaths.moveTo(-3, -3);
+    subpaths.lineTo(-4, -4);
+    QTest::newRow("subpaths") << subpaths;
+}
+
+void tst_PathCodec::roundTrip()
+{
+    QFETCH(QPainterPath, path);
+
+    QPainterPath decoded;
+    QVERIFY(DrawingOperation::decodePath(DrawingOperation::encodePath(path), decoded));
+    comparePaths(decoded, path);
+}
+
+void tst_PathCodec::encodingFormat()
+{
+    QPainterPath path;
+    path.moveTo(1, 2);
+    path.lineTo(3, 4);
+
+    const QJsonObject encoded = encodedObject(path);
+    QCOMPARE(encoded.size(), 4);
+    QCOMPARE(encoded["enc"].toString(), QString("qdelta"));
+    QCOMPARE(encoded["v"].toInt(), DrawingOperation::PathEncodingVersion);
+    QCOMPARE(encoded["n"].toInt(), 2);
+
+    // 每个元素：类型varint、x差分、y差分（zigzag varint）
+    // (1, 2) -> 100, 200；(3, 4) -> 差分200, 200
+    QCOMPARE(QByteArray::fromBase64(encoded["data"].toString().toLatin1()),
+             QByteArray::fromHex("00c801900301900390" "03"));
+}
+
+void tst_PathCodec::legacyPointArray()
+{
+    const QJsonArray points{
+        QJsonObject{{"x", 1.0}, {"y", 2.0}, {"type", QPainterPath::MoveToElement}},
+        QJsonObject{{"x", 3.5}, {"y", 4.5}, {"type", QPainterPath::LineToElement}}
+    };
+    QPainterPath decoded;
+    QVERIFY(DrawingOperation::decodePath(points, decoded));
+
+    QPainterPath expected;
+    expected.moveTo(1, 2);
+    expected.lineTo(3.5, 4.5);
+    comparePaths(decoded, expected);
+}
+
+void tst_PathCodec::rejectsUnknownEncoding()
+{
+    QPainterPath path;
+    path.moveTo(1, 1);
+    QJsonObject encoded = encodedObject(path);
+    encoded["enc"] = "gzip";
+
+    QPainterPath decoded;
+    decoded.moveTo(5, 5);
+    QVERIFY(!DrawingOperation::decodePath(encoded, decoded));
+    QVERIFY(!DrawingOperation::decodePath(QJsonValue("qdelta"), decoded));
+    QVERIFY(!DrawingOperation::decodePath(QJsonValue(), decoded));
+}
+
+void tst_PathCodec::rejectsNewerVersion()
+{
+    QPainterPath path;
+    path.moveTo(1, 1);
+    QJsonObject encoded = encodedObject(path);
+    encoded["v"] = DrawingOperation::PathEncodingVersion + 1;
+
+    QPainterPath decoded;
+    QVERIFY(!DrawingOperation::decodePath(encoded, decoded));
+}
+
+void tst_PathCodec::rejectsTruncatedData()
+{
+    QPainterPath path;
+    path.moveTo(0, 0);
+    for (int i = 1; i < 20; ++i) {
+        path.lineTo(i * 3.3, i * -7.7);
+    }
+    const QJsonObject encoded = encodedObject(path);
+    const QByteArray blob = QByteArray::fromBase64(encoded["data"].toString().toLatin1());
+
+    // 差分字节在任意位置截断都不能解码，也不能留下解码了一半的路径
+    for (int length = 0; length < blob.size(); ++length) {
+        QJsonObject truncated = encoded;
+        truncated["data"] = QString::fromLatin1(blob.left(length).toBase64());
+        QPainterPath decoded;
+        QVERIFY2(!DrawingOperation::decodePath(truncated, decoded),
+                 qPrintable(QString("截断到%1字节").arg(length)));
+        QVERIFY(decoded.isEmpty());
+    }
+
+    // 元素数量大于实际携带的元素
+    QJsonObject overCount = encoded;
+    overCount["n"] = path.elementCount() + 1;
+    QPainterPath decoded;
+    QVERIFY(!DrawingOperation::decodePath(overCount, decoded));
+    QVERIFY(decoded.isEmpty());
+}
+
+void tst_PathCodec::rejectsCorruptVarint()
+{
+    // 超过10字节的varint
+    const QJsonObject encoded{
+        {"enc", "qdelta"},
+        {"v", DrawingOperation::PathEncodingVersion},
+        {"n", 1},
+        {"data", QString::fromLatin1(QByteArray(16, '\x80').toBase64())}
+    };
+    QPainterPath decoded;
+    QVERIFY(!DrawingOperation::decodePath(encoded, decoded));
+    QVERIFY(decoded.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(tst_PathCodec)
+
+#include "tst_pathcodec.moc"
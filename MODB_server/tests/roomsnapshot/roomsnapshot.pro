@@ -0,0 +1,18 @@
+# RoomSnapshot::fold 历史折叠测试
+QT       = core gui testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_roomsnapshot
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_roomsnapshot.cpp \
+    ../../networkprotocol.cpp \
+    ../../roomsnapshot.cpp
+
+HEADERS += \
+    ../../networkprotocol.h \
+    ../../roomsnapshot.h
@@ -0,0 +1,230 @@
+﻿#include <QtTest>
+#include <QPainterPath>
+#include "roomsnapshot.h"
+
+namespace {
+QJsonObject shapeOp(const QString &id, DrawingOperationType type, qreal x, qreal y, qreal w, qreal h)
+{
+    return QJsonObject{
+        {"operationId", id},
+        {"opType", type},
+        {"data", QJsonObject{{"x", x}, {"y", y}, {"width", w}, {"height", h}, {"penWidth", 2}}}
+    };
+}
+
+QJsonObject strokeOp(const QString &id, const QPainterPath &path)
+{
+    return QJsonObject{
+        {"operationId", id},
+        {"opType", DOT_EndStroke},
+        {"data", QJsonObject{{"path", DrawingOperation::encodePath(path)}, {"penWidth", 2}}}
+    };
+}
+
+QJsonObject textOp(const QString &id, qreal x, qreal y)
+{
+    return QJsonObject{
+        {"operationId", id},
+        {"opType", DOT_AddText},
+        {"data", QJsonObject{{"x", x}, {"y", y}, {"content", "标注"}, {"fontSize", 12}}}
+    };
+}
+
+QJsonObject eraseAt(qreal x, qreal y, qreal size, const QString &id = "erase")
+{
+    return QJsonObject{
+        {"operationId", id},
+        {"opType", DOT_Erase},
+        {"data", QJsonObject{{"positionX", x}, {"positionY", y}, {"eraserSize", size}}}
+    };
+}
+
+QJsonObject eraseIds(const QJsonArray &itemIds, const QString &id = "erase")
+{
+    return QJsonObject{
+        {"operationId", id},
+        {"opType", DOT_Erase},
+        {"data", QJsonObject{{"itemIds", itemIds}, {"positionX", 0}, {"positionY", 0}, {"eraserSize", 100000}}}
+    };
+}
+
+QStringList ids(const QJsonArray &operations)
+{
+    QStringList result;
+    for (const QJsonValue &value : operations) {
+        result.append(value.toObject()["operationId"].toString());
+    }
+    return result;
+}
+}
+
+class tst_RoomSnapshot : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void keepsOperationsInOrder();
+    void skipsRemovedSlots();
+    void eraseByIdsIgnoresGeometry();
+    void eraseHitsShapesUnderEraser();
+    void eraseHitsStrokeOnlyNearPath();
+    void eraseNearTextIsKept();
+    void foldIsIncremental();
+    void undecodableStrokeIsKept();
+    void heldEraseKeepsErasedItems();
+};
+
+void tst_RoomSnapshot::keepsOperationsInOrder()
+{
+    const QJsonArray snapshot{shapeOp("a", DOT_DrawRectangle, 0, 0, 10, 10)};
+    const QJsonArray tail{shapeOp("b", DOT_DrawEllipse, 20, 20, 10, 10), textOp("c", 50, 50)};
+
+    const QJsonArray folded = RoomSnapshot::fold(snapshot, tail);
+    QCOMPARE(ids(folded), QStringList({"a", "b", "c"}));
+    // 折叠结果仍然是原样的绘图操作
+    QCOMPARE(folded[1].toObject(), tail[0].toObject());
+}
+
+void tst_RoomSnapshot::skipsRemovedSlots()
+{
+    // 按id撤销在快照和尾部中留下的空位
+    const QJsonArray snapshot{shapeOp("a", DOT_DrawRectangle, 0, 0, 10, 10), QJsonValue()};
+    const QJsonArray tail{QJsonValue(), shapeOp("b", DOT_DrawRectangle, 20, 20, 10, 10)};
+
+    QCOMPARE(ids(RoomSnapshot::fold(snapshot, tail)), QStringList({"a", "b"}));
+}
+
+void tst_RoomSnapshot::eraseByIdsIgnoresGeometry()
+{
+    const QJsonArray snapshot{
+        shapeOp("a", DOT_DrawRectangle, 0, 0, 10, 10),
+        shapeOp("b", DOT_DrawRectangle, 1000, 1000, 10, 10)
+    };
+    const QJsonArray tail{
+        shapeOp("c", DOT_DrawRectangle, 2000, 2000, 10, 10),
+        textOp("t", 5, 5),
+        // 擦除区域覆盖所有图形，但只擦除客户端指定的图形，未知的id忽略
+        eraseIds(QJsonArray{"a", "c", "missing"})
+    };
+
+    QCOMPARE(ids(RoomSnapshot::fold(snapshot, tail)), QStringList({"b", "t"}));
+}
+
+void tst_RoomSnapshot::eraseHitsShapesUnderEraser()
+{
+    const QJsonArray tail{
+        shapeOp("inside", DOT_DrawRectangle, 0, 0, 100, 100),
+        shapeOp("far", DOT_DrawEllipse, 500, 500, 50, 50),
+        // 橡皮擦在矩形内部：未填充的矩形擦中内部也会被擦除
+        eraseAt(50, 50, 10)
+    };
+
+    // 擦除操作本身不保留
+    QCOMPARE(ids(RoomSnapshot::fold(QJsonArray(), tail)), QStringList({"far"}));
+}
+
+void tst_RoomSnapshot::eraseHitsStrokeOnlyNearPath()
+{
+    QPainterPath diagonal;
+    diagonal.moveTo(0, 0);
+    diagonal.lineTo(100, 100);
+    QPainterPath horizontal;
+    horizontal.moveTo(0, 200);
+    horizontal.lineTo(100, 200);
+
+    const QJsonArray tail{
+        strokeOp("diagonal", diagonal),
+        strokeOp("horizontal", horizontal),
+        // 在对角线笔画的包围盒内但远离笔画本身
+        eraseAt(90, 10, 6),
+        // 压在水平笔画上
+        eraseAt(50, 200, 6)
+    };
+
+    QCOMPARE(ids(RoomSnapshot::fold(QJsonArray(), tail)), QStringList({"diagonal"}));
+}
+
+void tst_RoomSnapshot::eraseNearTextIsKept()
+{
+    // 文本大小取决于客户端字体，擦除操作保留下来由客户端判断
+    const QJsonObject erase = eraseAt(10, 10, 10);
+    const QJsonArray tail{textOp("t", 0, 0), erase};
+
+    const QJsonArray folded = RoomSnapshot::fold(QJsonArray(), tail);
+    QCOMPARE(ids(folded), QStringList({"t", "erase"}));
+    QCOMPARE(folded[1].toObject(), erase);
+
+    // 远离文本的擦除仍然丢弃
+    QCOMPARE(ids(RoomSnapshot::fold(QJsonArray(), QJsonArray{textOp("t", 0, 0), eraseAt(5000, 5000, 10)})),
+             QStringList({"t"}));
+}
+
+void tst_RoomSnapshot::foldIsIncremental()
+{
+    QPainterPath stroke;
+    stroke.moveTo(0, 0);
+    stroke.lineTo(300, 0);
+
+    const QJsonArray first{
+        shapeOp("a", DOT_DrawRectangle, 0, 0, 100, 100),
+        strokeOp("s", stroke),
+        shapeOp("b", DOT_DrawEllipse, 400, 400, 50, 50)
+    };
+    const QJsonArray second{
+        eraseAt(200, 0, 10),
+        shapeOp("c", DOT_DrawRectangle, 600, 600, 10, 10),
+        eraseIds(QJsonArray{"a"})
+    };
+
+    QJsonArray all = first;
+    for (const QJsonValue &value : second) {
+        all.append(value);
+    }
+
+    // 分两次折叠和一次折叠全部历史的结果一致
+    const QJsonArray once = RoomSnapshot::fold(QJsonArray(), all);
+    const QJsonArray twice = RoomSnapshot::fold(RoomSnapshot::fold(QJsonArray(), first), second);
+    QCOMPARE(ids(once), QStringList({"b", "c"}));
+    QCOMPARE(twice, once);
+}
+
+void tst_RoomSnapshot::undecodableStrokeIsKept()
+{
+    // 路径解析不了的笔画原样保留，不会被按位置擦除
+    const QJsonObject broken{
+        {"operationId", "s"},
+        {"opType", DOT_EndStroke},
+        {"data", QJsonObject{{"path", "not a path"}, {"penWidth", 2}}}
+    };
+    const QJsonArray tail{broken, eraseAt(0, 0, 100000)};
+
+    const QJsonArray folded = RoomSnapshot::fold(QJsonArray(), tail);
+    QCOMPARE(ids(folded), QStringList({"s"}));
+    QCOMPARE(folded[0].toObject(), broken);
+}
+
+void tst_RoomSnapshot::heldEraseKeepsErasedItems()
+{
+    const QJsonArray tail{
+        shapeOp("a", DOT_DrawRectangle, 0, 0, 10, 10),
+        shapeOp("b", DOT_DrawRectangle, 100, 100, 10, 10),
+        eraseIds(QJsonArray{"a"}, "e1"),
+        eraseAt(105, 105, 4, "e2"),
+        shapeOp("c", DOT_DrawRectangle, 100, 100, 10, 10)
+    };
+
+    // 作者还可能按id撤销的擦除：擦除操作和被擦除的图形都保留，撤销时服务端能找到这个擦除
+    const QSet<QString> held{"e1", "e2"};
+    const QJsonArray kept = RoomSnapshot::fold(QJsonArray(), tail, held);
+    QCOMPARE(ids(kept), QStringList({"a", "b", "e1", "e2", "c"}));
+
+    // 快照中的擦除只有释放之后才应用，擦除之后画的图形不受影响
+    QCOMPARE(RoomSnapshot::fold(kept, QJsonArray()), kept);
+    const QJsonArray released = RoomSnapshot::fold(kept, QJsonArray(), QSet<QString>(), held);
+    QCOMPARE(ids(released), QStringList({"c"}));
+    QCOMPARE(released, RoomSnapshot::fold(QJsonArray(), tail));
+}
+
+QTEST_GUILESS_MAIN(tst_RoomSnapshot)
+
+#include "tst_roomsnapshot.moc"
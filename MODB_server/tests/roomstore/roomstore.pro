@@ -0,0 +1,21 @@
+# RoomStore 操作日志写入和重放测试
+QT       = core testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_roomstore
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_roomstore.cpp \
+    ../../asynclogger.cpp \
+    ../../roomstore.cpp \
+    ../../snapshotfile.cpp
+
+HEADERS += \
+    ../../asynclogger.h \
+    ../../roomhistory.h \
+    ../../roomstore.h \
+    ../../snapshotfile.h
@@ -0,0 +1,341 @@
+﻿#include <QtTest>
+#include <QTemporaryDir>
+#include "roomstore.h"
+
+namespace {
+const QString RoomId = QStringLiteral("房间-1");
+
+QJsonObject operation(const QString &operationId)
+{
+    return QJsonObject{{"operationId", operationId}, {"opType", 4}};
+}
+
+QStringList ids(const QJsonArray &operations)
+{
+    QStringList result;
+    for (const QJsonValue &value : operations) {
+        result.append(value.toObject()["operationId"].toString());
+    }
+    return result;
+}
+
+QStringList ids(const QList<QJsonObject> &operations)
+{
+    QStringList result;
+    for (const QJsonObject &op : operations) {
+        result.append(op["operationId"].toString());
+    }
+    return result;
+}
+
+// 和 RoomStore::fileBase 的命名一致
+QString walFile(const QTemporaryDir &dir)
+{
+    return dir.filePath(QString::fromLatin1(RoomId.toUtf8().toHex()) + ".wal");
+}
+
+QString snapFile(const QTemporaryDir &dir)
+{
+    return dir.filePath(QString::fromLatin1(RoomId.toUtf8().toHex()) + ".snap");
+}
+}
+
+class tst_RoomStore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void replaysOperationsUndoAndRedo();
+    void redoByIdTakesRequestedEntry();
+    void ignoresUnknownIds();
+    void clearDropsEverything();
+    void roomName();
+    void replaysOnTopOfSnapshot();
+    void snapshotReopensLog();
+    void removeFallsBackToSnapshot();
+    void undoFallsBackToSnapshot();
+    void dropsTornLastLine();
+    void corruptSnapshotKeepsLog();
+};
+
+void tst_RoomStore::replaysOperationsUndoAndRedo()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+
+    store.appendOperation(RoomId, operation("a"));
+    store.appendOperation(RoomId, operation("b"));
+    store.appendOperation(RoomId, operation("c"));
+    store.undoLast(RoomId);
+    store.undoLast(RoomId);
+    store.redoLast(RoomId);
+
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(state.roomId, RoomId);
+    QCOMPARE(ids(state.history), QStringList({"a", "b"}));
+    QCOMPARE(ids(state.undoStack), QStringList({"c"}));
+    QVERIFY(state.snapshot.isEmpty());
+}
+
+void tst_RoomStore::redoByIdTakesRequestedEntry()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+
+    store.appendOperation(RoomId, operation("a"));
+    store.appendOperation(RoomId, operation("b"));
+    store.appendOperation(RoomId, operation("c"));
+    // 两个用户分别撤销了自己的操作a和c
+    store.removeOperation(RoomId, "a");
+    store.undoLast(RoomId);
+    // 撤销a的用户重做：恢复a，而不是栈顶的c
+    store.redoLast(RoomId, "a");
+
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(ids(state.history), QStringList({"b", "a"}));
+    QCOMPARE(ids(state.undoStack), QStringList({"c"}));
+}
+
+void tst_RoomStore::ignoresUnknownIds()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+
+    store.appendOperation(RoomId, operation("a"));
+    store.appendOperation(RoomId, operation("b"));
+    store.undoLast(RoomId);
+    store.removeOperation(RoomId, "missing");
+    store.redoLast(RoomId, "missing");
+
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(ids(state.history), QStringList({"a"}));
+    QCOMPARE(ids(state.undoStack), QStringList({"b"}));
+}
+
+void tst_RoomStore::clearDropsEverything()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+
+    store.appendOperation(RoomId, operation("a"));
+    store.appendOperation(RoomId, operation("b"));
+    store.undoLast(RoomId);
+    store.clearRoom(RoomId);
+    // 清屏之后撤销栈为空，重做不能恢复清屏之前的操作
+    store.redoLast(RoomId);
+    store.appendOperation(RoomId, operation("c"));
+
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(ids(state.history), QStringList({"c"}));
+    QVERIFY(state.undoStack.isEmpty());
+    QVERIFY(state.redoStack.isEmpty());
+}
+
+void tst_RoomStore::roomName()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(state.roomName, QString("Default Room"));
+
+    store.setRoomName(RoomId, "旧名称");
+    store.setRoomName(RoomId, "设计评审");
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(state.roomName, QString("设计评审"));
+}
+
+void tst_RoomStore::replaysOnTopOfSnapshot()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        RoomStore store;
+        QVERIFY(store.open(dir.path()));
+        store.start();
+
+        store.appendOperation(RoomId, operation("old"));
+        RoomState snapshot;
+        snapshot.roomId = RoomId;
+        snapshot.roomName = "快照房间";
+        snapshot.snapshot = QJsonArray{operation("a"), operation("b")};
+        snapshot.undoStack = {operation("u")};
+        store.writeSnapshot(snapshot);
+        store.appendOperation(RoomId, operation("c"));
+    }
+
+    // 重新打开，模拟服务端重启
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+
+    const QList<StoredRoom> rooms = store.scanRooms();
+    QCOMPARE(rooms.size(), 1);
+    QCOMPARE(rooms.first().roomId, RoomId);
+    QCOMPARE(rooms.first().roomName, QString("快照房间"));
+
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(state.roomName, QString("快照房间"));
+    // 快照之前的日志已经截断
+    QCOMPARE(ids(state.snapshot), QStringList({"a", "b"}));
+    QCOMPARE(ids(state.history), QStringList({"c"}));
+    QCOMPARE(ids(state.undoStack), QStringList({"u"}));
+}
+
+void tst_RoomStore::snapshotReopensLog()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+
+    store.appendOperation(RoomId, operation("a"));
+    RoomState snapshot;
+    snapshot.roomId = RoomId;
+    snapshot.snapshot = QJsonArray{operation("a")};
+    store.writeSnapshot(snapshot);
+
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(QFileInfo(walFile(dir)).size(), qint64(0));
+
+    // 快照之后日志文件已经关闭，新的记录重新打开日志追加
+    store.appendOperation(RoomId, operation("b"));
+    store.undoLast(RoomId);
+    store.appendOperation(RoomId, operation("c"));
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(ids(state.snapshot), QStringList({"a"}));
+    QCOMPARE(ids(state.history), QStringList({"c"}));
+    QCOMPARE(ids(state.undoStack), QStringList({"b"}));
+}
+
+void tst_RoomStore::removeFallsBackToSnapshot()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+
+    RoomState snapshot;
+    snapshot.roomId = RoomId;
+    snapshot.snapshot = QJsonArray{operation("a"), operation("b")};
+    store.writeSnapshot(snapshot);
+    store.appendOperation(RoomId, operation("c"));
+    // a已经折叠进快照，按id撤销时从快照中移除
+    store.removeOperation(RoomId, "a");
+    store.redoLast(RoomId, "a");
+    store.removeOperation(RoomId, "a");
+
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(ids(state.snapshot), QStringList({"b"}));
+    QCOMPARE(ids(state.history), QStringList({"c"}));
+    QCOMPARE(ids(state.undoStack), QStringList({"a"}));
+}
+
+void tst_RoomStore::undoFallsBackToSnapshot()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+
+    RoomState snapshot;
+    snapshot.roomId = RoomId;
+    snapshot.snapshot = QJsonArray{operation("a"), operation("b")};
+    store.writeSnapshot(snapshot);
+    store.appendOperation(RoomId, operation("c"));
+    // 先撤销尾部，尾部为空时撤销快照
+    store.undoLast(RoomId);
+    store.undoLast(RoomId);
+
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(ids(state.snapshot), QStringList({"a"}));
+    QVERIFY(state.history.isEmpty());
+    QCOMPARE(ids(state.undoStack), QStringList({"c", "b"}));
+}
+
+void tst_RoomStore::dropsTornLastLine()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        RoomStore store;
+        QVERIFY(store.open(dir.path()));
+        store.start();
+        store.appendOperation(RoomId, operation("a"));
+        store.appendOperation(RoomId, operation("b"));
+    }
+
+    // 崩溃时最后一行只写了一半
+    QFile wal(walFile(dir));
+    QVERIFY(wal.open(QIODevice::Append));
+    wal.write("{\"k\":\"op\",\"op\":{\"operationId\":\"c\"");
+    wal.close();
+
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QCOMPARE(ids(state.history), QStringList({"a", "b"}));
+}
+
+void tst_RoomStore::corruptSnapshotKeepsLog()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        RoomStore store;
+        QVERIFY(store.open(dir.path()));
+        store.start();
+        RoomState snapshot;
+        snapshot.roomId = RoomId;
+        snapshot.snapshot = QJsonArray{operation("a")};
+        store.writeSnapshot(snapshot);
+        store.appendOperation(RoomId, operation("b"));
+    }
+
+    // 快照文件被截断：既不是完整的二进制快照，也不是JSON快照
+    QFile snap(snapFile(dir));
+    QVERIFY(snap.open(QIODevice::ReadWrite));
+    QVERIFY(snap.resize(snap.size() / 2));
+    snap.close();
+
+    RoomStore store;
+    QVERIFY(store.open(dir.path()));
+    store.start();
+    RoomState state;
+    QVERIFY(store.loadRoom(RoomId, state));
+    QVERIFY(state.snapshot.isEmpty());
+    QCOMPARE(ids(state.history), QStringList({"b"}));
+}
+
+QTEST_GUILESS_MAIN(tst_RoomStore)
+
+#include "tst_roomstore.moc"
@@ -0,0 +1,16 @@
+# SnapshotFile 二进制快照文件编解码测试
+QT       = core testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_snapshotfile
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_snapshotfile.cpp \
+    ../../snapshotfile.cpp
+
+HEADERS += \
+    ../../snapshotfile.h
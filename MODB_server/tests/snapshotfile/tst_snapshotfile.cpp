@@ -0,0 +1,267 @@
+﻿#include <QtTest>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include "snapshotfile.h"
+
+namespace {
+// 文件头中的偏移，和 SnapshotFile 的文件格式一致
+const int StringCountOffset = 12;
+const int StringTableOffset = 16;
+const int SectionEntryOffset = 24;
+const int SectionEntrySize = 16;
+
+RoomState sampleState()
+{
+    RoomState state;
+    state.roomId = QStringLiteral("房间-7");
+    state.roomName = QStringLiteral("设计评审");
+    state.snapshot = QJsonArray{
+        QJsonObject{{"operationId", "a"}, {"opType", 4}, {"rect", QJsonObject{{"x", -1.5}, {"y", 2}, {"w", 300}, {"h", 0.25}}}},
+        QJsonObject{{"operationId", "b"}, {"opType", 6}, {"text", QStringLiteral("你好 ✓")}, {"bold", true}, {"font", QJsonValue()}},
+        QJsonObject{{"operationId", "c"}, {"opType", 2},
+                    {"path", QJsonObject{{"enc", "qdelta"}, {"v", 1}, {"n", 3}, {"data", QString(200, QChar('A'))}}},
+                    {"large", 4503599627370497.0}, {"negative", -123456789}}
+    };
+    state.undoStack = {
+        QJsonObject{{"operationId", "u"}, {"opType", 7}, {"itemIds", QJsonArray{"a", "b", QJsonArray{}, false}}}
+    };
+    state.redoStack = {
+        QJsonObject{{"operationId", "r"}, {"opType", 5}},
+        QJsonObject{}
+    };
+    return state;
+}
+
+QString writeFile(const QTemporaryDir &dir, const QByteArray &content)
+{
+    const QString fileName = dir.filePath("room.snap");
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return QString();
+    file.write(content);
+    return fileName;
+}
+
+void patchUInt32(QByteArray &content, int offset, quint32 value)
+{
+    qToLittleEndian<quint32>(value, content.data() + offset);
+}
+
+void patchUInt64(QByteArray &content, int offset, quint64 value)
+{
+    qToLittleEndian<quint64>(value, content.data() + offset);
+}
+}
+
+class tst_SnapshotFile : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void roundTripEmptyState();
+    void roomNameEqualToId();
+    void readHeaderOnly();
+    void detectsSnapshotFiles();
+    void rejectsBadMagicAndVersion();
+    void rejectsEveryTruncation();
+    void rejectsOutOfRangeOffsets();
+    void rejectsBadStringReferences();
+    void failedReadKeepsState();
+};
+
+void tst_SnapshotFile::roundTrip()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const RoomState state = sampleState();
+    const QString fileName = writeFile(dir, SnapshotFile::encode(state));
+    QVERIFY(!fileName.isEmpty());
+
+    RoomState decoded;
+    QVERIFY(SnapshotFile::read(fileName, decoded));
+    QCOMPARE(decoded.roomId, state.roomId);
+    QCOMPARE(decoded.roomName, state.roomName);
+    QCOMPARE(decoded.snapshot, state.snapshot);
+    QCOMPARE(decoded.undoStack, state.undoStack);
+    QCOMPARE(decoded.redoStack, state.redoStack);
+    // 操作日志不在快照文件中
+    QVERIFY(decoded.history.isEmpty());
+}
+
+void tst_SnapshotFile::roundTripEmptyState()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = writeFile(dir, SnapshotFile::encode(RoomState()));
+
+    RoomState decoded;
+    decoded.roomName = "stale";
+    decoded.undoStack = {QJsonObject{{"operationId", "x"}}};
+    QVERIFY(SnapshotFile::read(fileName, decoded));
+    QVERIFY(decoded.roomId.isEmpty());
+    QVERIFY(decoded.roomName.isEmpty());
+    QVERIFY(decoded.snapshot.isEmpty());
+    QVERIFY(decoded.undoStack.isEmpty());
+    QVERIFY(decoded.redoStack.isEmpty());
+}
+
+void tst_SnapshotFile::roomNameEqualToId()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    RoomState state = sampleState();
+    state.roomName = state.roomId;
+    const QString fileName = writeFile(dir, SnapshotFile::encode(state));
+
+    QString roomId;
+    QString roomName;
+    QVERIFY(SnapshotFile::readHeader(fileName, roomId, roomName));
+    QCOMPARE(roomName, state.roomId);
+
+    RoomState decoded;
+    QVERIFY(SnapshotFile::read(fileName, decoded));
+    QCOMPARE(decoded.roomId, state.roomId);
+    QCOMPARE(decoded.roomName, state.roomId);
+    QCOMPARE(decoded.snapshot, state.snapshot);
+}
+
+void tst_SnapshotFile::readHeaderOnly()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QByteArray content = SnapshotFile::encode(sampleState());
+
+    // 只读取字符串表的前两个字符串，记录区损坏不影响
+    content.truncate(content.size() - 1);
+    const QString fileName = writeFile(dir, content);
+
+    QString roomId;
+    QString roomName;
+    QVERIFY(SnapshotFile::readHeader(fileName, roomId, roomName));
+    QCOMPARE(roomId, sampleState().roomId);
+    QCOMPARE(roomName, sampleState().roomName);
+
+    QVERIFY(!SnapshotFile::readHeader(dir.filePath("missing.snap"), roomId, roomName));
+}
+
+void tst_SnapshotFile::detectsSnapshotFiles()
+{
+    const QByteArray content = SnapshotFile::encode(sampleState());
+    QVERIFY(SnapshotFile::isSnapshotFile(content.left(16)));
+    QVERIFY(!SnapshotFile::isSnapshotFile(content.left(4)));
+    // 旧版本的JSON快照
+    QVERIFY(!SnapshotFile::isSnapshotFile(QByteArray("{\"version\":1,\"roomId\":\"r\"}")));
+}
+
+void tst_SnapshotFile::rejectsBadMagicAndVersion()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray content = SnapshotFile::encode(sampleState());
+    RoomState decoded;
+    QString roomId;
+    QString roomName;
+
+    QByteArray badMagic = content;
+    badMagic[0] = 'X';
+    QString fileName = writeFile(dir, badMagic);
+    QVERIFY(!SnapshotFile::read(fileName, decoded));
+    QVERIFY(!SnapshotFile::readHeader(fileName, roomId, roomName));
+
+    QByteArray badVersion = content;
+    patchUInt32(badVersion, 8, SnapshotFile::FormatVersion + 1);
+    fileName = writeFile(dir, badVersion);
+    QVERIFY(!SnapshotFile::read(fileName, decoded));
+    QVERIFY(!SnapshotFile::readHeader(fileName, roomId, roomName));
+}
+
+void tst_SnapshotFile::rejectsEveryTruncation()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray content = SnapshotFile::encode(sampleState());
+    for (int length = 0; length < content.size(); ++length) {
+        RoomState decoded;
+        QVERIFY2(!SnapshotFile::read(writeFile(dir, content.left(length)), decoded),
+                 qPrintable(QString("截断到%1字节").arg(length)));
+    }
+}
+
+void tst_SnapshotFile::rejectsOutOfRangeOffsets()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray content = SnapshotFile::encode(sampleState());
+    RoomState decoded;
+    QString roomId;
+    QString roomName;
+
+    // 字符串表偏移超出文件
+    QByteArray strings = content;
+    patchUInt64(strings, StringTableOffset, content.size() + 1);
+    QString fileName = writeFile(dir, strings);
+    QVERIFY(!SnapshotFile::read(fileName, decoded));
+    QVERIFY(!SnapshotFile::readHeader(fileName, roomId, roomName));
+
+    // 字符串数量大于文件剩余字节
+    QByteArray stringCount = content;
+    patchUInt32(stringCount, StringCountOffset, 0xFFFFFFFFu);
+    QVERIFY(!SnapshotFile::read(writeFile(dir, stringCount), decoded));
+
+    for (int section = 0; section < 3; ++section) {
+        const int entry = SectionEntryOffset + section * SectionEntrySize;
+
+        // 分区索引偏移超出文件，以及指向文件末尾附近放不下索引的位置
+        QByteArray index = content;
+        patchUInt64(index, entry + 8, std::numeric_limits<quint64>::max());
+        QVERIFY(!SnapshotFile::read(writeFile(dir, index), decoded));
+        patchUInt64(index, entry + 8, content.size() - 4);
+        QVERIFY(!SnapshotFile::read(writeFile(dir, index), decoded));
+
+        // 记录数量远大于索引
+        QByteArray count = content;
+        patchUInt32(count, entry, 0xFFFFFFFFu);
+        QVERIFY(!SnapshotFile::read(writeFile(dir, count), decoded));
+    }
+
+    // 记录偏移超出文件，以及记录的起点在终点之后
+    const quint64 snapshotIndex = qFromLittleEndian<quint64>(content.constData() + SectionEntryOffset + 8);
+    QByteArray recordEnd = content;
+    patchUInt64(recordEnd, static_cast<int>(snapshotIndex) + 8, content.size() + 100);
+    QVERIFY(!SnapshotFile::read(writeFile(dir, recordEnd), decoded));
+
+    QByteArray recordOrder = content;
+    patchUInt64(recordOrder, static_cast<int>(snapshotIndex), content.size());
+    QVERIFY(!SnapshotFile::read(writeFile(dir, recordOrder), decoded));
+}
+
+void tst_SnapshotFile::rejectsBadStringReferences()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    // 字符串表只保留房间号和房间名称，记录中的键都成为越界的下标
+    QByteArray content = SnapshotFile::encode(sampleState());
+    patchUInt32(content, StringCountOffset, 2);
+
+    RoomState decoded;
+    QVERIFY(!SnapshotFile::read(writeFile(dir, content), decoded));
+}
+
+void tst_SnapshotFile::failedReadKeepsState()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray content = SnapshotFile::encode(sampleState());
+
+    RoomState state;
+    state.roomId = "kept";
+    state.snapshot = QJsonArray{QJsonObject{{"operationId", "k"}}};
+    QVERIFY(!SnapshotFile::read(writeFile(dir, content.left(content.size() - 1)), state));
+    QVERIFY(!SnapshotFile::read(dir.filePath("missing.snap"), state));
+    QCOMPARE(state.roomId, QString("kept"));
+    QCOMPARE(state.snapshot.size(), 1);
+}
+
+QTEST_GUILESS_MAIN(tst_SnapshotFile)
+
+#include "tst_snapshotfile.moc"
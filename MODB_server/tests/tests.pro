@@ -0,0 +1,9 @@
+# 服务端单元测试，每个子目录一个测试程序：qmake tests.pro && make && make check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    binarycodec \
+    pathcodec \
+    roomsnapshot \
+    roomstore \
+    snapshotfile
@@ -4,19 +4,19 @@
 #include <QObject>
 #include <QtWebSockets/QWebSocketServer>
 #include <QtWebSockets/QtWebSockets>
-#include <QMap>
-#include <map>
-#include <QSet>
+#include <QTcpServer>
+#include <QThread>
+#include <QVector>
+#include <QAtomicInt>
 #include <QString>
-#include <QMessageBox>
-#include <iostream>
 
-#include <QJsonArray>
-#include <QJsonObject>
-#include <QJsonDocument>
 #include <QUuid>
 #include "networkprotocol.h"
+#include "binaryprotocol.h"
+#include "roomworker.h"
+#include "roomstore.h"
 
+// 服务端入口：主线程只负责监听和接受连接，连接交给房间工作线程处理
 class WebSocketServer : public QObject
 {
     Q_OBJECT
@@ -28,24 +28,32 @@ public:
     bool startServer(QString ip, quint16 port);
     void stopServer();
     bool isRunning() const;
-    int getClientCount() const{return m_clients.size();};
+    int getClientCount() const{return m_clientCount.loadRelaxed();};
+
+    // 工作线程数量，只在服务端启动之前设置有效，默认为CPU核心数
+    void setWorkerThreadCount(int count);
+    int getWorkerThreadCount() const{return m_workerThreadCount;};
+
+    // 房间数据目录（操作日志和快照），只在服务端启动之前设置有效，为空时不持久化
+    void setDataDirectory(const QString &directory);
+    QString getDataDirectory() const{return m_dataDirectory;};
+    // 没有成员的房间空闲多少分钟后换出到磁盘，0表示不换出，需要启用持久化
+    void setRoomIdleMinutes(int minutes);
+    int getRoomIdleMinutes() const{return m_roomIdleMinutes;};
+    // 空闲房间换出次数和重新读取耗时
+    RoomDirectory::Stats getRoomStats() const{return m_roomDirectory.stats();};
+
+    // 指标接口：只监听本机地址，任意HTTP请求都返回文本格式的指标，0表示不开启；只在服务端启动之前设置有效
+    void setMetricsPort(quint16 port);
+    quint16 getMetricsPort() const{return m_metricsPort;};
+    // 汇总所有工作线程的消息数量、字节数和耗时直方图
+    QString metricsText() const;
 
     // 房间管理
     QString createRoom(const QString &roomName);
     bool removeRoom(const QString &roomId);
     QList<QString> getRoomList() const;
 
-    void sendError(QWebSocket *socket, const QString &errorMessage);
-    void processRoomListRequest(QWebSocket *socket);
-    void processLeaveRequest(QWebSocket *socket, const QJsonObject &data);
-    void processHeartbeat(QWebSocket *socket, const QJsonObject &data);
-    void processUserRoleChange(QWebSocket *socket, const QJsonObject &data);
-    void processChatMessage(QWebSocket *socket, const QJsonObject &data);
-    void processUndoRequest(QWebSocket *socket, const QJsonObject &data);
-    void processClearScene(QWebSocket *socket, const QJsonObject &data);
-    void processCreateRoomRequest(QWebSocket *socket, const QJsonObject &data);
-    void processRedoRequest(QWebSocket *socket, const QJsonObject &data);
-
 signals:
     void serverStarted();
     void serverStopped();
@@ -59,48 +67,29 @@ public slots:
 
 private slots:
     void onNewConnection();
-    void onClientDisconnected();
-    void onTextMessageReceived(const QString &message);
+    void onWorkerClientDisconnected(const QString &clientId);
+    void onMetricsConnection();
 
 private:
-    // 每一个客户端对应的信息，一个客户端可以加入多个房间
-    struct ClientInfo {
-        QWebSocket *socket;
-        QString userId;
-        QString userName;
-        UserRole role;
-        QString roomId;
-        QDateTime lastActive; // 最后活动时间
-    };
-    // 每一个房间对应的信息，包括有哪些客户端，一个房间可以有多个客户端
-    struct RoomInfo {
-        QString roomId;
-        QString roomName;
-        QSet<QString> clientIds;
-        QJsonArray drawingHistory; // 绘图历史记录
-        QList<QJsonObject> undoStack;       // 撤销栈
-        QList<QJsonObject> redoStack;       // 重做栈
-    };
-
     QWebSocketServer *m_webSocketServer;
-    QMap<QWebSocket*, ClientInfo> m_clients;
-    QMap<QString, RoomInfo> m_rooms;
-    QMap<QString, QWebSocket*> m_clientSockets;
-
-    void handleClientMessage(QWebSocket *socket, const NetworkMessage &message);
-    void processJoinRequest(QWebSocket *socket, const QJsonObject &data);
-    void processDrawingOperation(QWebSocket *socket, const QJsonObject &data);
-    void removeOperationFromHistory(const QString &roomId, const QString &operationId);
-    // 接收到来自客户端的数据之后，需要将数据同步到其他的客户端
-    void sendToClient(QWebSocket *socket, const NetworkMessage &message);
+    // 所有工作线程共享的房间目录
+    RoomDirectory m_roomDirectory;
+    QVector<QThread*> m_workerThreads;
+    QVector<RoomWorker*> m_workers;
+    int m_workerThreadCount;
+    int m_nextWorker;           // 新连接轮询分配到工作线程
+    QAtomicInt m_clientCount;
+    QString m_dataDirectory;
+    int m_roomIdleMinutes;
+    QTcpServer *m_metricsServer;
+    quint16 m_metricsPort;
+    RoomStore m_roomStore;      // 房间持久化，写线程在工作线程之外批量写入
+
+    void startWorkers();
+    void stopWorkers();
+
     // 指定的客户端ID
     QString generateClientId() const;
-    QString generateRoomId() const;
-
-    // 添加清理不活跃客户端的方法
-    void cleanupInactiveClients();
-
-    bool is_join_room;
 };
 
 #endif // WEBSOCKETSERVER_H